@@ -1,6 +1,13 @@
 import numpy as np
 import struct
 
+# Model file format: magic number ("PTM2" in little endian) and version:
+MODEL_MAGIC = 0x324D5450
+MODEL_VERSION = 6
+
+# Tensor data alignment (in bytes from the file beginning):
+TENSOR_ALIGNMENT = 64
+
 LAYER_DENSE = 1
 LAYER_CONV_1D = 2
 LAYER_CONV_2D = 3
@@ -15,6 +22,9 @@ LAYER_BATCH_NORMALIZATION = 12
 LAYER_LEAKY_RELU = 13
 LAYER_GLOBAL_MAXPOOLING_2D = 14
 LAYER_INPUT = 15
+LAYER_MASKING = 16
+LAYER_GRU = 17
+LAYER_SIMPLE_RNN = 18
 
 
 ACTIVATION_LINEAR = 1
@@ -29,15 +39,30 @@ ACTIVATION_SOFTMAX = 9
 ACTIVATION_SELU = 10
 
 
+PADDING_VALID = 0
+PADDING_SAME = 1
+
+
+WEIGHTS_FLOAT = 0
+WEIGHTS_INT8 = 1
+
+
 def write_tensor(f, data, dims=1):
     '''
     Writes tensor as flat array of floats to file in 1024 chunks,
     prevents memory explosion writing very large arrays to disk
     when calling struct.pack().
+
+    Data is preceded by padding bytes which align it to TENSOR_ALIGNMENT bytes,
+    so the runtime can use it directly from the memory mapped file.
     '''
     for stride in data.shape[:dims]:
         f.write(struct.pack('I', stride))
 
+    padding = -(f.tell() + 4) % TENSOR_ALIGNMENT
+    f.write(struct.pack('I', padding))
+    f.write(b'\0' * padding)
+
     data = data.flatten()
     step = 1024
     written = 0
@@ -50,6 +75,50 @@ def write_tensor(f, data, dims=1):
     assert written == len(data)
 
 
+def write_quantized_tensor(f, data, dims=1):
+    '''
+    Writes tensor as int8 values with one scale for each row (first dimension):
+    row values are divided by max(abs(row)) / 127 and rounded, so they fit in [-127, 127].
+
+    Scales are written first as a float tensor, followed by the tensor dims,
+    the padding bytes and the int8 values.
+    '''
+    rows = data.reshape((data.shape[0], -1)).astype(np.float64)
+    scales = np.abs(rows).max(axis=1) / 127
+    scales[scales == 0] = 1
+    values = np.clip(np.round(rows / scales[:, np.newaxis]), -127, 127).astype(np.int8)
+
+    write_tensor(f, scales.astype('f'))
+
+    for stride in data.shape[:dims]:
+        f.write(struct.pack('I', stride))
+
+    padding = -(f.tell() + 4) % TENSOR_ALIGNMENT
+    f.write(struct.pack('I', padding))
+    f.write(b'\0' * padding)
+    f.write(values.tobytes())
+
+
+def export_weights_type(f, quantize):
+    f.write(struct.pack('I', WEIGHTS_INT8 if quantize else WEIGHTS_FLOAT))
+
+
+def write_weights(f, data, dims, quantize):
+    if quantize:
+        write_quantized_tensor(f, data, dims)
+    else:
+        write_tensor(f, data, dims)
+
+
+def export_padding(f, padding):
+    if padding == 'valid':
+        f.write(struct.pack('I', PADDING_VALID))
+    elif padding == 'same':
+        f.write(struct.pack('I', PADDING_SAME))
+    else:
+        assert False, "Unsupported padding type: %s" % padding
+
+
 def export_activation(f, activation):
     if activation == 'linear':
         f.write(struct.pack('I', ACTIVATION_LINEAR))
@@ -91,7 +160,7 @@ def export_layer_normalization(f, layer):
     write_tensor(f, biases)
 
 
-def export_layer_dense(f, layer):
+def export_layer_dense(f, layer, quantize):
     weights = layer.get_weights()[0]
     biases = layer.get_weights()[1]
     activation = layer.get_config()['activation']
@@ -100,40 +169,54 @@ def export_layer_dense(f, layer):
     # shape: (outputs, dims)
 
     f.write(struct.pack('I', LAYER_DENSE))
+    export_weights_type(f, quantize)
 
-    write_tensor(f, weights, 2)
+    write_weights(f, weights, 2, quantize)
     write_tensor(f, biases)
 
     export_activation(f, activation)
 
 
-def export_layer_conv1d(f, layer):
+def export_layer_conv1d(f, layer, quantize):
     weights = layer.get_weights()[0]
     biases = layer.get_weights()[1]
     activation = layer.get_config()['activation']
 
+    strides = layer.get_config()['strides']
+    dilation_rate = layer.get_config()['dilation_rate']
+    assert layer.get_config()['padding'] == 'valid', "Unsupported Conv1D padding type"
+
     weights = weights.transpose(2, 0, 1)
     # shape: (outputs, steps, dims)
 
     f.write(struct.pack('I', LAYER_CONV_1D))
-    write_tensor(f, weights, 3)
+    export_weights_type(f, quantize)
+    write_weights(f, weights, 3, quantize)
     write_tensor(f, biases)
     export_activation(f, activation)
+    f.write(struct.pack('II', strides[0], dilation_rate[0]))
 
 
-def export_layer_conv2d(f, layer):
+def export_layer_conv2d(f, layer, quantize):
     weights = layer.get_weights()[0]
     biases = layer.get_weights()[1]
     activation = layer.get_config()['activation']
 
+    padding = layer.get_config()['padding']
+    strides = layer.get_config()['strides']
+    dilation_rate = layer.get_config()['dilation_rate']
+
     weights = weights.transpose(3, 0, 1, 2)
     # shape: (outputs, rows, cols, depth)
 
     f.write(struct.pack('I', LAYER_CONV_2D))
-    write_tensor(f, weights, 4)
+    export_weights_type(f, quantize)
+    write_weights(f, weights, 4, quantize)
     write_tensor(f, biases)
 
     export_activation(f, activation)
+    export_padding(f, padding)
+    f.write(struct.pack('IIII', strides[0], strides[1], dilation_rate[0], dilation_rate[1]))
 
 
 def export_layer_locally1d(f, layer):
@@ -154,15 +237,18 @@ def export_layer_locally1d(f, layer):
 
 def export_layer_maxpooling2d(f, layer):
     pool_size = layer.get_config()['pool_size']
+    strides = layer.get_config()['strides'] or pool_size
+    assert layer.get_config()['padding'] == 'valid', "Unsupported MaxPooling2D padding type"
 
     f.write(struct.pack('I', LAYER_MAXPOOLING_2D))
     f.write(struct.pack('I', pool_size[0]))
     f.write(struct.pack('I', pool_size[1]))
+    f.write(struct.pack('II', strides[0], strides[1]))
 
 def export_layer_globalmaxpooling2d(f, layer):
     f.write(struct.pack('I', LAYER_GLOBAL_MAXPOOLING_2D))
 
-def export_layer_lstm(f, layer):
+def export_layer_lstm(f, layer, quantize):
     inner_activation = layer.get_config()['recurrent_activation']
     activation = layer.get_config()['activation']
     return_sequences = int(layer.get_config()['return_sequences'])
@@ -186,21 +272,22 @@ def export_layer_lstm(f, layer):
     b_o = weights[2][-units:].reshape((1, -1))
 
     f.write(struct.pack('I', LAYER_LSTM))
+    export_weights_type(f, quantize)
 
-    write_tensor(f, W_i, 2)
-    write_tensor(f, U_i, 2)
+    write_weights(f, W_i, 2, quantize)
+    write_weights(f, U_i, 2, quantize)
     write_tensor(f, b_i, 2)
 
-    write_tensor(f, W_f, 2)
-    write_tensor(f, U_f, 2)
+    write_weights(f, W_f, 2, quantize)
+    write_weights(f, U_f, 2, quantize)
     write_tensor(f, b_f, 2)
 
-    write_tensor(f, W_c, 2)
-    write_tensor(f, U_c, 2)
+    write_weights(f, W_c, 2, quantize)
+    write_weights(f, U_c, 2, quantize)
     write_tensor(f, b_c, 2)
 
-    write_tensor(f, W_o, 2)
-    write_tensor(f, U_o, 2)
+    write_weights(f, W_o, 2, quantize)
+    write_weights(f, U_o, 2, quantize)
     write_tensor(f, b_o, 2)
 
     export_activation(f, inner_activation)
@@ -208,42 +295,103 @@ def export_layer_lstm(f, layer):
     f.write(struct.pack('I', return_sequences))
 
 
+def export_layer_gru(f, layer):
+    inner_activation = layer.get_config()['recurrent_activation']
+    activation = layer.get_config()['activation']
+    reset_after = int(layer.get_config().get('reset_after', False))
+    return_sequences = int(layer.get_config()['return_sequences'])
+
+    weights = layer.get_weights()
+
+    # Gates are packed in Keras order (update, reset and candidate), with a row for each gate output:
+    W = weights[0].transpose()
+    U = weights[1].transpose()
+
+    if reset_after:
+        b = weights[2][0]
+        b_recurrent = weights[2][1]
+    else:
+        b = weights[2]
+        b_recurrent = np.zeros_like(b)
+
+    f.write(struct.pack('I', LAYER_GRU))
+    write_tensor(f, W, 2)
+    write_tensor(f, U, 2)
+    write_tensor(f, b)
+    write_tensor(f, b_recurrent)
+
+    export_activation(f, inner_activation)
+    export_activation(f, activation)
+    f.write(struct.pack('I', reset_after))
+    f.write(struct.pack('I', return_sequences))
+
+
+def export_layer_simple_rnn(f, layer):
+    activation = layer.get_config()['activation']
+    return_sequences = int(layer.get_config()['return_sequences'])
+
+    weights = layer.get_weights()
+
+    f.write(struct.pack('I', LAYER_SIMPLE_RNN))
+    write_tensor(f, weights[0].transpose(), 2)
+    write_tensor(f, weights[1].transpose(), 2)
+    write_tensor(f, weights[2])
+
+    export_activation(f, activation)
+    f.write(struct.pack('I', return_sequences))
+
+
 def export_layer_embedding(f, layer):
     weights = layer.get_weights()[0]
 
+    mask_zero = int(layer.get_config()['mask_zero'])
+
     f.write(struct.pack('I', LAYER_EMBEDDING))
     write_tensor(f, weights, 2)
+    f.write(struct.pack('I', mask_zero))
 
 def export_layer_input(f, layer):
 
     f.write(struct.pack('I', LAYER_INPUT))
 
 
-def export_model(model, filename):
+def export_model(model, filename, quantize=False):
+    '''
+    If quantize is True, weights of Dense, Conv1D, Conv2D and LSTM layers are stored as int8 values
+    with one scale for each output channel (see README.md for the expected accuracy loss).
+    GRU and SimpleRNN weights are always stored as float values.
+    '''
     with open(filename, 'wb') as f:
         model_layers = [
             l for l in model.layers  if type(l).__name__ not in ['Dropout', 'Sequential']]
         if type(model.layers[-1]).__name__ == 'Sequential':
             model_layers += model.layers[-1].layers
         num_layers = len(model_layers)
-        f.write(struct.pack('I', num_layers))
+
+        # Header: magic number, version, layers count, reserved field and layers table
+        # (offset of each layer from the file beginning, written once all layers are exported):
+        f.write(struct.pack('IIII', MODEL_MAGIC, MODEL_VERSION, num_layers, 0))
+        layers_table_offset = f.tell()
+        f.write(struct.pack('=%sQ' % num_layers, *([0] * num_layers)))
+        layer_offsets = []
 
         for layer in model_layers:
             layer_type = type(layer).__name__
+            layer_offsets.append(f.tell())
 
             if layer_type == 'Dense':
-                export_layer_dense(f, layer)
+                export_layer_dense(f, layer, quantize)
             elif layer_type == 'InputLayer':
                 export_layer_input(f, layer)
 
             elif layer_type == 'Conv1D':
-                export_layer_conv1d(f, layer)
+                export_layer_conv1d(f, layer, quantize)
 
             elif layer_type == 'Conv1D':
-                export_layer_conv1d(f, layer)
+                export_layer_conv1d(f, layer, quantize)
 
             elif layer_type == 'Conv2D':
-                export_layer_conv2d(f, layer)
+                export_layer_conv2d(f, layer, quantize)
 
             elif layer_type == 'LocallyConnected1D':
                 export_layer_locally1d(f, layer)
@@ -267,7 +415,13 @@ def export_model(model, filename):
                 export_layer_globalmaxpooling2d(f, layer)
 
             elif layer_type == 'LSTM':
-                export_layer_lstm(f, layer)
+                export_layer_lstm(f, layer, quantize)
+
+            elif layer_type == 'GRU':
+                export_layer_gru(f, layer)
+
+            elif layer_type == 'SimpleRNN':
+                export_layer_simple_rnn(f, layer)
 
             elif layer_type == 'Embedding':
                 export_layer_embedding(f, layer)
@@ -275,9 +429,16 @@ def export_model(model, filename):
             elif layer_type == 'BatchNormalization':
                 export_layer_normalization(f, layer)
 
+            elif layer_type == 'Masking':
+                f.write(struct.pack('I', LAYER_MASKING))
+                f.write(struct.pack('f', layer.mask_value))
+
             elif layer_type == 'LeakyReLU':
                 f.write(struct.pack('I', LAYER_LEAKY_RELU))
                 f.write(struct.pack('f', layer.alpha))
 
             else:
                 assert False, "Unsupported layer type: %s" % layer_type
+
+        f.seek(layers_table_offset)
+        f.write(struct.pack('=%sQ' % num_layers, *layer_offsets))
@@ -0,0 +1,80 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_DISPATCHER_H
+#define PT_DISPATCHER_H
+
+#include <memory>
+#include <thread>
+
+namespace pt
+{
+
+class Dispatcher
+{
+
+public:
+    // Minimum amount of work (approximated as multiply-adds) assigned to each task:
+    static constexpr int MinTaskCost = 1 << 14;
+
+    // threadsCount includes the calling thread, so Dispatcher(1) doesn't spawn any worker thread:
+    explicit Dispatcher(std::size_t threadsCount = std::thread::hardware_concurrency());
+
+    ~Dispatcher() noexcept;
+
+    Dispatcher(const Dispatcher& other) = delete;
+
+    Dispatcher& operator=(const Dispatcher& other) = delete;
+
+    std::size_t getThreadsCount() const noexcept
+    {
+        return _threadsCount;
+    }
+
+    // Splits [0, its) in contiguous chunks and calls task(begin, end) for each one of them
+    // from the worker threads and the calling thread. Returns when all chunks have been processed.
+    // itCost is the approximated cost of each iteration, used to avoid waking up threads for tiny loops:
+    template<class Task>
+    void run(int its, int itCost, const Task& task)
+    {
+        int tasksCount = _getTasksCount(its, itCost);
+
+        if(tasksCount <= 1)
+        {
+            if(its > 0)
+            {
+                task(0, its);
+            }
+        }
+        else
+        {
+            _run(its, tasksCount, &Dispatcher::_invoke<Task>, &task);
+        }
+    }
+
+protected:
+    using Invoker = void(*)(const void* task, int begin, int end);
+
+    struct Data;
+
+    std::unique_ptr<Data> _data;
+    std::size_t _threadsCount;
+
+    template<class Task>
+    static void _invoke(const void* task, int begin, int end)
+    {
+        (*static_cast<const Task*>(task))(begin, end);
+    }
+
+    int _getTasksCount(int its, int itCost) const noexcept;
+
+    void _run(int its, int tasksCount, Invoker invoker, const void* task);
+};
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_EXECUTION_CONTEXT_H
+#define PT_EXECUTION_CONTEXT_H
+
+#include <array>
+#include <vector>
+#include "pt_tensor.h"
+#include "pt_dispatcher.h"
+
+namespace pt
+{
+
+class Model;
+
+// Memory required to run predictions of a model.
+//
+// All intermediate tensors are stored in one arena split in two ping-pong buffers
+// (each layer reads from one buffer and writes to the other one), sized from the output dims
+// of every layer for the given input dims. Temporary tensors used by some layers (like LSTM gates)
+// are kept too, so after the first prediction, predictions with the same input dims
+// don't allocate memory (as long as the output tensor is reused too).
+//
+// A context can't be used by more than one thread at the same time.
+class ExecutionContext
+{
+
+public:
+    explicit ExecutionContext(const Model& model);
+
+    ExecutionContext(const Model& model, Dispatcher& dispatcher);
+
+    ExecutionContext(const ExecutionContext& other) = delete;
+
+    ExecutionContext& operator=(const ExecutionContext& other) = delete;
+
+    const Model& getModel() const noexcept
+    {
+        return _model;
+    }
+
+    Dispatcher& getDispatcher() noexcept
+    {
+        return _dispatcher;
+    }
+
+    const Tensor::DimsVector& getInputDims() const noexcept
+    {
+        return _inDims;
+    }
+
+    // Model output dims for the planned input dims:
+    const Tensor::DimsVector& getOutputDims() const noexcept
+    {
+        return _outDims;
+    }
+
+    // Size in bytes of the arena memory:
+    std::size_t getArenaSize() const noexcept
+    {
+        return _arena.size() * sizeof(Tensor::Type);
+    }
+
+    // Infers the dims of all intermediate tensors and allocates the arena for the given input dims
+    // (Model::predict calls it when the input dims are different from the planned ones):
+    bool plan(const Tensor::DimsVector& inDims);
+
+protected:
+    friend class Model;
+
+    const Model& _model;
+    Dispatcher _ownDispatcher;
+    Dispatcher& _dispatcher;
+    Tensor::DimsVector _inDims;
+    Tensor::DimsVector _outDims;
+    Tensor::DimsVector _layerInDims;
+    Tensor::DimsVector _layerOutDims;
+    Tensor::DataVector _arena;
+    std::size_t _bufferSize = 0;
+    std::array<Tensor, 2> _buffers;
+    Tensor _mask; // Timesteps mask of the current layer input (see LayerData).
+    std::vector<Tensor> _scratch;
+
+    // Tensors which store their data in caller memory (see TensorView):
+    Tensor _inTensor;
+    Tensor _outTensor;
+
+    // Points the buffers to the arena again (layers which work in place swap them with other tensors):
+    void _resetBuffers() noexcept;
+
+    // Resizes the given tensor to the given dims, storing its data in the given memory if it is not null:
+    static void _wrap(Tensor& tensor, Tensor::Type* data, const Tensor::DimsVector& dims);
+};
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_EXECUTION_CONTEXT_POOL_H
+#define PT_EXECUTION_CONTEXT_POOL_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "pt_execution_context.h"
+#include "pt_tensor_view.h"
+
+namespace pt
+{
+
+// Set of execution contexts of a model, so many threads can run predictions at the same time
+// sharing the model weights, without allocating memory once each context has been used with the input dims.
+//
+// Contexts are acquired and released without locks: each slot of the pool stores an idle context or null,
+// and threads claim them with atomic exchanges. If all contexts are in use, a new one is created
+// (and it is deleted when it is released if there's no empty slot to keep it).
+class ExecutionContextPool
+{
+
+public:
+    // Acquired context, which is returned to the pool when the handle is destroyed:
+    class Handle
+    {
+
+    public:
+        Handle(Handle&& other) noexcept;
+
+        ~Handle() noexcept;
+
+        Handle(const Handle& other) = delete;
+
+        Handle& operator=(const Handle& other) = delete;
+
+        ExecutionContext& operator*() const noexcept
+        {
+            return *_context;
+        }
+
+        ExecutionContext* operator->() const noexcept
+        {
+            return _context;
+        }
+
+    protected:
+        friend class ExecutionContextPool;
+
+        ExecutionContextPool* _pool;
+        ExecutionContext* _context;
+
+        Handle(ExecutionContextPool& pool, ExecutionContext* context) noexcept;
+    };
+
+    // Contexts are created up front (their memory is allocated when they are planned).
+    // Each context runs its predictions in the calling thread only:
+    explicit ExecutionContextPool(const Model& model,
+                                  std::size_t contextsCount = std::thread::hardware_concurrency());
+
+    ~ExecutionContextPool() noexcept;
+
+    ExecutionContextPool(const ExecutionContextPool& other) = delete;
+
+    ExecutionContextPool& operator=(const ExecutionContextPool& other) = delete;
+
+    const Model& getModel() const noexcept
+    {
+        return _model;
+    }
+
+    // Maximum number of idle contexts kept by the pool:
+    std::size_t getContextsCount() const noexcept
+    {
+        return _slotsCount;
+    }
+
+    Handle acquire();
+
+    // Run a prediction with an idle context (see Model::predict):
+    bool predict(const Tensor& in, Tensor& out);
+
+    bool predict(const ConstTensorView& in, const TensorView& out);
+
+protected:
+    // Each slot fills a cache line (64 bytes in x86-64 and most ARM CPUs), so threads claiming different slots
+    // don't invalidate each other's cache lines:
+    struct Slot
+    {
+        std::atomic<ExecutionContext*> context;
+        char padding[64 - sizeof(std::atomic<ExecutionContext*>)];
+    };
+
+    const Model& _model;
+    std::unique_ptr<Slot[]> _slots;
+    std::size_t _slotsCount;
+
+    void _release(ExecutionContext* context) noexcept;
+};
+
+}
+
+#endif
@@ -9,23 +9,44 @@
 #define PT_LAYER_H
 
 #include <memory>
+#include <vector>
 #include <iosfwd>
 
 namespace pt
 {
 
 struct LayerData;
+struct BatchLayerData;
 
 class Layer
 {
 
 public:
+    using DimsVector = std::vector<std::size_t>;
+
     static std::unique_ptr<Layer> create(std::istream& stream);
 
     virtual ~Layer() noexcept;
 
     virtual bool apply(LayerData& layerData) const = 0;
 
+    // Applies the layer to each sample of the batch (by default, one by one):
+    virtual bool applyBatch(BatchLayerData& batchLayerData) const;
+
+    // Retrieves the output tensor dims for the given input tensor dims without applying the layer:
+    virtual bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const = 0;
+
+    // Minimum buffer size of the input tensor (greater than the input size if it is expanded in place):
+    virtual std::size_t getInputBufferSize(const DimsVector& inDims) const;
+
+    // Returns true if the output is stored in the input tensor (apply swaps them and updates the output in place):
+    virtual bool isInPlace() const noexcept;
+
+    // Merges the next layer into this one if it is possible, so it doesn't need its own pass over the output
+    // tensor (called when the model is loaded). Returns true if the next layer has been merged.
+    // A layer can also move part of its work to the next layer without merging it (like Embedding into LSTM):
+    virtual bool merge(std::unique_ptr<Layer>& nextLayer);
+
 protected:
     Layer() = default;
 };
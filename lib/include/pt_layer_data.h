@@ -8,17 +8,46 @@
 #ifndef PT_LAYER_DATA_H
 #define PT_LAYER_DATA_H
 
+#include <vector>
 #include "pt_tensor.h"
 
 namespace pt
 {
 
+class Dispatcher;
 class Config;
 
 struct LayerData
 {
-    Tensor in;
+    Tensor& in;
     Tensor& out;
+
+    // Timesteps mask of the input sequence, with a value for each input dims[0] row (0 if the timestep is masked).
+    // It is empty if the input is not masked. Layers which generate a mask (like Embedding with mask_zero) write it,
+    // and recurrent layers skip masked timesteps (the ones which only return their last output clear it):
+    Tensor& mask;
+
+    // Tensors which the layer can use as temporary memory (it can resize the vector and its tensors).
+    // They are reused by the next layers and predictions (an ExecutionContext keeps them between predictions,
+    // so resizing them to the same dims doesn't allocate memory):
+    std::vector<Tensor>& scratch;
+
+    Dispatcher& dispatcher;
+    const Config& config;
+};
+
+struct BatchLayerData
+{
+    std::vector<Tensor> in;
+    std::vector<Tensor>& out;
+
+    // Timesteps mask of each input sample (see LayerData). It is empty if no sample is masked:
+    std::vector<Tensor> masks;
+
+    // Temporary memory shared by all layers of the batch (see LayerData):
+    std::vector<Tensor>& scratch;
+
+    Dispatcher& dispatcher;
     const Config& config;
 };
 
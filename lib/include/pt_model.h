@@ -11,22 +11,46 @@
 #include <vector>
 #include "pt_layer.h"
 #include "pt_config.h"
+#include "pt_tensor_view.h"
 
 namespace pt
 {
 
-class Tensor;
+class Dispatcher;
+class ExecutionContext;
+class MappedFile;
+class ModelStream;
 
 class Model
 {
 
 public:
+    // Model files are mapped in memory, so the weights of aligned (v2) model files
+    // are not copied, they are read from the file pages shared with the page cache:
     static std::unique_ptr<Model> create(const std::string& filePath);
 
     static std::unique_ptr<Model> create(std::istream& stream);
 
+    ~Model() noexcept;
+
     bool predict(Tensor in, Tensor& out) const;
 
+    bool predict(Dispatcher& dispatcher, Tensor in, Tensor& out) const;
+
+    // Stores all intermediate tensors in the given context, so a prediction doesn't allocate memory
+    // if the context has been planned for the input dims and the output tensor is reused:
+    bool predict(ExecutionContext& context, const Tensor& in, Tensor& out) const;
+
+    // Reads the input from and writes the output to memory owned by the caller
+    // (output dims must be the model output dims for the input dims, see ExecutionContext::getOutputDims):
+    bool predict(ExecutionContext& context, const ConstTensorView& in, const TensorView& out) const;
+
+    // Runs a prediction for each input sample, processing all of them in each layer before moving
+    // to the next one (so layer weights are reused while they are still in cache):
+    bool predictBatch(const std::vector<Tensor>& in, std::vector<Tensor>& out) const;
+
+    bool predictBatch(Dispatcher& dispatcher, const std::vector<Tensor>& in, std::vector<Tensor>& out) const;
+
     const Config& getConfig() const noexcept
     {
         return _config;
@@ -43,10 +67,16 @@ public:
     }
 
 protected:
+    std::unique_ptr<MappedFile> _mappedFile;
     std::vector<std::unique_ptr<Layer>> _layers;
     Config _config;
 
     Model(std::vector<std::unique_ptr<Layer>>&& layers) noexcept;
+
+    // Returns the tensor which stores the output, or null if the prediction failed:
+    const Tensor* _predict(ExecutionContext& context, const ConstTensorView& in, const TensorView* out) const;
+
+    static std::unique_ptr<Model> _create(ModelStream& stream);
 };
 
 }
@@ -0,0 +1,85 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_STREAMING_SESSION_H
+#define PT_STREAMING_SESSION_H
+
+#include <array>
+#include <vector>
+#include "pt_tensor.h"
+#include "pt_dispatcher.h"
+
+namespace pt
+{
+
+class Model;
+
+// Runs a sequence model one timestep at a time.
+//
+// The session keeps the state of each recurrent layer (like LSTM hidden and cell states) between step calls,
+// so feeding a sequence frame by frame gives the same outputs as predicting each growing sequence at once,
+// but each frame costs one timestep instead of the whole sequence length.
+//
+// Layers before the recurrent ones must process each timestep independently (like Embedding).
+//
+// A session can't be used by more than one thread at the same time.
+class StreamingSession
+{
+
+public:
+    // State of all layers (empty tensors for the non recurrent ones):
+    using State = std::vector<Tensor>;
+
+    explicit StreamingSession(const Model& model);
+
+    StreamingSession(const Model& model, Dispatcher& dispatcher);
+
+    StreamingSession(const StreamingSession& other) = delete;
+
+    StreamingSession& operator=(const StreamingSession& other) = delete;
+
+    const Model& getModel() const noexcept
+    {
+        return _model;
+    }
+
+    Dispatcher& getDispatcher() noexcept
+    {
+        return _dispatcher;
+    }
+
+    // Advances all layers one timestep. frame has the model input dims with only one timestep
+    // ([1, features] for a LSTM input, [1] for an Embedding input):
+    bool step(const Tensor& frame, Tensor& out);
+
+    // Clears the state, so the next step starts a new sequence:
+    void reset() noexcept;
+
+    // Returns a copy of the current state:
+    State snapshot() const
+    {
+        return _state;
+    }
+
+    // Replaces the current state with one retrieved from snapshot:
+    bool restore(const State& state);
+
+protected:
+    const Model& _model;
+    Dispatcher _ownDispatcher;
+    Dispatcher& _dispatcher;
+    State _state;
+    std::array<Tensor, 2> _buffers;
+    Tensor _mask; // Mask of the current frame (see LayerData).
+    std::vector<Tensor> _scratch;
+
+    void _init();
+};
+
+}
+
+#endif
@@ -33,6 +33,14 @@ public:
 
     Tensor() = default;
 
+    Tensor(const Tensor& other);
+
+    Tensor& operator=(const Tensor& other);
+
+    Tensor(Tensor&& other) noexcept;
+
+    Tensor& operator=(Tensor&& other) noexcept;
+
     Tensor(std::size_t i)
     {
         resize(i);
@@ -68,11 +76,24 @@ public:
         return getSizeImpl(_dims);
     }
 
-    const DataVector& getData() const noexcept
+    // The data can be stored in an external buffer (see setBuffer), so it is returned as a pointer
+    // to getSize() elements instead of as a DataVector:
+    const Type* getData() const noexcept
     {
-        return _data;
+        return begin();
     }
 
+    // Number of elements which can be stored without allocating memory (only for external buffers):
+    std::size_t getBufferSize() const noexcept
+    {
+        return _bufferSize;
+    }
+
+    // Stores the tensor data in the given buffer instead of in its own memory
+    // (resize calls which don't fit in the buffer move the tensor data back to its own memory).
+    // The buffer must be aligned to Alignment bytes and it must outlive the tensor:
+    void setBuffer(Type* buffer, std::size_t bufferSize) noexcept;
+
     Type operator()(std::size_t i) const noexcept
     {
         return const_cast<Tensor&>(*this).operator()(i);
@@ -83,7 +104,7 @@ public:
         PT_ASSERT(_dims.size() == 1);
         PT_ASSERT(i < _dims[0]);
 
-        return _data[i];
+        return _ptr()[i];
     }
 
     Type operator()(std::size_t i, std::size_t j) const noexcept
@@ -97,7 +118,7 @@ public:
         PT_ASSERT(i < _dims[0]);
         PT_ASSERT(j < _dims[1]);
 
-        return _data[_dims[1] * i + j];
+        return _ptr()[_dims[1] * i + j];
     }
 
     Type operator()(std::size_t i, std::size_t j, std::size_t k) const noexcept
@@ -112,7 +133,7 @@ public:
         PT_ASSERT(j < _dims[1]);
         PT_ASSERT(k < _dims[2]);
 
-        return _data[_dims[2] * (_dims[1] * i + j) + k];
+        return _ptr()[_dims[2] * (_dims[1] * i + j) + k];
     }
 
     Type operator()(std::size_t i, std::size_t j, std::size_t k, std::size_t l) const noexcept
@@ -128,27 +149,27 @@ public:
         PT_ASSERT(k < _dims[2]);
         PT_ASSERT(l < _dims[3]);
 
-        return _data[_dims[3] * (_dims[2] * (_dims[1] * i + j) + k) + l];
+        return _ptr()[_dims[3] * (_dims[2] * (_dims[1] * i + j) + k) + l];
     }
 
-    typename DataVector::const_iterator begin() const noexcept
+    const Type* begin() const noexcept
     {
-        return _data.begin();
+        return const_cast<Tensor&>(*this)._ptr();
     }
 
-    typename DataVector::iterator begin() noexcept
+    Type* begin() noexcept
     {
-        return _data.begin();
+        return _ptr();
     }
 
-    typename DataVector::const_iterator end() const noexcept
+    const Type* end() const noexcept
     {
-        return _data.end();
+        return begin() + getSize();
     }
 
-    typename DataVector::iterator end() noexcept
+    Type* end() noexcept
     {
-        return _data.end();
+        return begin() + getSize();
     }
 
     void copyTo(Tensor& other) const;
@@ -163,9 +184,11 @@ public:
 
     void setData(DataVector &&data) noexcept
     {
-        PT_ASSERT(_data.size() == data.size());
+        PT_ASSERT(getSize() == data.size());
 
         _data = std::move(data);
+        _buffer = nullptr;
+        _bufferSize = 0;
     }
 
     void fill(Type value) noexcept;
@@ -237,9 +260,23 @@ public:
 protected:
     DimsVector _dims;
     DataVector _data;
+    Type* _buffer = nullptr;
+    std::size_t _bufferSize = 0;
+
+    Type* _ptr() noexcept
+    {
+        return _buffer ? _buffer : _data.data();
+    }
+
+    void _resizeData(std::size_t size);
 
     static std::size_t getSizeImpl(const DimsVector& dims) noexcept
     {
+        if(dims.empty())
+        {
+            return 0;
+        }
+
         std::size_t size = 1;
 
         for(std::size_t dim : dims)
@@ -0,0 +1,146 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_TENSOR_VIEW_H
+#define PT_TENSOR_VIEW_H
+
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include <initializer_list>
+#include "pt_tensor.h"
+
+namespace pt
+{
+
+// Non-owning reference to a dense, row-major tensor stored in memory owned by the caller
+// (like a decoder frame or a row of a memory mapped file), so it can be passed to Model::predict without copies.
+//
+// Data aligned to Tensor::Alignment bytes is read or written in place, otherwise it is copied.
+template<class T>
+class BasicTensorView
+{
+
+public:
+    using Type = T;
+
+    static constexpr std::size_t MaxDims = 4;
+
+    BasicTensorView(Type* data, std::initializer_list<std::size_t> dims) noexcept :
+        _data(data),
+        _dims(),
+        _dimsCount(dims.size())
+    {
+        PT_ASSERT(_dimsCount <= MaxDims);
+
+        std::copy(dims.begin(), dims.end(), _dims.begin());
+    }
+
+    BasicTensorView(Type* data, const Tensor::DimsVector& dims) noexcept :
+        _data(data),
+        _dims(),
+        _dimsCount(dims.size())
+    {
+        PT_ASSERT(_dimsCount <= MaxDims);
+
+        std::copy(dims.begin(), dims.end(), _dims.begin());
+    }
+
+    BasicTensorView(Tensor& tensor) noexcept :
+        BasicTensorView(tensor.begin(), tensor.getDims())
+    {
+    }
+
+    BasicTensorView(const Tensor& tensor) noexcept :
+        BasicTensorView(tensor.begin(), tensor.getDims())
+    {
+    }
+
+    // Mutable views can be converted to const ones:
+    template<class OtherType>
+    BasicTensorView(const BasicTensorView<OtherType>& other) noexcept :
+        _data(other.begin()),
+        _dims(),
+        _dimsCount(other.getDimsCount())
+    {
+        for(std::size_t index = 0; index != _dimsCount; ++index)
+        {
+            _dims[index] = other.getDim(index);
+        }
+    }
+
+    Type* begin() const noexcept
+    {
+        return _data;
+    }
+
+    Type* end() const noexcept
+    {
+        return _data + getSize();
+    }
+
+    std::size_t getDimsCount() const noexcept
+    {
+        return _dimsCount;
+    }
+
+    std::size_t getDim(std::size_t index) const noexcept
+    {
+        PT_ASSERT(index < _dimsCount);
+
+        return _dims[index];
+    }
+
+    std::size_t getSize() const noexcept
+    {
+        if(! _dimsCount)
+        {
+            return 0;
+        }
+
+        std::size_t size = 1;
+
+        for(std::size_t index = 0; index != _dimsCount; ++index)
+        {
+            size *= _dims[index];
+        }
+
+        return size;
+    }
+
+    bool isValid() const noexcept
+    {
+        return _data && getSize();
+    }
+
+    bool isAligned() const noexcept
+    {
+        return reinterpret_cast<std::uintptr_t>(_data) % Tensor::Alignment == 0;
+    }
+
+    bool hasDims(const Tensor::DimsVector& dims) const noexcept
+    {
+        return dims.size() == _dimsCount && std::equal(dims.begin(), dims.end(), _dims.begin());
+    }
+
+    Tensor::DimsVector getDims() const
+    {
+        return Tensor::DimsVector(_dims.begin(), _dims.begin() + long(_dimsCount));
+    }
+
+protected:
+    Type* _data;
+    std::array<std::size_t, MaxDims> _dims;
+    std::size_t _dimsCount;
+};
+
+using TensorView = BasicTensorView<Tensor::Type>;
+using ConstTensorView = BasicTensorView<const Tensor::Type>;
+
+}
+
+#endif
@@ -1,4 +1,4 @@
-/*
+﻿/*
  * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
  * Kerasify (c) 2016 Robert W. Rose
  *
@@ -23,11 +23,26 @@
     #define PT_LOOP_UNROLLING_ENABLE 0
 #endif
 
-// Define libsimdpp arch:
-#ifdef __arm__
-    #define SIMDPP_ARCH_ARM_NEON_FLT_SP
-#else
-    #if PT_FMADD_ENABLE
+// Maximum size in bytes of the table which stores the LSTM input projection of each embedding id when an Embedding
+// layer precedes a LSTM one (the projections are not precomputed if the table would be bigger):
+#ifndef PT_EMBEDDING_PROJECTION_MAX_SIZE
+#   define PT_EMBEDDING_PROJECTION_MAX_SIZE (64 * 1024 * 1024)
+#endif
+
+// Enable runtime dispatch of the hot kernels (disabled by default, see PT_RUNTIME_DISPATCH CMake option).
+// Kernels are compiled for several x86 instruction sets and the best one supported by the CPU is selected
+// at runtime, so the rest of the library only requires SSE4.1:
+#ifndef PT_RUNTIME_DISPATCH_ENABLE
+#   define PT_RUNTIME_DISPATCH_ENABLE 0
+#endif
+
+// Define libsimdpp arch (kernels variants compiled for runtime dispatch receive it from the build system):
+#ifndef PT_KERNELS_VARIANT
+    #ifdef __arm__
+        #define SIMDPP_ARCH_ARM_NEON_FLT_SP
+    #elif PT_RUNTIME_DISPATCH_ENABLE
+        #define SIMDPP_ARCH_X86_SSE4_1
+    #elif PT_FMADD_ENABLE
         #define SIMDPP_ARCH_X86_AVX2
         #define SIMDPP_ARCH_X86_FMA3
     #else
@@ -104,9 +104,20 @@ std::unique_ptr<ActivationLayer> ActivationLayer::create(std::istream& stream)
 
 bool ActivationLayer::apply(LayerData& layerData) const
 {
-    layerData.out = std::move(layerData.in);
+    std::swap(layerData.in, layerData.out);
     apply(layerData.out);
     return true;
 }
 
+bool ActivationLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    outDims = inDims;
+    return true;
+}
+
+bool ActivationLayer::isInPlace() const noexcept
+{
+    return true;
+}
+
 }
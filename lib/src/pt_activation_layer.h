@@ -25,6 +25,10 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    bool isInPlace() const noexcept final;
+
 protected:
     ActivationLayer() = default;
 };
@@ -57,6 +57,20 @@ bool BatchNormalizationLayer::apply(LayerData& layerData) const
     return true;
 }
 
+bool BatchNormalizationLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(inDims != _weights.getDims())
+    {
+        PT_LOG_ERROR << "Input and weights tensor dims are different" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" <<
+                            " (weights dims: " << VectorPrinter<std::size_t>{ _weights.getDims() } << ")" << std::endl;
+        return false;
+    }
+
+    outDims = inDims;
+    return true;
+}
+
 BatchNormalizationLayer::BatchNormalizationLayer(Tensor&& weights, Tensor&& biases) noexcept :
     _weights(std::move(weights)),
     _biases(std::move(biases))
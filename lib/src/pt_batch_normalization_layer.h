@@ -22,6 +22,18 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    const Tensor& getWeights() const noexcept
+    {
+        return _weights;
+    }
+
+    const Tensor& getBiases() const noexcept
+    {
+        return _biases;
+    }
+
 protected:
     Tensor _weights;
     Tensor _biases;
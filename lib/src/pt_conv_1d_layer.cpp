@@ -8,8 +8,14 @@
 #include "pt_conv_1d_layer.h"
 
 #include <array>
+#include <limits>
+#include <algorithm>
+#include "pt_parser.h"
 #include "pt_layer_data.h"
-#include "pt_multiply_add.h"
+#include "pt_dispatcher.h"
+#include "pt_kernels.h"
+#include "pt_layer_merger.h"
+#include "pt_model_stream.h"
 #include "pt_logger.h"
 
 namespace pt
@@ -17,53 +23,292 @@ namespace pt
 
 namespace
 {
-    template<class MultiplyAddType>
-    void multiplyAddImpl(const Tensor& weights, const Tensor& biases, LayerData& layerData)
+    // Output timestep x reads kernel taps dilation timesteps apart from input timestep x * stride:
+    void multiplyAddImpl(const Tensor& weights, const Tensor& biases, int stride, int dilation, const Tensor& in,
+                         Tensor& out, int xBegin, int xEnd) noexcept
     {
-        const Tensor& in = layerData.in;
-        Tensor& out = layerData.out;
-
         const auto& ww = weights.getDims();
         const auto& ow = out.getDims();
         auto outInc = int(ow[1]);
         auto wInc = int(ww[2] * ww[1]);
         auto wInc2 = int(ww[2]);
-
-        auto tx = int(ow[0]);
+        auto taps = int(ww[1]);
 
         auto inBegin = in.begin();
         auto outBegin = out.begin();
         auto wBegin = weights.begin();
         auto wEnd = weights.end();
         auto bBegin = biases.begin();
-        MultiplyAddType multiplyAdd;
+        auto dot = Kernels::get().dot;
 
-        for(int x = 0; x != tx; ++x)
+        for(int x = xBegin; x != xEnd; ++x)
         {
-            auto inIt = inBegin + x * wInc2;
+            auto inIt = inBegin + x * stride * wInc2;
             auto outIt = outBegin + x * outInc;
             auto bIt = bBegin;
 
-            for(auto wIt = wBegin; wIt != wEnd; wIt += wInc)
+            if(dilation == 1)
             {
-                *outIt = *bIt + multiplyAdd(&*inIt, &*wIt, wInc);
-                ++outIt;
-                ++bIt;
+                // Kernel taps are contiguous:
+                for(auto wIt = wBegin; wIt != wEnd; wIt += wInc)
+                {
+                    *outIt = *bIt + dot(&*inIt, &*wIt, wInc);
+                    ++outIt;
+                    ++bIt;
+                }
+            }
+            else
+            {
+                for(auto wIt = wBegin; wIt != wEnd; wIt += wInc)
+                {
+                    auto inIt2 = inIt;
+                    Tensor::Type sum = *bIt;
+
+                    for(int tap = 0; tap != taps; ++tap)
+                    {
+                        sum += dot(&*inIt2, &*(wIt + tap * wInc2), wInc2);
+                        inIt2 += dilation * wInc2;
+                    }
+
+                    *outIt = sum;
+                    ++outIt;
+                    ++bIt;
+                }
             }
         }
     }
+
+    void multiplyAddImpl(const Tensor& weights, const Tensor& biases, int stride, int dilation,
+                         LayerData& layerData)
+    {
+        const Tensor& in = layerData.in;
+        Tensor& out = layerData.out;
+
+        auto tx = int(out.getDims()[0]);
+
+        layerData.dispatcher.run(tx, int(weights.getSize()), [&](int taskBegin, int taskEnd)
+        {
+            multiplyAddImpl(weights, biases, stride, dilation, in, out, taskBegin, taskEnd);
+        });
+    }
+
+    void multiplyAddImpl(const Tensor& weights, const Tensor& biases, int stride, int dilation,
+                         BatchLayerData& batchLayerData)
+    {
+        const std::vector<Tensor>& in = batchLayerData.in;
+        std::vector<Tensor>& out = batchLayerData.out;
+
+        auto samples = int(in.size());
+        int tx = 0;
+
+        for(const Tensor& sampleOut : out)
+        {
+            tx = std::max(tx, int(sampleOut.getDims()[0]));
+        }
+
+        // Each output timestep is computed for all samples before moving to the next one,
+        // so weights are reused while they are still in cache:
+        batchLayerData.dispatcher.run(tx, int(weights.getSize()) * samples, [&](int taskBegin, int taskEnd)
+        {
+            for(int x = taskBegin; x != taskEnd; ++x)
+            {
+                for(int sample = 0; sample != samples; ++sample)
+                {
+                    Tensor& sampleOut = out[std::size_t(sample)];
+
+                    if(x < int(sampleOut.getDims()[0]))
+                    {
+                        multiplyAddImpl(weights, biases, stride, dilation, in[std::size_t(sample)], sampleOut,
+                                        x, x + 1);
+                    }
+                }
+            }
+        });
+    }
+
+    // Like multiplyAddImpl, with int8 weights and an input quantized with inScale:
+    void multiplyAddImpl(const QuantizedTensor& weights, const Tensor& biases, int stride, int dilation,
+                         const std::int16_t* in, FloatType inScale, Tensor& out, int xBegin, int xEnd) noexcept
+    {
+        const auto& ww = weights.getDims();
+        auto outInc = int(out.getDims()[1]);
+        auto filters = int(ww[0]);
+        auto wInc = int(ww[2] * ww[1]);
+        auto wInc2 = int(ww[2]);
+        auto taps = int(ww[1]);
+
+        auto outBegin = out.begin();
+        auto wBegin = weights.getData();
+        auto scalesBegin = weights.getScales().begin();
+        auto dotRowsInt8 = Kernels::get().dotRowsInt8;
+
+        for(int x = xBegin; x != xEnd; ++x)
+        {
+            auto inIt = in + x * stride * wInc2;
+            auto outIt = outBegin + x * outInc;
+            std::copy(biases.begin(), biases.end(), outIt);
+
+            if(dilation == 1)
+            {
+                // Kernel taps are contiguous:
+                dotRowsInt8(inIt, wBegin, wInc, filters, wInc, scalesBegin, inScale, outIt);
+            }
+            else
+            {
+                for(int tap = 0; tap != taps; ++tap)
+                {
+                    dotRowsInt8(inIt + tap * dilation * wInc2, wBegin + tap * wInc2, wInc, filters, wInc2,
+                                scalesBegin, inScale, outIt);
+                }
+            }
+        }
+    }
+
+    void multiplyAddImpl(const QuantizedTensor& weights, const Tensor& biases, int stride, int dilation,
+                         LayerData& layerData)
+    {
+        const Tensor& in = layerData.in;
+        Tensor& out = layerData.out;
+        std::vector<Tensor>& scratch = layerData.scratch;
+
+        if(scratch.empty())
+        {
+            scratch.resize(1);
+        }
+
+        // The input is quantized once and shared by all tasks:
+        std::int16_t* quantizedIn = QuantizedTensor::getBuffer(scratch[0], in.getSize());
+        FloatType inScale = QuantizedTensor::quantize(in.begin(), in.getSize(), quantizedIn);
+        auto tx = int(out.getDims()[0]);
+
+        layerData.dispatcher.run(tx, int(weights.getSize()), [&](int taskBegin, int taskEnd)
+        {
+            multiplyAddImpl(weights, biases, stride, dilation, quantizedIn, inScale, out, taskBegin, taskEnd);
+        });
+    }
+
+    void multiplyAddImpl(const QuantizedTensor& weights, const Tensor& biases, int stride, int dilation,
+                         BatchLayerData& batchLayerData)
+    {
+        const std::vector<Tensor>& in = batchLayerData.in;
+        std::vector<Tensor>& out = batchLayerData.out;
+
+        auto samples = int(in.size());
+        std::vector<Tensor>& scratch = batchLayerData.scratch;
+        std::size_t inSize = 0;
+        int tx = 0;
+
+        for(const Tensor& sampleIn : in)
+        {
+            inSize += sampleIn.getSize();
+        }
+
+        if(scratch.size() < 2)
+        {
+            scratch.resize(2);
+        }
+
+        // Each sample is quantized with its own scale after the previous one (samples can have
+        // different lengths), and all of them are shared by all tasks:
+        std::int16_t* quantizedIn = QuantizedTensor::getBuffer(scratch[0], inSize);
+        Tensor& inScales = scratch[1];
+        inScales.resize(in.size());
+
+        for(int sample = 0, offset = 0; sample != samples; ++sample)
+        {
+            const Tensor& sampleIn = in[std::size_t(sample)];
+            inScales.begin()[sample] = QuantizedTensor::quantize(sampleIn.begin(), sampleIn.getSize(),
+                                                                 quantizedIn + offset);
+            offset += int(sampleIn.getSize());
+            tx = std::max(tx, int(out[std::size_t(sample)].getDims()[0]));
+        }
+
+        batchLayerData.dispatcher.run(tx, int(weights.getSize()) * samples, [&](int taskBegin, int taskEnd)
+        {
+            for(int x = taskBegin; x != taskEnd; ++x)
+            {
+                for(int sample = 0, offset = 0; sample != samples; ++sample)
+                {
+                    Tensor& sampleOut = out[std::size_t(sample)];
+
+                    if(x < int(sampleOut.getDims()[0]))
+                    {
+                        multiplyAddImpl(weights, biases, stride, dilation, quantizedIn + offset,
+                                        inScales.begin()[sample], sampleOut, x, x + 1);
+                    }
+
+                    offset += int(in[std::size_t(sample)].getSize());
+                }
+            }
+        });
+    }
+
+    // Returns the output timesteps count (0 if the input is smaller than the dilated kernel):
+    std::size_t getOutputSize(std::size_t inSize, const Tensor::DimsVector& ww, int stride, int dilation) noexcept
+    {
+        auto dilatedKernelSize = (ww[1] - 1) * std::size_t(dilation) + 1;
+        return inSize >= dilatedKernelSize ? (inSize - dilatedKernelSize) / std::size_t(stride) + 1 : 0;
+    }
+
+    bool checkInput(const Tensor::DimsVector& iw, const Tensor::DimsVector& ww)
+    {
+        if(iw.size() != 2)
+        {
+            PT_LOG_ERROR << "Input tensor dims count must be 2" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
+            return false;
+        }
+
+        if(iw[1] != ww[2])
+        {
+            PT_LOG_ERROR << "Input tensor dims[1] must be the same as weights dims[2]" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" <<
+                                " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
 }
 
 std::unique_ptr<Conv1DLayer> Conv1DLayer::create(std::istream& stream)
 {
-    auto weights = Tensor::create(3, stream);
+    bool quantized = false;
 
-    if(! weights)
+    if(! QuantizedTensor::parseType(stream, quantized))
     {
-        PT_LOG_ERROR << "Weights tensor parse failed" << std::endl;
+        PT_LOG_ERROR << "Weights type parse failed" << std::endl;
         return std::unique_ptr<Conv1DLayer>();
     }
 
+    Tensor weights;
+    QuantizedTensor quantizedWeights;
+
+    if(quantized)
+    {
+        auto tensor = QuantizedTensor::create(3, stream);
+
+        if(! tensor)
+        {
+            PT_LOG_ERROR << "Quantized weights tensor parse failed" << std::endl;
+            return std::unique_ptr<Conv1DLayer>();
+        }
+
+        quantizedWeights = std::move(*tensor);
+    }
+    else
+    {
+        auto tensor = Tensor::create(3, stream);
+
+        if(! tensor)
+        {
+            PT_LOG_ERROR << "Weights tensor parse failed" << std::endl;
+            return std::unique_ptr<Conv1DLayer>();
+        }
+
+        weights = std::move(*tensor);
+    }
+
     auto biases = Tensor::create(1, stream);
 
     if(! biases)
@@ -80,60 +325,164 @@ std::unique_ptr<Conv1DLayer> Conv1DLayer::create(std::istream& stream)
         return std::unique_ptr<Conv1DLayer>();
     }
 
-    return std::unique_ptr<Conv1DLayer>(new Conv1DLayer(std::move(*weights), std::move(*biases),
-                                                        std::move(activation)));
+    // Stride and dilation rate are stored since v4 files:
+    unsigned int stride = 1;
+    unsigned int dilation = 1;
+    auto modelStream = dynamic_cast<ModelStream*>(&stream);
+
+    if(modelStream && modelStream->getVersion() >= 4)
+    {
+        if(! Parser::parse(stream, stride))
+        {
+            PT_LOG_ERROR << "Stride parse failed" << std::endl;
+            return std::unique_ptr<Conv1DLayer>();
+        }
+
+        if(stride == 0 || stride > unsigned(std::numeric_limits<int>::max()))
+        {
+            PT_LOG_ERROR << "Invalid stride: " << stride << std::endl;
+            return std::unique_ptr<Conv1DLayer>();
+        }
+
+        if(! Parser::parse(stream, dilation))
+        {
+            PT_LOG_ERROR << "Dilation rate parse failed" << std::endl;
+            return std::unique_ptr<Conv1DLayer>();
+        }
+
+        if(dilation == 0 || dilation > unsigned(std::numeric_limits<int>::max()))
+        {
+            PT_LOG_ERROR << "Invalid dilation rate: " << dilation << std::endl;
+            return std::unique_ptr<Conv1DLayer>();
+        }
+    }
+
+    return std::unique_ptr<Conv1DLayer>(new Conv1DLayer(std::move(weights), std::move(quantizedWeights),
+                                                        std::move(*biases), std::move(activation), int(stride),
+                                                        int(dilation)));
 }
 
 bool Conv1DLayer::apply(LayerData& layerData) const
 {
     const Tensor& in = layerData.in;
-    const auto& iw = in.getDims();
 
-    if(iw.size() != 2)
+    if(! checkInput(in.getDims(), _getWeightsDims()))
     {
-        PT_LOG_ERROR << "Input tensor dims count must be 2" <<
-                            " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
         return false;
     }
 
-    const auto& ww = _weights.getDims();
+    const auto& iw = in.getDims();
+    const auto& ww = _getWeightsDims();
+    auto outSize = getOutputSize(iw[0], ww, _stride, _dilation);
 
-    if(iw[1] != ww[2])
+    if(! outSize)
     {
-        PT_LOG_ERROR << "Input tensor dims[1] must be the same as weights dims[2]" <<
+        PT_LOG_ERROR << "Input tensor is smaller than the kernel" <<
                             " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" <<
                             " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
         return false;
     }
 
-    auto offset = ww[1] - 1;
     Tensor& out = layerData.out;
-    out.resize(iw[0] - offset, ww[0]);
+    out.resize(outSize, ww[0]);
+
+    if(_quantizedWeights.isValid())
+    {
+        multiplyAddImpl(_quantizedWeights, _biases, _stride, _dilation, layerData);
+    }
+    else
+    {
+        multiplyAddImpl(_weights, _biases, _stride, _dilation, layerData);
+    }
+
+    _activation->apply(out);
+    return true;
+}
+
+bool Conv1DLayer::applyBatch(BatchLayerData& batchLayerData) const
+{
+    const std::vector<Tensor>& in = batchLayerData.in;
+    std::vector<Tensor>& out = batchLayerData.out;
+    out.resize(in.size());
 
-    auto tensorSize = int(ww[2] * ww[1]);
+    const auto& ww = _getWeightsDims();
 
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
+    for(std::size_t index = 0, count = in.size(); index != count; ++index)
     {
-        multiplyAddImpl<Vector2MultiplyAdd>(_weights, _biases, layerData);
+        const auto& iw = in[index].getDims();
+
+        if(! checkInput(iw, _getWeightsDims()))
+        {
+            return false;
+        }
+
+        auto outSize = getOutputSize(iw[0], ww, _stride, _dilation);
+
+        if(! outSize)
+        {
+            PT_LOG_ERROR << "Input tensor is smaller than the kernel" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" <<
+                                " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+            return false;
+        }
+
+        out[index].resize(outSize, ww[0]);
     }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
+
+    if(_quantizedWeights.isValid())
     {
-        multiplyAddImpl<VectorMultiplyAdd>(_weights, _biases, layerData);
+        multiplyAddImpl(_quantizedWeights, _biases, _stride, _dilation, batchLayerData);
     }
     else
     {
-        multiplyAddImpl<ScalarMultiplyAdd>(_weights, _biases, layerData);
+        multiplyAddImpl(_weights, _biases, _stride, _dilation, batchLayerData);
     }
 
-    _activation->apply(out);
+    for(Tensor& sampleOut : out)
+    {
+        _activation->apply(sampleOut);
+    }
+
+    return true;
+}
+
+bool Conv1DLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! checkInput(inDims, _getWeightsDims()))
+    {
+        return false;
+    }
+
+    auto outSize = getOutputSize(inDims[0], _getWeightsDims(), _stride, _dilation);
+
+    if(! outSize)
+    {
+        PT_LOG_ERROR << "Input tensor is smaller than the kernel" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" <<
+                            " (weights dims: " << VectorPrinter<std::size_t>{ _getWeightsDims() } << ")" <<
+                            std::endl;
+        return false;
+    }
+
+    outDims = { outSize, _getWeightsDims()[0] };
     return true;
 }
 
-Conv1DLayer::Conv1DLayer(Tensor&& weights, Tensor&& biases,
-                         std::unique_ptr<ActivationLayer>&& activation) noexcept :
+bool Conv1DLayer::merge(std::unique_ptr<Layer>& nextLayer)
+{
+    // Quantized weights rows are scaled by their scales:
+    Tensor& weights = _quantizedWeights.isValid() ? _quantizedWeights.getScales() : _weights;
+    return LayerMerger::merge(weights, _biases, _activation, nextLayer);
+}
+
+Conv1DLayer::Conv1DLayer(Tensor&& weights, QuantizedTensor&& quantizedWeights, Tensor&& biases,
+                         std::unique_ptr<ActivationLayer>&& activation, int stride, int dilation) noexcept :
     _weights(std::move(weights)),
+    _quantizedWeights(std::move(quantizedWeights)),
     _biases(std::move(biases)),
-    _activation(std::move(activation))
+    _activation(std::move(activation)),
+    _stride(stride),
+    _dilation(dilation)
 {
 }
 
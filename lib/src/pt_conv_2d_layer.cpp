@@ -8,8 +8,16 @@
 #include "pt_conv_2d_layer.h"
 
 #include <array>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
 #include "pt_layer_data.h"
+#include "pt_dispatcher.h"
 #include "pt_multiply_add.h"
+#include "pt_kernels.h"
+#include "pt_layer_merger.h"
+#include "pt_model_stream.h"
+#include "pt_parser.h"
 #include "pt_logger.h"
 
 namespace pt
@@ -17,69 +25,1062 @@ namespace pt
 
 namespace
 {
-    template<class MultiplyAddType>
-    void multiplyAddImpl(const Tensor& weights, const Tensor& biases, LayerData& layerData)
+    // Maps output pixels to input windows: the top left input value read by the output pixel (y, x)
+    // is (y * strideY - padY, x * strideX - padX), and kernel taps are dilation values apart:
+    struct Window
+    {
+        int padY;
+        int padX;
+        int strideY;
+        int strideX;
+        int dilationY;
+        int dilationX;
+    };
+
+    // Returns the first kernel tap which reads the input on one dimension, given the input position of the first tap:
+    int getTapsBegin(int inPosition, int dilation) noexcept
+    {
+        return inPosition < 0 ? (dilation - 1 - inPosition) / dilation : 0;
+    }
+
+    // Returns the end of the kernel taps which read the input on one dimension:
+    int getTapsEnd(int inPosition, int inSize, int kernelSize, int dilation) noexcept
+    {
+        return std::min(kernelSize, (inSize - inPosition + dilation - 1) / dilation);
+    }
+
+    // Calls pixelFunction(inIt, kernelOffset, rows, columns, columnLength, outIt) for each output pixel
+    // of the given rows with the part of the kernel which overlaps the input, so padding values are skipped
+    // instead of being stored in a padded copy of the input, and only the output pixels kept by the strides
+    // are computed:
+    // * inIt: first input value used.
+    // * kernelOffset: index of the first kernel value used ([kernel rows, kernel columns * input depth]).
+    // * rows: kernel rows used (dilationY input rows apart).
+    // * columns: kernel columns used (dilationX * input depth values apart).
+    // * columnLength: contiguous values used of each kernel column. Without horizontal dilation,
+    //   all kernel columns used are contiguous, so they are passed as one column.
+    //
+    // Interior pixels use the whole kernel, so only the border ones are clipped:
+    template<class PixelFunction>
+    void forEachPixel(const Tensor::DimsVector& ww, const Window& window, const Tensor& in, Tensor& out,
+                      int yBegin, int yEnd, const PixelFunction& pixelFunction) noexcept
+    {
+        const auto& iw = in.getDims();
+        const auto& ow = out.getDims();
+        auto ih = int(iw[0]);
+        auto iwx = int(iw[1]);
+        auto ky = int(ww[1]);
+        auto kx = int(ww[2]);
+        auto depth = int(ww[3]);
+        auto kxd = kx * depth;
+        auto tx = int(ow[1]);
+        auto outInc = int(ow[2]);
+        auto inIncY = iwx * depth;
+        auto dilationX = window.dilationX;
+        auto strideX = window.strideX;
+        auto padX = window.padX;
+
+        // Kernel columns are passed as one contiguous column without horizontal dilation:
+        auto columns = dilationX == 1 ? 1 : kx;
+        auto columnLength = dilationX == 1 ? kxd : depth;
+
+        // Output columns whose kernel doesn't overlap the left or the right borders:
+        auto lastColumnOffset = (kx - 1) * dilationX;
+        int xInteriorBegin = std::min((padX + strideX - 1) / strideX, tx);
+        int xInteriorEnd = xInteriorBegin;
+
+        if(iwx - 1 - lastColumnOffset + padX >= 0)
+        {
+            xInteriorEnd = std::max(xInteriorBegin, std::min(tx, (iwx - 1 - lastColumnOffset + padX) / strideX + 1));
+        }
+
+        auto inBegin = in.begin();
+        auto outBegin = out.begin();
+
+        for(int y = yBegin; y != yEnd; ++y)
+        {
+            int inY = y * window.strideY - window.padY;
+            int kyBegin = getTapsBegin(inY, window.dilationY);
+            int rows = getTapsEnd(inY, ih, ky, window.dilationY) - kyBegin;
+            auto inRowIt = inBegin + (inY + kyBegin * window.dilationY) * inIncY;
+            auto outRowIt = outBegin + y * tx * outInc;
+            int rowOffset = kyBegin * kxd;
+
+            auto borderPixel = [&](int x)
+            {
+                int inX = x * strideX - padX;
+                int kxBegin = getTapsBegin(inX, dilationX);
+                int kxEnd = getTapsEnd(inX, iwx, kx, dilationX);
+                auto pixelInIt = inRowIt + (inX + kxBegin * dilationX) * depth;
+                auto kernelOffset = rowOffset + kxBegin * depth;
+
+                if(dilationX == 1)
+                {
+                    pixelFunction(pixelInIt, kernelOffset, rows, 1, (kxEnd - kxBegin) * depth, outRowIt + x * outInc);
+                }
+                else
+                {
+                    pixelFunction(pixelInIt, kernelOffset, rows, kxEnd - kxBegin, depth, outRowIt + x * outInc);
+                }
+            };
+
+            for(int x = 0; x != xInteriorBegin; ++x)
+            {
+                borderPixel(x);
+            }
+
+            for(int x = xInteriorBegin; x != xInteriorEnd; ++x)
+            {
+                pixelFunction(inRowIt + (x * strideX - padX) * depth, rowOffset, rows, columns, columnLength,
+                              outRowIt + x * outInc);
+            }
+
+            for(int x = xInteriorEnd; x != tx; ++x)
+            {
+                borderPixel(x);
+            }
+        }
+    }
+
+    void multiplyAddImpl(const Tensor& weights, const Tensor& biases, const Window& window, const Tensor& in,
+                         Tensor& out, int yBegin, int yEnd) noexcept
+    {
+        const auto& iw = in.getDims();
+        const auto& ww = weights.getDims();
+        auto wSize = int(ww[0] * ww[1] * ww[2] * ww[3]);
+        auto wInc = int(ww[1] * ww[2] * ww[3]);
+        auto wIncY = int(ww[2] * ww[3]);
+        auto wIncX = int(ww[3]);
+        auto inIncY = int(ww[3] * iw[1]) * window.dilationY;
+        auto inIncX = int(ww[3]) * window.dilationX;
+
+        auto wBegin = weights.begin();
+        auto bBegin = biases.begin();
+        auto dot = Kernels::get().dot;
+
+        forEachPixel(ww, window, in, out, yBegin, yEnd,
+                     [&](const Tensor::Type* inIt, int kernelOffset, int rows, int columns, int columnLength,
+                         Tensor::Type* outIt)
+        {
+            auto bIt = bBegin;
+
+            for(auto wIt = wBegin + kernelOffset, wEnd = wIt + wSize; wIt != wEnd; wIt += wInc)
+            {
+                auto inIt2 = inIt;
+                auto wIt2 = wIt;
+                Tensor::Type sum = *bIt;
+
+                for(int row = 0; row != rows; ++row)
+                {
+                    auto inIt3 = inIt2;
+                    auto wIt3 = wIt2;
+
+                    for(int column = 0; column != columns; ++column)
+                    {
+                        sum += dot(inIt3, wIt3, columnLength);
+                        inIt3 += inIncX;
+                        wIt3 += wIncX;
+                    }
+
+                    inIt2 += inIncY;
+                    wIt2 += wIncY;
+                }
+
+                *outIt = sum;
+                ++outIt;
+                ++bIt;
+            }
+        });
+    }
+
+    void multiplyAddImpl(const Tensor& weights, const Tensor& biases, const Window& window, LayerData& layerData)
+    {
+        const Tensor& in = layerData.in;
+        Tensor& out = layerData.out;
+
+        const auto& ow = out.getDims();
+        auto ty = int(ow[0]);
+        auto tx = int(ow[1]);
+        auto wSize = int(weights.getSize());
+
+        layerData.dispatcher.run(ty, tx * wSize, [&](int taskBegin, int taskEnd)
+        {
+            multiplyAddImpl(weights, biases, window, in, out, taskBegin, taskEnd);
+        });
+    }
+
+    void multiplyAddImpl(const Tensor& weights, const Tensor& biases, const Window& window,
+                         BatchLayerData& batchLayerData)
+    {
+        const std::vector<Tensor>& in = batchLayerData.in;
+        std::vector<Tensor>& out = batchLayerData.out;
+
+        const auto& ow = out[0].getDims();
+        auto ty = int(ow[0]);
+        auto tx = int(ow[1]);
+        auto wSize = int(weights.getSize());
+        auto samples = int(in.size());
+
+        // Each output row is computed for all samples before moving to the next one,
+        // so weights are reused while they are still in cache:
+        batchLayerData.dispatcher.run(ty, tx * wSize * samples, [&](int taskBegin, int taskEnd)
+        {
+            for(int y = taskBegin; y != taskEnd; ++y)
+            {
+                for(int sample = 0; sample != samples; ++sample)
+                {
+                    multiplyAddImpl(weights, biases, window, in[std::size_t(sample)], out[std::size_t(sample)],
+                                    y, y + 1);
+                }
+            }
+        });
+    }
+
+    // Like multiplyAddImpl, with int8 weights and an input quantized with inScale (quantizedIn has the same layout
+    // as in). Each kernel column used is multiplied by the weights rows of all output channels at once:
+    void multiplyAddImpl(const QuantizedTensor& weights, const Tensor& biases, const Window& window,
+                         const Tensor& in, const std::int16_t* quantizedIn, FloatType inScale, Tensor& out,
+                         int yBegin, int yEnd) noexcept
+    {
+        const auto& iw = in.getDims();
+        const auto& ww = weights.getDims();
+        auto filters = int(ww[0]);
+        auto wInc = int(ww[1] * ww[2] * ww[3]);
+        auto wIncY = int(ww[2] * ww[3]);
+        auto wIncX = int(ww[3]);
+        auto inIncY = int(ww[3] * iw[1]) * window.dilationY;
+        auto inIncX = int(ww[3]) * window.dilationX;
+
+        auto inBegin = in.begin();
+        auto wBegin = weights.getData();
+        auto scalesBegin = weights.getScales().begin();
+        auto dotRowsInt8 = Kernels::get().dotRowsInt8;
+
+        forEachPixel(ww, window, in, out, yBegin, yEnd,
+                     [&](const Tensor::Type* inIt, int kernelOffset, int rows, int columns, int columnLength,
+                         Tensor::Type* outIt)
+        {
+            auto quantizedInIt = quantizedIn + (inIt - inBegin);
+            auto wIt = wBegin + kernelOffset;
+            std::copy(biases.begin(), biases.end(), outIt);
+
+            for(int row = 0; row != rows; ++row)
+            {
+                for(int column = 0; column != columns; ++column)
+                {
+                    dotRowsInt8(quantizedInIt + (row * inIncY + column * inIncX), wIt + (row * wIncY + column * wIncX),
+                                wInc, filters, columnLength, scalesBegin, inScale, outIt);
+                }
+            }
+        });
+    }
+
+    void multiplyAddImpl(const QuantizedTensor& weights, const Tensor& biases, const Window& window,
+                         LayerData& layerData)
+    {
+        const Tensor& in = layerData.in;
+        Tensor& out = layerData.out;
+        std::vector<Tensor>& scratch = layerData.scratch;
+
+        if(scratch.empty())
+        {
+            scratch.resize(1);
+        }
+
+        // The input is quantized once and shared by all tasks:
+        std::int16_t* quantizedIn = QuantizedTensor::getBuffer(scratch[0], in.getSize());
+        FloatType inScale = QuantizedTensor::quantize(in.begin(), in.getSize(), quantizedIn);
+
+        const auto& ow = out.getDims();
+        auto ty = int(ow[0]);
+        auto tx = int(ow[1]);
+        auto wSize = int(weights.getSize());
+
+        layerData.dispatcher.run(ty, tx * wSize, [&](int taskBegin, int taskEnd)
+        {
+            multiplyAddImpl(weights, biases, window, in, quantizedIn, inScale, out, taskBegin, taskEnd);
+        });
+    }
+
+    void multiplyAddImpl(const QuantizedTensor& weights, const Tensor& biases, const Window& window,
+                         BatchLayerData& batchLayerData)
+    {
+        const std::vector<Tensor>& in = batchLayerData.in;
+        std::vector<Tensor>& out = batchLayerData.out;
+
+        const auto& ow = out[0].getDims();
+        auto ty = int(ow[0]);
+        auto tx = int(ow[1]);
+        auto wSize = int(weights.getSize());
+        auto samples = int(in.size());
+        auto inSize = in[0].getSize();
+        std::vector<Tensor>& scratch = batchLayerData.scratch;
+
+        if(scratch.size() < 2)
+        {
+            scratch.resize(2);
+        }
+
+        // Each sample is quantized with its own scale, and all of them are shared by all tasks:
+        std::int16_t* quantizedIn = QuantizedTensor::getBuffer(scratch[0], in.size() * inSize);
+        Tensor& inScales = scratch[1];
+        inScales.resize(in.size());
+
+        for(std::size_t sample = 0; sample != in.size(); ++sample)
+        {
+            inScales.begin()[sample] = QuantizedTensor::quantize(in[sample].begin(), inSize,
+                                                                 quantizedIn + (sample * inSize));
+        }
+
+        // Each output row is computed for all samples before moving to the next one,
+        // so weights are reused while they are still in cache:
+        batchLayerData.dispatcher.run(ty, tx * wSize * samples, [&](int taskBegin, int taskEnd)
+        {
+            for(int y = taskBegin; y != taskEnd; ++y)
+            {
+                for(std::size_t sample = 0; sample != in.size(); ++sample)
+                {
+                    multiplyAddImpl(weights, biases, window, in[sample], quantizedIn + (sample * inSize),
+                                    inScales.begin()[sample], out[sample], y, y + 1);
+                }
+            }
+        });
+    }
+
+    // Increments between the kernel rows and columns used by channelMultiplyAdd:
+    struct ChannelSteps
+    {
+        int inY;
+        int inX;
+        int weightsY;
+        int weightsX;
+        int weights; // Between consecutive kernel values (output channels count padded to Tensor::VectorSize).
+    };
+
+    // Computes Blocks vectors of output channels of one output pixel, broadcasting each input value
+    // against the repacked weights of these channels.
+    // Without horizontal dilation, kernel columns are passed as one column, so the columns loop is skipped:
+    template<int Blocks, bool DilatedColumns>
+    void channelMultiplyAdd(const Tensor::Type* inIt, int rows, int columns, int columnLength,
+                            const ChannelSteps& steps, const Tensor::Type* wIt, const Tensor::Type* bIt,
+                            Tensor::Type* outIt, int outSize) noexcept
+    {
+        constexpr auto vectorSize = int(Tensor::VectorSize);
+        std::array<Tensor::Vector, Blocks> acc;
+        auto wInc = steps.weights;
+
+        for(int block = 0; block != Blocks; ++block)
+        {
+            acc[std::size_t(block)] = simdpp::load(bIt + block * vectorSize);
+        }
+
+        auto multiplyAddColumn = [&acc, wInc](const Tensor::Type* inColumnIt, const Tensor::Type* wColumnIt,
+                                              int length)
+        {
+            for(int k = 0; k != length; ++k)
+            {
+                Tensor::Vector inVector = simdpp::load_splat(inColumnIt + k);
+
+                for(int block = 0; block != Blocks; ++block)
+                {
+                    Tensor::Vector& accVector = acc[std::size_t(block)];
+                    accVector = detail::madd(inVector, simdpp::load(wColumnIt + block * vectorSize), accVector);
+                }
+
+                wColumnIt += wInc;
+            }
+        };
+
+        for(int row = 0; row != rows; ++row)
+        {
+            if(DilatedColumns)
+            {
+                auto inIt2 = inIt;
+                auto wIt2 = wIt;
+
+                for(int column = 0; column != columns; ++column)
+                {
+                    multiplyAddColumn(inIt2, wIt2, columnLength);
+                    inIt2 += steps.inX;
+                    wIt2 += steps.weightsX;
+                }
+            }
+            else
+            {
+                multiplyAddColumn(inIt, wIt, columnLength);
+            }
+
+            inIt += steps.inY;
+            wIt += steps.weightsY;
+        }
+
+        if(outSize >= Blocks * vectorSize)
+        {
+            for(int block = 0; block != Blocks; ++block)
+            {
+                simdpp::store_u(outIt + block * vectorSize, acc[std::size_t(block)]);
+            }
+        }
+        else
+        {
+            // Last output channels don't fill the vectors:
+            alignas(Tensor::Alignment) std::array<Tensor::Type, Blocks * Tensor::VectorSize> values;
+
+            for(int block = 0; block != Blocks; ++block)
+            {
+                simdpp::store(values.data() + block * vectorSize, acc[std::size_t(block)]);
+            }
+
+            std::copy(values.begin(), values.begin() + outSize, outIt);
+        }
+    }
+
+    template<bool DilatedColumns>
+    void channelMultiplyAddImpl(const Tensor& channelWeights, const Tensor& channelBiases,
+                                const Tensor::DimsVector& ww, const Window& window, const Tensor& in, Tensor& out,
+                                int yBegin, int yEnd) noexcept
+    {
+        constexpr auto vectorSize = int(Tensor::VectorSize);
+        constexpr auto blocks = 4;
+
+        const auto& iw = in.getDims();
+        auto outInc = int(out.getDims()[2]);
+        auto wInc = int(channelWeights.getDims()[2]);
+        ChannelSteps steps = {
+            int(ww[3] * iw[1]) * window.dilationY, int(ww[3]) * window.dilationX,
+            int(ww[2] * ww[3]) * wInc, int(ww[3]) * wInc, wInc
+        };
+
+        auto wBegin = channelWeights.begin();
+        auto bBegin = channelBiases.begin();
+
+        forEachPixel(ww, window, in, out, yBegin, yEnd,
+                     [&](const Tensor::Type* inIt, int kernelOffset, int rows, int columns, int columnLength,
+                         Tensor::Type* outIt)
+        {
+            auto wIt = wBegin + kernelOffset * wInc;
+            int channel = 0;
+
+            for(; channel + blocks * vectorSize <= wInc; channel += blocks * vectorSize)
+            {
+                channelMultiplyAdd<blocks, DilatedColumns>(inIt, rows, columns, columnLength, steps, wIt + channel,
+                                                           bBegin + channel, outIt + channel, outInc - channel);
+            }
+
+            for(; channel != wInc; channel += vectorSize)
+            {
+                channelMultiplyAdd<1, DilatedColumns>(inIt, rows, columns, columnLength, steps, wIt + channel,
+                                                      bBegin + channel, outIt + channel, outInc - channel);
+            }
+        });
+    }
+
+    void channelMultiplyAddImpl(const Tensor& channelWeights, const Tensor& channelBiases,
+                                const Tensor::DimsVector& ww, const Window& window, const Tensor& in, Tensor& out,
+                                int yBegin, int yEnd) noexcept
+    {
+        if(window.dilationX == 1)
+        {
+            channelMultiplyAddImpl<false>(channelWeights, channelBiases, ww, window, in, out, yBegin, yEnd);
+        }
+        else
+        {
+            channelMultiplyAddImpl<true>(channelWeights, channelBiases, ww, window, in, out, yBegin, yEnd);
+        }
+    }
+
+    void channelMultiplyAddImpl(const Tensor& channelWeights, const Tensor& channelBiases,
+                                const Tensor::DimsVector& ww, const Window& window, LayerData& layerData)
     {
         const Tensor& in = layerData.in;
         Tensor& out = layerData.out;
 
-        const auto& iw = in.getDims();
-        const auto& ww = weights.getDims();
-        const auto& ow = out.getDims();
-        auto outInc = int(ow[2]);
-        auto wSize = int(ww[0] * ww[1] * ww[2] * ww[3]);
-        auto wInc = int(ww[1] * ww[2] * ww[3]);
-        auto wInc2 = int(ww[2] * ww[3]);
+        const auto& ow = out.getDims();
+        auto ty = int(ow[0]);
+        auto tx = int(ow[1]);
+        auto wSize = int(channelWeights.getSize());
+
+        layerData.dispatcher.run(ty, tx * wSize, [&](int taskBegin, int taskEnd)
+        {
+            channelMultiplyAddImpl(channelWeights, channelBiases, ww, window, in, out, taskBegin, taskEnd);
+        });
+    }
+
+    void channelMultiplyAddImpl(const Tensor& channelWeights, const Tensor& channelBiases,
+                                const Tensor::DimsVector& ww, const Window& window, BatchLayerData& batchLayerData)
+    {
+        const std::vector<Tensor>& in = batchLayerData.in;
+        std::vector<Tensor>& out = batchLayerData.out;
+
+        const auto& ow = out[0].getDims();
+        auto ty = int(ow[0]);
+        auto tx = int(ow[1]);
+        auto wSize = int(channelWeights.getSize());
+        auto samples = int(in.size());
+
+        batchLayerData.dispatcher.run(ty, tx * wSize * samples, [&](int taskBegin, int taskEnd)
+        {
+            for(int y = taskBegin; y != taskEnd; ++y)
+            {
+                for(int sample = 0; sample != samples; ++sample)
+                {
+                    channelMultiplyAddImpl(channelWeights, channelBiases, ww, window, in[std::size_t(sample)],
+                                           out[std::size_t(sample)], y, y + 1);
+                }
+            }
+        });
+    }
+
+    // Values count of each im2col buffer (the input windows of a tile of output pixels), small enough
+    // to stay in L2 cache while the tile is multiplied by the channel weights:
+    constexpr int GemmTileValues = 1 << 15;
+
+    // Copies the input windows of the output pixels [pixelBegin, pixelEnd) to consecutive buffer rows
+    // of [kernel rows, kernel columns, input depth] values, with zeros for padding:
+    void im2col(const Tensor::DimsVector& ww, const Window& window, const Tensor& in, int outX, int pixelBegin,
+                int pixelEnd, Tensor::Type* buffer) noexcept
+    {
+        const auto& iw = in.getDims();
+        auto ih = int(iw[0]);
+        auto iwx = int(iw[1]);
+        auto ky = int(ww[1]);
+        auto kx = int(ww[2]);
+        auto depth = int(ww[3]);
+        auto inIncY = iwx * depth;
+        auto inBegin = in.begin();
+
+        for(int pixel = pixelBegin; pixel != pixelEnd; ++pixel)
+        {
+            int inY = (pixel / outX) * window.strideY - window.padY;
+            int inX = (pixel % outX) * window.strideX - window.padX;
+
+            for(int row = 0; row != ky; ++row)
+            {
+                int rowY = inY + row * window.dilationY;
+
+                if(rowY < 0 || rowY >= ih)
+                {
+                    buffer = std::fill_n(buffer, kx * depth, Tensor::Type(0));
+                }
+                else if(window.dilationX == 1)
+                {
+                    // Kernel row columns are contiguous in the input:
+                    int kxBegin = std::min(getTapsBegin(inX, 1), kx);
+                    int kxEnd = std::max(getTapsEnd(inX, iwx, kx, 1), kxBegin);
+                    auto inRowIt = inBegin + rowY * inIncY + inX * depth;
+                    buffer = std::fill_n(buffer, kxBegin * depth, Tensor::Type(0));
+                    buffer = std::copy(inRowIt + kxBegin * depth, inRowIt + kxEnd * depth, buffer);
+                    buffer = std::fill_n(buffer, (kx - kxEnd) * depth, Tensor::Type(0));
+                }
+                else
+                {
+                    for(int column = 0; column != kx; ++column)
+                    {
+                        int columnX = inX + column * window.dilationX;
+
+                        if(columnX < 0 || columnX >= iwx)
+                        {
+                            buffer = std::fill_n(buffer, depth, Tensor::Type(0));
+                        }
+                        else
+                        {
+                            auto inColumnIt = inBegin + rowY * inIncY + columnX * depth;
+                            buffer = std::copy(inColumnIt, inColumnIt + depth, buffer);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Lowers tiles of output pixels to im2col buffers and multiplies them by the channel weights with a GEMM
+    // kernel, which accumulates blocks of output pixels and channels in registers.
+    // Tiles are split in one contiguous range for each thread, which uses its own buffer:
+    void gemmImpl(const Tensor& channelWeights, const Tensor& channelBiases, const Tensor::DimsVector& ww,
+                  const Window& window, const Tensor& in, Tensor& out, std::vector<Tensor>& buffers,
+                  Dispatcher& dispatcher)
+    {
+        const auto& ow = out.getDims();
+        auto outX = int(ow[1]);
+        auto pixels = int(ow[0] * ow[1]);
+        auto channels = int(ow[2]);
+        auto length = int(ww[1] * ww[2] * ww[3]);
+        auto bInc = int(channelWeights.getDims()[2]);
+
+        // Tile pixels are a multiple of the GEMM kernel block rows:
+        int tileSize = std::max(GemmTileValues / length / 6, 1) * 6;
+        tileSize = std::min(tileSize, pixels);
+
+        int tilesCount = (pixels + tileSize - 1) / tileSize;
+        int slots = std::max(std::min(int(dispatcher.getThreadsCount()), tilesCount), 1);
+
+        if(int(buffers.size()) < slots)
+        {
+            buffers.resize(std::size_t(slots));
+        }
+
+        for(int slot = 0; slot != slots; ++slot)
+        {
+            buffers[std::size_t(slot)].resize(std::size_t(tileSize * length));
+        }
+
+        auto slotCost = std::int64_t(pixels) * length * bInc / slots;
+        auto wBegin = channelWeights.begin();
+        auto bBegin = channelBiases.begin();
+        auto outBegin = out.begin();
+        auto gemm = Kernels::get().gemm;
+
+        dispatcher.run(slots, int(std::min(slotCost, std::int64_t(std::numeric_limits<int>::max()))),
+                       [&](int taskBegin, int taskEnd)
+        {
+            Tensor::Type* buffer = buffers[std::size_t(taskBegin)].begin();
+
+            for(int tile = taskBegin * tilesCount / slots, tileEnd = taskEnd * tilesCount / slots; tile != tileEnd;
+                ++tile)
+            {
+                int pixelBegin = tile * tileSize;
+                int pixelEnd = std::min(pixelBegin + tileSize, pixels);
+                im2col(ww, window, in, outX, pixelBegin, pixelEnd, buffer);
+                gemm(buffer, pixelEnd - pixelBegin, length, wBegin, bInc, bBegin, outBegin + pixelBegin * channels,
+                     channels, channels);
+            }
+        });
+    }
+
+    // Winograd F(2x2, 3x3) convolution computes each 2x2 output tile from a 4x4 input tile with 16 multiplications
+    // per input channel instead of 36:
+    // * Input tiles are transformed to V = B^T d B (only additions), vectorized across input depth.
+    // * For each of the 16 tile positions, V is multiplied by the transformed weights U = G g G^T
+    //   (precomputed when the layer is created) with the GEMM kernel, giving M = U * V.
+    // * Output tiles are transformed back to Y = A^T M A (only additions), vectorized across output channels.
+    //
+    // Values count of each tiles group buffer (transformed inputs and products), small enough to stay in L2 cache:
+    constexpr int WinogradGroupValues = 1 << 15;
+
+    // In place B^T d B of a 4x4 tile, with B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1]:
+    template<class Type>
+    void winogradInputTransform(std::array<Type, 16>& d) noexcept
+    {
+        for(int column = 0; column != 4; ++column)
+        {
+            Type d0 = d[std::size_t(column)];
+            Type d1 = d[std::size_t(4 + column)];
+            Type d2 = d[std::size_t(8 + column)];
+            Type d3 = d[std::size_t(12 + column)];
+            d[std::size_t(column)] = d0 - d2;
+            d[std::size_t(4 + column)] = d1 + d2;
+            d[std::size_t(8 + column)] = d2 - d1;
+            d[std::size_t(12 + column)] = d1 - d3;
+        }
+
+        for(int row = 0; row != 16; row += 4)
+        {
+            Type d0 = d[std::size_t(row)];
+            Type d1 = d[std::size_t(row + 1)];
+            Type d2 = d[std::size_t(row + 2)];
+            Type d3 = d[std::size_t(row + 3)];
+            d[std::size_t(row)] = d0 - d2;
+            d[std::size_t(row + 1)] = d1 + d2;
+            d[std::size_t(row + 2)] = d2 - d1;
+            d[std::size_t(row + 3)] = d1 - d3;
+        }
+    }
+
+    // A^T m A of a 4x4 tile, with A^T = [1 1 1 0; 0 1 -1 -1], returned as a row major 2x2 tile:
+    template<class Type>
+    void winogradOutputTransform(const std::array<Type, 16>& m, std::array<Type, 4>& y) noexcept
+    {
+        std::array<Type, 8> t;
+
+        for(int column = 0; column != 4; ++column)
+        {
+            Type m1 = m[std::size_t(4 + column)];
+            Type m2 = m[std::size_t(8 + column)];
+            Type sum = m1 + m2;
+            Type difference = m1 - m2;
+            t[std::size_t(column)] = sum + m[std::size_t(column)];
+            t[std::size_t(4 + column)] = difference - m[std::size_t(12 + column)];
+        }
+
+        for(int row = 0; row != 2; ++row)
+        {
+            Type t1 = t[std::size_t(row * 4 + 1)];
+            Type t2 = t[std::size_t(row * 4 + 2)];
+            Type sum = t1 + t2;
+            Type difference = t1 - t2;
+            y[std::size_t(row * 2)] = sum + t[std::size_t(row * 4)];
+            y[std::size_t(row * 2 + 1)] = difference - t[std::size_t(row * 4 + 3)];
+        }
+    }
+
+    // Transforms the input tiles [tileBegin, tileEnd) to v, which stores groupSize tiles of input depth values
+    // for each tile position. Values out of the input are padding zeros:
+    void winogradInputTiles(const Window& window, const Tensor& in, int tilesX, int tileBegin, int tileEnd,
+                            int groupSize, Tensor::Type* v) noexcept
+    {
+        constexpr auto vectorSize = int(Tensor::VectorSize);
+
+        const auto& iw = in.getDims();
+        auto ih = int(iw[0]);
+        auto iwx = int(iw[1]);
+        auto depth = int(iw[2]);
+        auto positionInc = groupSize * depth;
+        auto inBegin = in.begin();
+        Tensor::Vector zero = makeVector(Tensor::Type(0));
+        std::array<const Tensor::Type*, 16> inIts;
+
+        for(int tile = tileBegin; tile != tileEnd; ++tile)
+        {
+            int inY = (tile / tilesX) * 2 - window.padY;
+            int inX = (tile % tilesX) * 2 - window.padX;
+
+            for(int position = 0; position != 16; ++position)
+            {
+                int y = inY + position / 4;
+                int x = inX + position % 4;
+                bool inside = y >= 0 && y < ih && x >= 0 && x < iwx;
+                inIts[std::size_t(position)] = inside ? inBegin + (y * iwx + x) * depth : nullptr;
+            }
+
+            auto vIt = v + (tile - tileBegin) * depth;
+            int index = 0;
+
+            for(; index + vectorSize <= depth; index += vectorSize)
+            {
+                std::array<Tensor::Vector, 16> d;
+
+                for(std::size_t position = 0; position != 16; ++position)
+                {
+                    d[position] = inIts[position] ? Tensor::Vector(simdpp::load_u(inIts[position] + index)) : zero;
+                }
+
+                winogradInputTransform(d);
+
+                for(int position = 0; position != 16; ++position)
+                {
+                    simdpp::store_u(vIt + position * positionInc + index, d[std::size_t(position)]);
+                }
+            }
+
+            for(; index != depth; ++index)
+            {
+                std::array<Tensor::Type, 16> d;
 
-        auto tx = int(ow[1]);
-        auto ty = int(ow[0]);
-        auto inIncX = int(ww[3]);
-        auto inIncY = int(ww[3] * iw[1]);
+                for(std::size_t position = 0; position != 16; ++position)
+                {
+                    d[position] = inIts[position] ? inIts[position][index] : Tensor::Type(0);
+                }
+
+                winogradInputTransform(d);
+
+                for(int position = 0; position != 16; ++position)
+                {
+                    vIt[position * positionInc + index] = d[std::size_t(position)];
+                }
+            }
+        }
+    }
 
-        auto inBegin = in.getData().data();
-        auto outBegin = const_cast<Tensor::Type*>(out.getData().data());
-        auto wBegin = weights.getData().data();
-        auto bBegin = biases.getData().data();
-        MultiplyAddType multiplyAdd;
+    // Transforms the products m of the tiles [tileBegin, tileEnd) back to output tiles, discarding the values
+    // of the last row and column tiles which are out of the output:
+    void winogradOutputTiles(const Tensor::Type* m, int groupSize, int paddedChannels, int tilesX, int tileBegin,
+                             int tileEnd, Tensor& out) noexcept
+    {
+        constexpr auto vectorSize = int(Tensor::VectorSize);
 
+        const auto& ow = out.getDims();
+        auto oh = int(ow[0]);
+        auto owx = int(ow[1]);
+        auto channels = int(ow[2]);
+        auto positionInc = groupSize * paddedChannels;
+        auto outBegin = out.begin();
 
-        for(int y = 0; y != ty; ++y)
+        for(int tile = tileBegin; tile != tileEnd; ++tile)
         {
-            for(int x = 0; x != tx; ++x)
+            int outY = (tile / tilesX) * 2;
+            int outX = (tile % tilesX) * 2;
+            int rows = std::min(oh - outY, 2);
+            int columns = std::min(owx - outX, 2);
+            auto mIt = m + (tile - tileBegin) * paddedChannels;
+            auto outIt = outBegin + (outY * owx + outX) * channels;
+
+            for(int channel = 0; channel < channels; channel += vectorSize)
             {
+                std::array<Tensor::Vector, 16> values;
+                std::array<Tensor::Vector, 4> y;
 
-                auto inIt = inBegin + y * inIncY + x * inIncX;
-                auto outIt = outBegin + y * tx * outInc + x * outInc;
-                auto bIt = bBegin;
-                for(auto wIt = wBegin, wEnd = wBegin + wSize; wIt != wEnd; wIt += wInc)
+                for(int position = 0; position != 16; ++position)
                 {
-                    auto inIt2 = inIt;
-                    *outIt = *bIt;
+                    values[std::size_t(position)] = simdpp::load_u(mIt + position * positionInc + channel);
+                }
+
+                winogradOutputTransform(values, y);
 
-                    for(auto wIt2 = wIt, wEnd2 = wIt + wInc; wIt2 != wEnd2; wIt2 += wInc2)
+                for(int row = 0; row != rows; ++row)
+                {
+                    for(int column = 0; column != columns; ++column)
                     {
-                        *outIt += multiplyAdd(&*inIt2, &*wIt2, wInc2);
-                        inIt2 += inIncY;
+                        auto outValueIt = outIt + (row * owx + column) * channels + channel;
+                        const Tensor::Vector& yVector = y[std::size_t(row * 2 + column)];
+
+                        if(channel + vectorSize <= channels)
+                        {
+                            simdpp::store_u(outValueIt, yVector);
+                        }
+                        else
+                        {
+                            // Last output channels don't fill the vector:
+                            alignas(Tensor::Alignment) std::array<Tensor::Type, Tensor::VectorSize> lastValues;
+                            simdpp::store(lastValues.data(), yVector);
+                            std::copy(lastValues.begin(), lastValues.begin() + (channels - channel), outValueIt);
+                        }
                     }
+                }
+            }
+        }
+    }
+
+    // Splits the output tiles in groups, which are transformed and multiplied one by one.
+    // Groups are split in one contiguous range for each thread, which uses its own buffer:
+    void winogradImpl(const Tensor& winogradWeights, const Tensor& winogradBiases, const Window& window,
+                      const Tensor& in, Tensor& out, std::vector<Tensor>& buffers, Dispatcher& dispatcher)
+    {
+        const auto& ow = out.getDims();
+        auto tilesX = int(ow[1] + 1) / 2;
+        auto tiles = int(ow[0] + 1) / 2 * tilesX;
+        auto depth = int(in.getDims()[2]);
+        auto paddedChannels = int(winogradWeights.getDims()[2]);
+
+        // Group tiles are a multiple of the GEMM kernel block rows:
+        int groupSize = std::max(WinogradGroupValues / (16 * (depth + paddedChannels)) / 6, 1) * 6;
+        groupSize = std::min(groupSize, tiles);
+
+        int groupsCount = (tiles + groupSize - 1) / groupSize;
+        int slots = std::max(std::min(int(dispatcher.getThreadsCount()), groupsCount), 1);
+
+        if(int(buffers.size()) < slots)
+        {
+            buffers.resize(std::size_t(slots));
+        }
+
+        for(int slot = 0; slot != slots; ++slot)
+        {
+            buffers[std::size_t(slot)].resize(16, std::size_t(groupSize), std::size_t(depth + paddedChannels));
+        }
+
+        auto slotCost = std::int64_t(tiles) * 16 * depth * paddedChannels / slots;
+        auto wBegin = winogradWeights.begin();
+        auto bBegin = winogradBiases.begin();
+        auto gemm = Kernels::get().gemm;
+
+        dispatcher.run(slots, int(std::min(slotCost, std::int64_t(std::numeric_limits<int>::max()))),
+                       [&](int taskBegin, int taskEnd)
+        {
+            Tensor::Type* v = buffers[std::size_t(taskBegin)].begin();
+            Tensor::Type* m = v + 16 * groupSize * depth;
+
+            for(int group = taskBegin * groupsCount / slots, groupEnd = taskEnd * groupsCount / slots;
+                group != groupEnd; ++group)
+            {
+                int tileBegin = group * groupSize;
+                int tileEnd = std::min(tileBegin + groupSize, tiles);
+                winogradInputTiles(window, in, tilesX, tileBegin, tileEnd, groupSize, v);
+
+                for(int position = 0; position != 16; ++position)
+                {
+                    gemm(v + position * groupSize * depth, tileEnd - tileBegin, depth,
+                         wBegin + position * depth * paddedChannels, paddedChannels,
+                         bBegin + position * paddedChannels, m + position * groupSize * paddedChannels,
+                         paddedChannels, paddedChannels);
+                }
+
+                winogradOutputTiles(m, groupSize, paddedChannels, tilesX, tileBegin, tileEnd, out);
+            }
+        });
+    }
+
+    // The default kernel vectorizes the dot products along kernel columns * input depth
+    // (only along input depth with horizontal dilation), so it runs scalar if they are less than the vector size.
+    // The channel kernel uses outputChannels / paddedOutputChannels of each vector, but it needs one load
+    // per multiply-add instead of two and no horizontal additions, so it is faster unless most lanes are padding:
+    bool useChannelKernel(const Tensor::DimsVector& ww, int dilationX) noexcept
+    {
+        auto outChannels = ww[0];
+        auto paddedChannels = ((outChannels + Tensor::VectorSize - 1) / Tensor::VectorSize) * Tensor::VectorSize;
+        auto dotLength = dilationX == 1 ? ww[2] * ww[3] : ww[3];
+
+        if(dotLength < Tensor::VectorSize)
+        {
+            return outChannels > 1;
+        }
+
+        return outChannels * 2 >= paddedChannels;
+    }
+
+    // The channel kernel keeps the accumulators of all output channels of a pixel in memory and streams
+    // all the weights for each pixel, which is slow when they don't fit in L1 cache (many output channels
+    // and long kernel rows). The GEMM reuses each weights vector for 6 pixels held in registers,
+    // but it pays for the im2col copies, so it's only faster with wide layers
+    // (measured with 3x3 kernels: 1.5x faster with 128 output channels, slower with 64 or less):
+    bool useGemm(const Tensor::DimsVector& ww) noexcept
+    {
+        return ww[0] >= 128 && ww[1] * ww[2] * ww[3] >= 256;
+    }
 
-                    ++outIt;
-                    ++bIt;
+    // Winograd F(2x2, 3x3) only works with 3x3 kernels without strides nor dilation. Transforms are
+    // proportional to the input depth and output channels counts, while the multiplications saved
+    // are proportional to their product, so it needs both of them wide enough
+    // (measured: about 2x faster than the other algorithms with 8 or more, slower with RGB inputs):
+    bool useWinograd(const Tensor::DimsVector& ww, int strideY, int strideX, int dilationY, int dilationX) noexcept
+    {
+        if(ww[1] != 3 || ww[2] != 3 || strideY != 1 || strideX != 1 || dilationY != 1 || dilationX != 1)
+        {
+            return false;
+        }
+
+        return ww[0] >= 8 && ww[3] >= 8;
+    }
+
+    void packChannelWeights(const Tensor& weights, const Tensor& biases, Tensor& channelWeights,
+                            Tensor& channelBiases)
+    {
+        const auto& ww = weights.getDims();
+        auto outChannels = ww[0];
+        auto kernelSize = ww[1] * ww[2] * ww[3];
+        auto paddedChannels = ((outChannels + Tensor::VectorSize - 1) / Tensor::VectorSize) * Tensor::VectorSize;
+
+        channelWeights.resize(ww[1], ww[2] * ww[3], paddedChannels);
+        channelWeights.fill(0);
+
+        auto wIt = weights.begin();
+        auto channelWeightsIt = channelWeights.begin();
+
+        for(std::size_t channel = 0; channel != outChannels; ++channel)
+        {
+            for(std::size_t index = 0; index != kernelSize; ++index)
+            {
+                channelWeightsIt[index * paddedChannels + channel] = *wIt;
+                ++wIt;
+            }
+        }
+
+        channelBiases.resize(paddedChannels);
+        channelBiases.fill(0);
+        std::copy(biases.begin(), biases.end(), channelBiases.begin());
+    }
+
+    // Winograd weights are U = G g G^T for each input and output channel, with
+    // G = [1 0 0; 0.5 0.5 0.5; 0.5 -0.5 0.5; 0 0 1], stored as [tile positions, input depth, output channels]
+    // (output channels padded to Tensor::VectorSize).
+    // Biases are only stored on the (1, 1) tile position, which is added once to each output value
+    // by the output transform:
+    void packWinogradWeights(const Tensor& weights, const Tensor& biases, Tensor& winogradWeights,
+                             Tensor& winogradBiases)
+    {
+        const auto& ww = weights.getDims();
+        auto outChannels = ww[0];
+        auto depth = ww[3];
+        auto paddedChannels = ((outChannels + Tensor::VectorSize - 1) / Tensor::VectorSize) * Tensor::VectorSize;
+
+        winogradWeights.resize(16, depth, paddedChannels);
+        winogradWeights.fill(0);
+
+        auto wIt = weights.begin();
+        auto winogradWeightsIt = winogradWeights.begin();
+        const double g[4][3] = { { 1, 0, 0 }, { 0.5, 0.5, 0.5 }, { 0.5, -0.5, 0.5 }, { 0, 0, 1 } };
+
+        for(std::size_t channel = 0; channel != outChannels; ++channel)
+        {
+            for(std::size_t inChannel = 0; inChannel != depth; ++inChannel)
+            {
+                auto kernelIt = wIt + (channel * 9 * depth + inChannel);
+
+                for(std::size_t row = 0; row != 4; ++row)
+                {
+                    for(std::size_t column = 0; column != 4; ++column)
+                    {
+                        double value = 0;
+
+                        for(std::size_t y = 0; y != 3; ++y)
+                        {
+                            for(std::size_t x = 0; x != 3; ++x)
+                            {
+                                value += g[row][y] * double(kernelIt[(y * 3 + x) * depth]) * g[column][x];
+                            }
+                        }
+
+                        auto position = row * 4 + column;
+                        winogradWeightsIt[(position * depth + inChannel) * paddedChannels + channel] =
+                                Tensor::Type(value);
+                    }
                 }
             }
         }
+
+        winogradBiases.resize(16, paddedChannels);
+        winogradBiases.fill(0);
+        std::copy(biases.begin(), biases.end(), winogradBiases.begin() + 5 * paddedChannels);
+    }
+
+    bool checkInput(const Tensor::DimsVector& iw, const Tensor::DimsVector& ww)
+    {
+        if(iw.size() != 3)
+        {
+            PT_LOG_ERROR << "Input tensor dims count must be 3" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
+            return false;
+        }
+
+        if(iw[2] != ww[3])
+        {
+            PT_LOG_ERROR << "Input tensor dims[2] must be the same as weights dims[3]" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" <<
+                                " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+            return false;
+        }
+
+        return true;
     }
 }
 
 std::unique_ptr<Conv2DLayer> Conv2DLayer::create(std::istream& stream)
 {
-    auto weights = Tensor::create(4, stream);
+    bool quantized = false;
 
-    if(! weights)
+    if(! QuantizedTensor::parseType(stream, quantized))
     {
-        PT_LOG_ERROR << "Weights tensor parse failed" << std::endl;
+        PT_LOG_ERROR << "Weights type parse failed" << std::endl;
         return std::unique_ptr<Conv2DLayer>();
     }
 
+    Tensor weights;
+    QuantizedTensor quantizedWeights;
+
+    if(quantized)
+    {
+        auto tensor = QuantizedTensor::create(4, stream);
+
+        if(! tensor)
+        {
+            PT_LOG_ERROR << "Quantized weights tensor parse failed" << std::endl;
+            return std::unique_ptr<Conv2DLayer>();
+        }
+
+        quantizedWeights = std::move(*tensor);
+    }
+    else
+    {
+        auto tensor = Tensor::create(4, stream);
+
+        if(! tensor)
+        {
+            PT_LOG_ERROR << "Weights tensor parse failed" << std::endl;
+            return std::unique_ptr<Conv2DLayer>();
+        }
+
+        weights = std::move(*tensor);
+    }
+
     auto biases = Tensor::create(1, stream);
 
     if(! biases)
@@ -96,63 +1097,347 @@ std::unique_ptr<Conv2DLayer> Conv2DLayer::create(std::istream& stream)
         return std::unique_ptr<Conv2DLayer>();
     }
 
-    return std::unique_ptr<Conv2DLayer>(new Conv2DLayer(std::move(*weights), std::move(*biases),
-                                                        std::move(activation)));
+    // Padding mode is stored since v3 files:
+    auto padding = Padding::Legacy;
+    auto modelStream = dynamic_cast<ModelStream*>(&stream);
+
+    if(modelStream && modelStream->getVersion() >= 3)
+    {
+        unsigned int paddingValue = 0;
+
+        if(! Parser::parse(stream, paddingValue))
+        {
+            PT_LOG_ERROR << "Padding parse failed" << std::endl;
+            return std::unique_ptr<Conv2DLayer>();
+        }
+
+        if(paddingValue != unsigned(Padding::Valid) && paddingValue != unsigned(Padding::Same))
+        {
+            PT_LOG_ERROR << "Invalid padding value: " << paddingValue << std::endl;
+            return std::unique_ptr<Conv2DLayer>();
+        }
+
+        padding = Padding(paddingValue);
+    }
+
+    // Strides and dilation rates are stored since v4 files:
+    std::array<unsigned int, 4> stridesAndDilations = {{ 1, 1, 1, 1 }};
+
+    if(modelStream && modelStream->getVersion() >= 4)
+    {
+        if(! Parser::parse(stream, stridesAndDilations.data(), stridesAndDilations.size()))
+        {
+            PT_LOG_ERROR << "Strides and dilation rates parse failed" << std::endl;
+            return std::unique_ptr<Conv2DLayer>();
+        }
+
+        for(unsigned int value : stridesAndDilations)
+        {
+            if(value == 0 || value > unsigned(std::numeric_limits<int>::max()))
+            {
+                PT_LOG_ERROR << "Invalid stride or dilation rate: " << value << std::endl;
+                return std::unique_ptr<Conv2DLayer>();
+            }
+        }
+    }
+
+    return std::unique_ptr<Conv2DLayer>(new Conv2DLayer(std::move(weights), std::move(quantizedWeights),
+                                                        std::move(*biases), std::move(activation), padding,
+                                                        int(stridesAndDilations[0]), int(stridesAndDilations[1]),
+                                                        int(stridesAndDilations[2]), int(stridesAndDilations[3])));
 }
 
 bool Conv2DLayer::apply(LayerData& layerData) const
 {
-    Tensor& in = layerData.in;
-    const auto& iw = in.getDims();
+    const Tensor& in = layerData.in;
 
-    if(iw.size() != 3)
+    if(! checkInput(in.getDims(), _getWeightsDims()))
     {
-        PT_LOG_ERROR << "Input tensor dims count must be 3" <<
-                            " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
         return false;
     }
 
-    const auto& ww = _weights.getDims();
+    const auto& iw = in.getDims();
+    const auto& ww = _getWeightsDims();
+    auto outY = _getOutputSize(iw[0], ww[1], _strideY, _dilationY);
+    auto outX = _getOutputSize(iw[1], ww[2], _strideX, _dilationX);
 
-    if(iw[2] != ww[3])
+    if(! outY || ! outX)
     {
-        PT_LOG_ERROR << "Input tensor dims[2] must be the same as weights dims[3]" <<
+        PT_LOG_ERROR << "Input tensor is smaller than the kernel" <<
                             " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" <<
                             " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
         return false;
     }
 
-    auto offsetY = ww[1] - 1;
-    auto offsetX = ww[2] - 1;
-    layerData.in.pad(offsetY / 2, offsetX / 2, 0);
     Tensor& out = layerData.out;
-    out.resize(iw[0] - offsetY, iw[1] - offsetX, ww[0]);
+    out.resize(outY, outX, ww[0]);
+
+    Window window = {
+        _getPaddingBegin(iw[0], ww[1], _strideY, _dilationY), _getPaddingBegin(iw[1], ww[2], _strideX, _dilationX),
+        _strideY, _strideX, _dilationY, _dilationX
+    };
+
+    switch(_algorithm)
+    {
+
+    case Algorithm::Winograd:
+        winogradImpl(_winogradWeights, _winogradBiases, window, layerData.in, out, layerData.scratch,
+                     layerData.dispatcher);
+        break;
+
+    case Algorithm::Gemm:
+        gemmImpl(_channelWeights, _channelBiases, ww, window, layerData.in, out, layerData.scratch,
+                 layerData.dispatcher);
+        break;
+
+    case Algorithm::Channels:
+        channelMultiplyAddImpl(_channelWeights, _channelBiases, ww, window, layerData);
+        break;
+
+    case Algorithm::Int8:
+        multiplyAddImpl(_quantizedWeights, _biases, window, layerData);
+        break;
+
+    case Algorithm::Dot:
+    default:
+        multiplyAddImpl(_weights, _biases, window, layerData);
+        break;
+    }
+
+    _activation->apply(out);
+    return true;
+}
+
+bool Conv2DLayer::applyBatch(BatchLayerData& batchLayerData) const
+{
+    std::vector<Tensor>& in = batchLayerData.in;
+    std::vector<Tensor>& out = batchLayerData.out;
+    out.resize(in.size());
+
+    const auto& ww = _getWeightsDims();
 
-    auto tensorSize = int(ww[2] * ww[3]);
+    for(std::size_t index = 0, count = in.size(); index != count; ++index)
+    {
+        Tensor& sampleIn = in[index];
+
+        if(! checkInput(sampleIn.getDims(), _getWeightsDims()))
+        {
+            return false;
+        }
+
+        if(sampleIn.getDims() != in[0].getDims())
+        {
+            PT_LOG_ERROR << "Input tensors dims must be the same for all samples" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ sampleIn.getDims() } << ")" <<
+                                " (first input dims: " << VectorPrinter<std::size_t>{ in[0].getDims() } << ")" <<
+                                std::endl;
+            return false;
+        }
+    }
 
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
+    const auto& iw = in[0].getDims();
+    auto outY = _getOutputSize(iw[0], ww[1], _strideY, _dilationY);
+    auto outX = _getOutputSize(iw[1], ww[2], _strideX, _dilationX);
+
+    if(! outY || ! outX)
     {
-        multiplyAddImpl<Vector2MultiplyAdd>(_weights, _biases, layerData);
+        PT_LOG_ERROR << "Input tensors are smaller than the kernel" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" <<
+                            " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+        return false;
     }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
+
+    for(Tensor& sampleOut : out)
     {
-        multiplyAddImpl<VectorMultiplyAdd>(_weights, _biases, layerData);
+        sampleOut.resize(outY, outX, ww[0]);
     }
-    else
+
+    Window window = {
+        _getPaddingBegin(iw[0], ww[1], _strideY, _dilationY), _getPaddingBegin(iw[1], ww[2], _strideX, _dilationX),
+        _strideY, _strideX, _dilationY, _dilationX
+    };
+
+    switch(_algorithm)
     {
-        multiplyAddImpl<ScalarMultiplyAdd>(_weights, _biases, layerData);
+
+    case Algorithm::Winograd:
+        // Weights are reused across the tiles of each group, so samples are processed one by one:
+        for(std::size_t index = 0, count = in.size(); index != count; ++index)
+        {
+            winogradImpl(_winogradWeights, _winogradBiases, window, in[index], out[index], batchLayerData.scratch,
+                         batchLayerData.dispatcher);
+        }
+
+        break;
+
+    case Algorithm::Gemm:
+        // Weights are reused across the pixels of each tile, so samples are processed one by one:
+        for(std::size_t index = 0, count = in.size(); index != count; ++index)
+        {
+            gemmImpl(_channelWeights, _channelBiases, ww, window, in[index], out[index], batchLayerData.scratch,
+                     batchLayerData.dispatcher);
+        }
+
+        break;
+
+    case Algorithm::Channels:
+        channelMultiplyAddImpl(_channelWeights, _channelBiases, ww, window, batchLayerData);
+        break;
+
+    case Algorithm::Int8:
+        multiplyAddImpl(_quantizedWeights, _biases, window, batchLayerData);
+        break;
+
+    case Algorithm::Dot:
+    default:
+        multiplyAddImpl(_weights, _biases, window, batchLayerData);
+        break;
+    }
+
+    for(Tensor& sampleOut : out)
+    {
+        _activation->apply(sampleOut);
+    }
+
+    return true;
+}
+
+bool Conv2DLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! checkInput(inDims, _getWeightsDims()))
+    {
+        return false;
+    }
+
+    const auto& ww = _getWeightsDims();
+    auto outY = _getOutputSize(inDims[0], ww[1], _strideY, _dilationY);
+    auto outX = _getOutputSize(inDims[1], ww[2], _strideX, _dilationX);
+
+    if(! outY || ! outX)
+    {
+        PT_LOG_ERROR << "Input tensor is smaller than the kernel" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" <<
+                            " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+        return false;
+    }
+
+    outDims = { outY, outX, ww[0] };
+    return true;
+}
+
+bool Conv2DLayer::merge(std::unique_ptr<Layer>& nextLayer)
+{
+    // Quantized weights rows are scaled by their scales:
+    Tensor& weights = _quantizedWeights.isValid() ? _quantizedWeights.getScales() : _weights;
+
+    if(! LayerMerger::merge(weights, _biases, _activation, nextLayer))
+    {
+        return false;
+    }
+
+    // Repacked weights and biases must be updated if they have been folded:
+    if(_channelWeights.isValid())
+    {
+        packChannelWeights(_weights, _biases, _channelWeights, _channelBiases);
+    }
+
+    if(_winogradWeights.isValid())
+    {
+        packWinogradWeights(_weights, _biases, _winogradWeights, _winogradBiases);
     }
 
-    _activation->apply(out);
     return true;
 }
 
-Conv2DLayer::Conv2DLayer(Tensor&& weights, Tensor&& biases,
-                         std::unique_ptr<ActivationLayer>&& activation) noexcept :
+Conv2DLayer::Conv2DLayer(Tensor&& weights, QuantizedTensor&& quantizedWeights, Tensor&& biases,
+                         std::unique_ptr<ActivationLayer>&& activation, Padding padding, int strideY, int strideX,
+                         int dilationY, int dilationX) :
     _weights(std::move(weights)),
+    _quantizedWeights(std::move(quantizedWeights)),
     _biases(std::move(biases)),
-    _activation(std::move(activation))
+    _activation(std::move(activation)),
+    _padding(padding),
+    _strideY(strideY),
+    _strideX(strideX),
+    _dilationY(dilationY),
+    _dilationX(dilationX)
+{
+    const auto& ww = _getWeightsDims();
+
+    if(_quantizedWeights.isValid())
+    {
+        _algorithm = Algorithm::Int8;
+    }
+    else if(useWinograd(ww, _strideY, _strideX, _dilationY, _dilationX))
+    {
+        _algorithm = Algorithm::Winograd;
+    }
+    else if(useGemm(ww))
+    {
+        _algorithm = Algorithm::Gemm;
+    }
+    else if(useChannelKernel(ww, _dilationX))
+    {
+        _algorithm = Algorithm::Channels;
+    }
+    else
+    {
+        _algorithm = Algorithm::Dot;
+    }
+
+    if(_algorithm == Algorithm::Winograd)
+    {
+        packWinogradWeights(_weights, _biases, _winogradWeights, _winogradBiases);
+    }
+    else if(_algorithm != Algorithm::Dot && _algorithm != Algorithm::Int8)
+    {
+        packChannelWeights(_weights, _biases, _channelWeights, _channelBiases);
+    }
+}
+
+std::size_t Conv2DLayer::_getOutputSize(std::size_t inSize, std::size_t kernelSize, int stride,
+                                        int dilation) const noexcept
 {
+    auto dilatedKernelSize = (kernelSize - 1) * std::size_t(dilation) + 1;
+
+    switch(_padding)
+    {
+
+    case Padding::Valid:
+        return inSize >= dilatedKernelSize ? (inSize - dilatedKernelSize) / std::size_t(stride) + 1 : 0;
+
+    case Padding::Same:
+        return (inSize + std::size_t(stride) - 1) / std::size_t(stride);
+
+    case Padding::Legacy:
+    default:
+        // Legacy files pad (kernel size - 1) / 2 values on each side, so even kernels lose one value
+        // (they don't have strides nor dilation rates):
+        return inSize - (kernelSize - 1) % 2;
+    }
+}
+
+int Conv2DLayer::_getPaddingBegin(std::size_t inSize, std::size_t kernelSize, int stride,
+                                  int dilation) const noexcept
+{
+    switch(_padding)
+    {
+
+    case Padding::Valid:
+        return 0;
+
+    case Padding::Same:
+    {
+        // Keras same padding puts the extra padding value after the input when the total is odd:
+        auto outSize = int(_getOutputSize(inSize, kernelSize, stride, dilation));
+        auto dilatedKernelSize = (int(kernelSize) - 1) * dilation + 1;
+        return std::max((outSize - 1) * stride + dilatedKernelSize - int(inSize), 0) / 2;
+    }
+
+    case Padding::Legacy:
+    default:
+        return int(kernelSize - 1) / 2;
+    }
 }
 
 }
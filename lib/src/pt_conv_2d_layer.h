@@ -9,6 +9,7 @@
 #define PT_CONV_2D_LAYER_H
 
 #include "pt_tensor.h"
+#include "pt_quantized_tensor.h"
 #include "pt_activation_layer.h"
 
 namespace pt
@@ -22,12 +23,70 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool applyBatch(BatchLayerData& batchLayerData) const final;
+
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    bool merge(std::unique_ptr<Layer>& nextLayer) final;
+
 protected:
+    // Padding values are the same as the ones written by kerasify.py:
+    enum class Padding
+    {
+        Valid = 0,
+        Same = 1,
+        Legacy = 2 // Files older than v3: (kernel size - 1) / 2 zeros on each side.
+    };
+
+    // Convolution algorithms, selected from the layer shape when it is loaded:
+    enum class Algorithm
+    {
+        Dot,      // Dot products along kernel columns * input depth for each output value.
+        Channels, // Vectorized across output channels for each output pixel.
+        Gemm,     // Tiles of output pixels lowered to im2col buffers and multiplied by the channel weights.
+        Winograd, // Winograd F(2x2, 3x3) transforms of 2x2 output tiles, multiplied by the Winograd weights.
+        Int8      // Int8 dot products along kernel columns * input depth for all output channels of each pixel.
+    };
+
+    // Only one of the weights tensors is valid, depending on the weights type stored in the model file
+    // (quantized weights always use the Int8 algorithm):
     Tensor _weights;
+    QuantizedTensor _quantizedWeights;
     Tensor _biases;
+
+    // Weights and biases repacked as [kernel rows, kernel columns * input depth, output channels]
+    // (output channels padded to Tensor::VectorSize) for the algorithms which vectorize across output channels.
+    // They are only used by the Channels and Gemm algorithms:
+    Tensor _channelWeights;
+    Tensor _channelBiases;
+
+    // Weights transformed for each of the 16 positions of a 4x4 input tile, as [16, input depth, output channels]
+    // (output channels padded to Tensor::VectorSize), and their biases. They are only used by the Winograd algorithm:
+    Tensor _winogradWeights;
+    Tensor _winogradBiases;
+
     std::unique_ptr<ActivationLayer> _activation;
+    Padding _padding;
+    int _strideY;
+    int _strideX;
+    int _dilationY;
+    int _dilationX;
+    Algorithm _algorithm;
+
+    Conv2DLayer(Tensor&& weights, QuantizedTensor&& quantizedWeights, Tensor&& biases,
+                std::unique_ptr<ActivationLayer>&& activation, Padding padding, int strideY, int strideX,
+                int dilationY, int dilationX);
+
+    const DimsVector& _getWeightsDims() const noexcept
+    {
+        return _quantizedWeights.isValid() ? _quantizedWeights.getDims() : _weights.getDims();
+    }
+
+    // Returns the output size of one dimension (0 if the input is too small):
+    std::size_t _getOutputSize(std::size_t inSize, std::size_t kernelSize, int stride, int dilation) const noexcept;
 
-    Conv2DLayer(Tensor&& weights, Tensor&& biases, std::unique_ptr<ActivationLayer>&& activation) noexcept;
+    // Returns the zeros count added before the input on one dimension:
+    int _getPaddingBegin(std::size_t inSize, std::size_t kernelSize, int stride, int dilation) const noexcept;
 };
 
 }
@@ -0,0 +1,111 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_cpu_caches.h"
+
+#ifdef __linux__
+    #include <fstream>
+    #include <string>
+#endif
+
+namespace pt
+{
+
+namespace
+{
+    #ifdef __linux__
+        // Reads the given cache attribute of the first CPU (empty if it doesn't exist):
+        std::string readCacheAttribute(int index, const char* name)
+        {
+            std::ifstream file("/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/" + name);
+            std::string value;
+            file >> value;
+            return value;
+        }
+
+        // Parses sizes like "48K" or "32M" (0 if they are invalid):
+        std::size_t parseSize(const std::string& text)
+        {
+            std::size_t size = 0;
+            std::size_t index = 0;
+
+            for(std::size_t count = text.size(); index != count && text[index] >= '0' && text[index] <= '9'; ++index)
+            {
+                size = size * 10 + std::size_t(text[index] - '0');
+            }
+
+            if(index == text.size())
+            {
+                return size;
+            }
+
+            switch(text[index])
+            {
+
+            case 'K':
+                return size * 1024;
+
+            case 'M':
+                return size * 1024 * 1024;
+
+            case 'G':
+                return size * 1024 * 1024 * 1024;
+
+            default:
+                return 0;
+            }
+        }
+    #endif
+
+    CpuCaches detect()
+    {
+        CpuCaches caches = { 32 * 1024, 256 * 1024, 8 * 1024 * 1024 };
+
+        #ifdef __linux__
+            for(int index = 0; ; ++index)
+            {
+                std::string level = readCacheAttribute(index, "level");
+
+                if(level.empty())
+                {
+                    break;
+                }
+
+                std::string type = readCacheAttribute(index, "type");
+                std::size_t size = parseSize(readCacheAttribute(index, "size"));
+
+                if(type == "Instruction" || ! size)
+                {
+                    continue;
+                }
+
+                if(level == "1")
+                {
+                    caches.l1DataSize = size;
+                }
+                else if(level == "2")
+                {
+                    caches.l2Size = size;
+                }
+                else if(level == "3")
+                {
+                    caches.l3Size = size;
+                }
+            }
+        #endif
+
+        return caches;
+    }
+}
+
+const CpuCaches& CpuCaches::get()
+{
+    static const CpuCaches caches = detect();
+    return caches;
+}
+
+}
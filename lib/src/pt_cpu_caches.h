@@ -0,0 +1,32 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_CPU_CACHES_H
+#define PT_CPU_CACHES_H
+
+#include <cstddef>
+
+namespace pt
+{
+
+// Data caches sizes of the CPU in bytes, used to size the blocks of the layers which stream big weights.
+//
+// On Linux they are read from sysfs (from the first CPU). On other systems, or if they can't be read,
+// common desktop sizes are used instead.
+struct CpuCaches
+{
+    // Returns the sizes detected on this CPU (the detection is done on the first call):
+    static const CpuCaches& get();
+
+    std::size_t l1DataSize;
+    std::size_t l2Size;
+    std::size_t l3Size;
+};
+
+}
+
+#endif
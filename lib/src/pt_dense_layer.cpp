@@ -8,8 +8,12 @@
 #include "pt_dense_layer.h"
 
 #include <array>
+#include <algorithm>
 #include "pt_layer_data.h"
-#include "pt_multiply_add.h"
+#include "pt_dispatcher.h"
+#include "pt_kernels.h"
+#include "pt_cpu_caches.h"
+#include "pt_layer_merger.h"
 #include "pt_logger.h"
 
 namespace pt
@@ -17,8 +21,17 @@ namespace pt
 
 namespace
 {
-    template<class MultiplyAddType>
-    void multiplyAddImpl(const Tensor& weights, LayerData& layerData) noexcept
+    // Weights which don't fit in L2 cache are streamed from memory, so the next values of each row
+    // are prefetched while the current ones are multiplied:
+    constexpr int PrefetchBytes = 1024;
+
+    int getPrefetchDistance(const Tensor& weights)
+    {
+        auto weightsBytes = weights.getSize() * sizeof(Tensor::Type);
+        return weightsBytes > CpuCaches::get().l2Size ? int(PrefetchBytes / sizeof(Tensor::Type)) : 0;
+    }
+
+    void multiplyAddImpl(const Tensor& weights, LayerData& layerData)
     {
         const Tensor& in = layerData.in;
         Tensor& out = layerData.out;
@@ -26,31 +39,198 @@ namespace
         const auto& weightsDims = weights.getDims();
         auto wInc = int(weightsDims[1]);
         auto inIt = in.begin();
-        auto outIt = out.begin();
-        MultiplyAddType multiplyAdd;
+        auto outBegin = out.begin();
 
         auto weightsBegin = weights.begin();
         int its = int(weights.end() - weightsBegin) / wInc;
+        auto dotRows = Kernels::get().dotRows;
+        int prefetchDistance = getPrefetchDistance(weights);
+
+        layerData.dispatcher.run(its, wInc, [&](int taskBegin, int taskEnd)
+        {
+            dotRows(&*inIt, &*(weightsBegin + (taskBegin * wInc)), wInc, taskEnd - taskBegin, wInc,
+                    &*(outBegin + taskBegin), prefetchDistance);
+        });
+    }
+
+    void multiplyAddImpl(const Tensor& weights, BatchLayerData& batchLayerData)
+    {
+        const std::vector<Tensor>& in = batchLayerData.in;
+        std::vector<Tensor>& out = batchLayerData.out;
+
+        const auto& weightsDims = weights.getDims();
+        auto wInc = int(weightsDims[1]);
+        auto samples = int(in.size());
+
+        auto weightsBegin = weights.begin();
+        int its = int(weights.end() - weightsBegin) / wInc;
+
+        // Weights rows are processed in blocks small enough to stay in L1 cache (along with the inputs)
+        // while they are multiplied by all input samples. Blocks have at least the 8 rows which dotRows
+        // computes at once; blocks of longer rows stay in L2 cache instead:
+        auto blockValues = int(CpuCaches::get().l1DataSize / 2 / sizeof(Tensor::Type));
+        int blockIts = std::max(blockValues / wInc / 8 * 8, 8);
+        auto dotRows = Kernels::get().dotRows;
+        int prefetchDistance = getPrefetchDistance(weights);
+
+        batchLayerData.dispatcher.run(its, wInc * samples, [&](int taskBegin, int taskEnd)
+        {
+            for(int blockBegin = taskBegin; blockBegin < taskEnd; blockBegin += blockIts)
+            {
+                int blockEnd = std::min(blockBegin + blockIts, taskEnd);
+                auto wBegin = weightsBegin + (blockBegin * wInc);
+
+                for(int sample = 0; sample != samples; ++sample)
+                {
+                    auto inIt = in[std::size_t(sample)].begin();
+                    auto outIt = out[std::size_t(sample)].begin() + blockBegin;
+
+                    // Only the first sample loads the block from memory:
+                    dotRows(&*inIt, &*wBegin, wInc, blockEnd - blockBegin, wInc, &*outIt,
+                            sample ? 0 : prefetchDistance);
+                }
+            }
+        });
+    }
+
+    void multiplyAddImpl(const QuantizedTensor& weights, LayerData& layerData)
+    {
+        const Tensor& in = layerData.in;
+        std::vector<Tensor>& scratch = layerData.scratch;
+
+        if(scratch.empty())
+        {
+            scratch.resize(1);
+        }
+
+        // The input is quantized once and shared by all tasks:
+        std::int16_t* quantizedIn = QuantizedTensor::getBuffer(scratch[0], in.getSize());
+        FloatType inScale = QuantizedTensor::quantize(in.begin(), in.getSize(), quantizedIn);
+
+        auto wInc = int(weights.getRowSize());
+        auto its = int(weights.getDims()[0]);
+        auto weightsBegin = weights.getData();
+        auto scalesBegin = weights.getScales().begin();
+        auto outBegin = layerData.out.begin();
+        auto dotRowsInt8 = Kernels::get().dotRowsInt8;
 
-        for(auto wIt = weightsBegin, wEnd = weightsBegin + (its * wInc);
-            wIt != wEnd; wIt += wInc)
+        layerData.dispatcher.run(its, wInc, [&](int taskBegin, int taskEnd)
         {
-            *outIt += multiplyAdd(&*inIt, &*wIt, wInc);
-            ++outIt;
+            dotRowsInt8(quantizedIn, weightsBegin + (taskBegin * wInc), wInc, taskEnd - taskBegin, wInc,
+                        scalesBegin + taskBegin, inScale, outBegin + taskBegin);
+        });
+    }
+
+    void multiplyAddImpl(const QuantizedTensor& weights, BatchLayerData& batchLayerData)
+    {
+        const std::vector<Tensor>& in = batchLayerData.in;
+        std::vector<Tensor>& out = batchLayerData.out;
+
+        std::vector<Tensor>& scratch = batchLayerData.scratch;
+
+        if(scratch.size() < 2)
+        {
+            scratch.resize(2);
         }
+
+        // Each sample is quantized with its own scale, and all of them are shared by all tasks:
+        auto wInc = int(weights.getRowSize());
+        auto its = int(weights.getDims()[0]);
+        auto samples = int(in.size());
+        std::int16_t* quantizedIn = QuantizedTensor::getBuffer(scratch[0], std::size_t(samples * wInc));
+        Tensor& inScales = scratch[1];
+        inScales.resize(in.size());
+
+        for(int sample = 0; sample != samples; ++sample)
+        {
+            const Tensor& sampleIn = in[std::size_t(sample)];
+            inScales.begin()[sample] = QuantizedTensor::quantize(sampleIn.begin(), sampleIn.getSize(),
+                                                                 quantizedIn + (sample * wInc));
+        }
+
+        // Like with float weights, blocks of weights rows stay in L1 cache while they are multiplied
+        // by all input samples:
+        auto blockValues = int(CpuCaches::get().l1DataSize / 2 / sizeof(QuantizedTensor::Type));
+        int blockIts = std::max(blockValues / wInc / 4 * 4, 4);
+        auto weightsBegin = weights.getData();
+        auto scalesBegin = weights.getScales().begin();
+        auto dotRowsInt8 = Kernels::get().dotRowsInt8;
+
+        batchLayerData.dispatcher.run(its, wInc * samples, [&](int taskBegin, int taskEnd)
+        {
+            for(int blockBegin = taskBegin; blockBegin < taskEnd; blockBegin += blockIts)
+            {
+                int blockEnd = std::min(blockBegin + blockIts, taskEnd);
+
+                for(int sample = 0; sample != samples; ++sample)
+                {
+                    dotRowsInt8(quantizedIn + (sample * wInc), weightsBegin + (blockBegin * wInc), wInc,
+                                blockEnd - blockBegin, wInc, scalesBegin + blockBegin, inScales.begin()[sample],
+                                out[std::size_t(sample)].begin() + blockBegin);
+                }
+            }
+        });
+    }
+
+    bool checkInput(const Tensor::DimsVector& iw, const Tensor::DimsVector& ww)
+    {
+        if(iw.size() != 1)
+        {
+            PT_LOG_ERROR << "Input tensor dims count must be 1" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
+            return false;
+        }
+
+        if(iw[0] != ww[1])
+        {
+            PT_LOG_ERROR << "Input tensor dims[0] must be the same as weights dims[1]" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" <<
+                                " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+            return false;
+        }
+
+        return true;
     }
 }
 
 std::unique_ptr<DenseLayer> DenseLayer::create(std::istream& stream)
 {
-    auto weights = Tensor::create(2, stream);
+    bool quantized = false;
 
-    if(! weights)
+    if(! QuantizedTensor::parseType(stream, quantized))
     {
-        PT_LOG_ERROR << "Weights tensor parse failed" << std::endl;
+        PT_LOG_ERROR << "Weights type parse failed" << std::endl;
         return std::unique_ptr<DenseLayer>();
     }
 
+    Tensor weights;
+    QuantizedTensor quantizedWeights;
+
+    if(quantized)
+    {
+        auto tensor = QuantizedTensor::create(2, stream);
+
+        if(! tensor)
+        {
+            PT_LOG_ERROR << "Quantized weights tensor parse failed" << std::endl;
+            return std::unique_ptr<DenseLayer>();
+        }
+
+        quantizedWeights = std::move(*tensor);
+    }
+    else
+    {
+        auto tensor = Tensor::create(2, stream);
+
+        if(! tensor)
+        {
+            PT_LOG_ERROR << "Weights tensor parse failed" << std::endl;
+            return std::unique_ptr<DenseLayer>();
+        }
+
+        weights = std::move(*tensor);
+    }
+
     auto biases = Tensor::create(1, stream);
 
     if(! biases)
@@ -67,57 +247,88 @@ std::unique_ptr<DenseLayer> DenseLayer::create(std::istream& stream)
         return std::unique_ptr<DenseLayer>();
     }
 
-    return std::unique_ptr<DenseLayer>(new DenseLayer(std::move(*weights), std::move(*biases),
-                                                      std::move(activation)));
+    return std::unique_ptr<DenseLayer>(new DenseLayer(std::move(weights), std::move(quantizedWeights),
+                                                      std::move(*biases), std::move(activation)));
 }
 
 bool DenseLayer::apply(LayerData& layerData) const
 {
-    const Tensor& in = layerData.in;
-    const auto& iw = in.getDims();
-
-    if(iw.size() != 1)
+    if(! checkInput(layerData.in.getDims(), _getWeightsDims()))
     {
-        PT_LOG_ERROR << "Input tensor dims count must be 1" <<
-                            " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
         return false;
     }
 
-    const auto& ww = _weights.getDims();
+    Tensor& out = layerData.out;
+    _biases.copyTo(out);
 
-    if(iw[0] != ww[1])
+    if(_quantizedWeights.isValid())
     {
-        PT_LOG_ERROR << "Input tensor dims[0] must be the same as weights dims[1]" <<
-                            " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" <<
-                            " (weights dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
-        return false;
+        multiplyAddImpl(_quantizedWeights, layerData);
+    }
+    else
+    {
+        multiplyAddImpl(_weights, layerData);
     }
 
-    Tensor& out = layerData.out;
-    _biases.copyTo(out);
+    _activation->apply(out);
+    return true;
+}
 
-    auto tensorSize = int(ww[1]);
+bool DenseLayer::applyBatch(BatchLayerData& batchLayerData) const
+{
+    const std::vector<Tensor>& in = batchLayerData.in;
+    std::vector<Tensor>& out = batchLayerData.out;
+    out.resize(in.size());
 
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
+    for(std::size_t index = 0, count = in.size(); index != count; ++index)
     {
-        multiplyAddImpl<Vector2MultiplyAdd>(_weights, layerData);
+        if(! checkInput(in[index].getDims(), _getWeightsDims()))
+        {
+            return false;
+        }
+
+        _biases.copyTo(out[index]);
     }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
+
+    if(_quantizedWeights.isValid())
     {
-        multiplyAddImpl<VectorMultiplyAdd>(_weights, layerData);
+        multiplyAddImpl(_quantizedWeights, batchLayerData);
     }
     else
     {
-        multiplyAddImpl<ScalarMultiplyAdd>(_weights, layerData);
+        multiplyAddImpl(_weights, batchLayerData);
     }
 
-    _activation->apply(out);
+    for(Tensor& sampleOut : out)
+    {
+        _activation->apply(sampleOut);
+    }
+
+    return true;
+}
+
+bool DenseLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! checkInput(inDims, _getWeightsDims()))
+    {
+        return false;
+    }
+
+    outDims.assign(1, _getWeightsDims()[0]);
     return true;
 }
 
-DenseLayer::DenseLayer(Tensor&& weights, Tensor&& biases,
+bool DenseLayer::merge(std::unique_ptr<Layer>& nextLayer)
+{
+    // Quantized weights rows are scaled by their scales:
+    Tensor& weights = _quantizedWeights.isValid() ? _quantizedWeights.getScales() : _weights;
+    return LayerMerger::merge(weights, _biases, _activation, nextLayer);
+}
+
+DenseLayer::DenseLayer(Tensor&& weights, QuantizedTensor&& quantizedWeights, Tensor&& biases,
                        std::unique_ptr<ActivationLayer>&& activation) noexcept :
     _weights(std::move(weights)),
+    _quantizedWeights(std::move(quantizedWeights)),
     _biases(std::move(biases)),
     _activation(std::move(activation))
 {
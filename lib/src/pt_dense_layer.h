@@ -9,6 +9,7 @@
 #define PT_DENSE_LAYER_H
 
 #include "pt_tensor.h"
+#include "pt_quantized_tensor.h"
 #include "pt_activation_layer.h"
 
 namespace pt
@@ -22,12 +23,26 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool applyBatch(BatchLayerData& batchLayerData) const final;
+
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    bool merge(std::unique_ptr<Layer>& nextLayer) final;
+
 protected:
+    // Only one of the weights tensors is valid, depending on the weights type stored in the model file:
     Tensor _weights;
+    QuantizedTensor _quantizedWeights;
     Tensor _biases;
     std::unique_ptr<ActivationLayer> _activation;
 
-    DenseLayer(Tensor&& weights, Tensor&& biases, std::unique_ptr<ActivationLayer>&& activation) noexcept;
+    DenseLayer(Tensor&& weights, QuantizedTensor&& quantizedWeights, Tensor&& biases,
+               std::unique_ptr<ActivationLayer>&& activation) noexcept;
+
+    const DimsVector& _getWeightsDims() const noexcept
+    {
+        return _quantizedWeights.isValid() ? _quantizedWeights.getDims() : _weights.getDims();
+    }
 };
 
 }
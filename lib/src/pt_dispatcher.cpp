@@ -0,0 +1,167 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_dispatcher.h"
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
+
+namespace pt
+{
+
+struct Dispatcher::Data
+{
+    std::vector<std::thread> threads;
+    std::mutex runMutex;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable endCondition;
+    std::atomic<int> nextTask;
+    Invoker invoker = nullptr;
+    const void* task = nullptr;
+    int its = 0;
+    int tasksCount = 0;
+    int busyThreads = 0;
+    unsigned long generation = 0;
+    bool exit = false;
+
+    Data() :
+        nextTask(0)
+    {
+    }
+
+    // Processes chunks until all of them have been claimed:
+    void execute(Invoker taskInvoker, const void* taskPtr, int taskIts, int taskTasksCount) noexcept
+    {
+        int taskIndex = nextTask.fetch_add(1);
+
+        while(taskIndex < taskTasksCount)
+        {
+            auto begin = int((long long)(taskIts) * taskIndex / taskTasksCount);
+            auto end = int((long long)(taskIts) * (taskIndex + 1) / taskTasksCount);
+            taskInvoker(taskPtr, begin, end);
+            taskIndex = nextTask.fetch_add(1);
+        }
+    }
+
+    void work() noexcept
+    {
+        unsigned long threadGeneration = 0;
+
+        while(true)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startCondition.wait(lock, [&]{ return exit || generation != threadGeneration; });
+
+            if(exit)
+            {
+                return;
+            }
+
+            threadGeneration = generation;
+
+            auto taskInvoker = invoker;
+            auto taskPtr = task;
+            auto taskIts = its;
+            auto taskTasksCount = tasksCount;
+            ++busyThreads;
+            lock.unlock();
+
+            execute(taskInvoker, taskPtr, taskIts, taskTasksCount);
+
+            lock.lock();
+
+            if(--busyThreads == 0)
+            {
+                endCondition.notify_all();
+            }
+        }
+    }
+};
+
+Dispatcher::Dispatcher(std::size_t threadsCount) :
+    _threadsCount(std::max(threadsCount, std::size_t(1)))
+{
+    if(_threadsCount == 1)
+    {
+        return;
+    }
+
+    _data.reset(new Data());
+    _data->threads.reserve(_threadsCount - 1);
+
+    for(std::size_t index = 1; index < _threadsCount; ++index)
+    {
+        Data* data = _data.get();
+        _data->threads.emplace_back([data]{ data->work(); });
+    }
+}
+
+Dispatcher::~Dispatcher() noexcept
+{
+    if(! _data)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_data->mutex);
+        _data->exit = true;
+    }
+
+    _data->startCondition.notify_all();
+
+    for(std::thread& thread : _data->threads)
+    {
+        thread.join();
+    }
+}
+
+int Dispatcher::_getTasksCount(int its, int itCost) const noexcept
+{
+    if(_threadsCount == 1 || its <= 1)
+    {
+        return 1;
+    }
+
+    auto cost = (long long)(its) * std::max(itCost, 1);
+    auto tasksCount = std::max(cost / MinTaskCost, 1LL);
+    tasksCount = std::min(tasksCount, (long long)(_threadsCount));
+    tasksCount = std::min(tasksCount, (long long)(its));
+    return int(tasksCount);
+}
+
+void Dispatcher::_run(int its, int tasksCount, Invoker invoker, const void* task)
+{
+    Data& data = *_data;
+    std::lock_guard<std::mutex> runLock(data.runMutex);
+
+    {
+        // Wait until threads which woke up late from a previous run have left it:
+        std::unique_lock<std::mutex> lock(data.mutex);
+        data.endCondition.wait(lock, [&]{ return data.busyThreads == 0; });
+
+        data.invoker = invoker;
+        data.task = task;
+        data.its = its;
+        data.tasksCount = tasksCount;
+        data.nextTask.store(0);
+        ++data.generation;
+    }
+
+    data.startCondition.notify_all();
+    data.execute(invoker, task, its, tasksCount);
+
+    // All chunks have been claimed, wait until worker threads have processed them:
+    std::unique_lock<std::mutex> lock(data.mutex);
+    data.endCondition.wait(lock, [&]{ return data.busyThreads == 0; });
+}
+
+}
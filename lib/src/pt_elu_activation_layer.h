@@ -10,6 +10,7 @@
 
 #include "pt_tensor.h"
 #include "pt_activation_layer.h"
+#include "pt_kernels.h"
 
 namespace pt
 {
@@ -24,13 +25,7 @@ public:
 
     void apply(Tensor& out) const final
     {
-        for(FloatType& value : out)
-        {
-            if(value < 0)
-            {
-                value = std::expm1(value);
-            }
-        }
+        Kernels::get().elu(out.begin(), int(out.getSize()), 1);
     }
 };
 
@@ -8,7 +8,8 @@
 #include "pt_elu_layer.h"
 
 #include "pt_parser.h"
-#include "pt_layer_data.h"
+#include "pt_tensor.h"
+#include "pt_kernels.h"
 
 namespace pt
 {
@@ -26,19 +27,9 @@ std::unique_ptr<EluLayer> EluLayer::create(std::istream& stream)
     return std::unique_ptr<EluLayer>(new EluLayer(FloatType(alpha)));
 }
 
-bool EluLayer::apply(LayerData& layerData) const
+void EluLayer::apply(Tensor& out) const
 {
-    layerData.out = std::move(layerData.in);
-
-    for(FloatType& value : layerData.out)
-    {
-        if(value < 0)
-        {
-            value = _alpha * std::expm1(value);
-        }
-    }
-
-    return true;
+    Kernels::get().elu(out.begin(), int(out.getSize()), _alpha);
 }
 
 EluLayer::EluLayer(FloatType alpha) noexcept :
@@ -9,18 +9,20 @@
 #define PT_ELU_LAYER_H
 
 #include "pt_libsimdpp.h"
-#include "pt_layer.h"
+#include "pt_activation_layer.h"
 
 namespace pt
 {
 
-class EluLayer : public Layer
+class EluLayer : public ActivationLayer
 {
 
 public:
+    using ActivationLayer::apply;
+
     static std::unique_ptr<EluLayer> create(std::istream& stream);
 
-    bool apply(LayerData& layerData) const final;
+    void apply(Tensor& out) const final;
 
 protected:
     FloatType _alpha;
@@ -7,12 +7,31 @@
 
 #include "pt_embedding_layer.h"
 
+#include <algorithm>
+#include "pt_parser.h"
+#include "pt_model_stream.h"
 #include "pt_layer_data.h"
+#include "pt_lstm_layer.h"
 #include "pt_logger.h"
 
 namespace pt
 {
 
+namespace
+{
+    bool checkInput(const Tensor::DimsVector& iw)
+    {
+        if(iw.size() != 1 && iw.size() != 2)
+        {
+            PT_LOG_ERROR << "Input tensor dims count must be 1 or 2" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+}
+
 std::unique_ptr<EmbeddingLayer> EmbeddingLayer::create(std::istream& stream)
 {
     auto weights = Tensor::create(2, stream);
@@ -23,7 +42,17 @@ std::unique_ptr<EmbeddingLayer> EmbeddingLayer::create(std::istream& stream)
         return std::unique_ptr<EmbeddingLayer>();
     }
 
-    return std::unique_ptr<EmbeddingLayer>(new EmbeddingLayer(std::move(*weights)));
+    // Keras mask_zero flag is stored since v6 files:
+    unsigned int maskZero = 0;
+    auto modelStream = dynamic_cast<ModelStream*>(&stream);
+
+    if(modelStream && modelStream->getVersion() >= 6 && ! Parser::parse(stream, maskZero))
+    {
+        PT_LOG_ERROR << "Mask zero parse failed" << std::endl;
+        return std::unique_ptr<EmbeddingLayer>();
+    }
+
+    return std::unique_ptr<EmbeddingLayer>(new EmbeddingLayer(std::move(*weights), maskZero));
 }
 
 bool EmbeddingLayer::apply(LayerData& layerData) const
@@ -31,25 +60,109 @@ bool EmbeddingLayer::apply(LayerData& layerData) const
     const Tensor& in = layerData.in;
     const auto& iw = in.getDims();
 
-    Tensor& out = layerData.out;
-    out.resize(iw[0], iw[1], _weights.getDims()[1]);
+    if(! checkInput(iw))
+    {
+        return false;
+    }
+
+    const Tensor* ids = &in;
+
+    if(_fused)
+    {
+        // The next layer reads the ids:
+        std::swap(layerData.in, layerData.out);
+        ids = &layerData.out;
+    }
+    else
+    {
+        Tensor& out = layerData.out;
+        auto inc = _weights.getDims()[1];
+
+        if(iw.size() == 1)
+        {
+            out.resize(iw[0], inc);
+        }
+        else
+        {
+            out.resize(iw[0], iw[1], inc);
+        }
+
+        auto outIt = out.begin();
+        auto wBegin = _weights.begin();
+
+        for(auto inIt = in.begin(), inEnd = in.end(); inIt != inEnd; ++inIt)
+        {
+            auto wIt = wBegin + int(*inIt * inc);
+            std::memcpy(&*outIt, &*wIt, inc * sizeof(Tensor::Type));
+            outIt += long(inc);
+        }
+    }
 
-    auto outIt = out.begin();
-    auto wBegin = _weights.begin();
-    auto inc = _weights.getDims()[1];
+    // With mask_zero, timesteps (input dims[0] rows) whose ids are all 0 are masked:
+    Tensor& mask = layerData.mask;
 
-    for(auto inIt = in.begin(), inEnd = in.begin() + long(iw[0] * iw[1]); inIt != inEnd; ++inIt)
+    if(! _maskZero)
     {
-        auto wIt = wBegin + int(*inIt * inc);
-        std::memcpy(&*outIt, &*wIt, inc * sizeof(Tensor::Type));
-        outIt += long(inc);
+        mask.clear();
+        return true;
+    }
+
+    auto rows = ids->getDims()[0];
+    auto rowSize = ids->getSize() / rows;
+    auto inIt = ids->begin();
+    mask.resize(rows);
+
+    for(std::size_t row = 0; row != rows; ++row)
+    {
+        auto rowEnd = inIt + rowSize;
+        bool masked = std::all_of(inIt, rowEnd, [](Tensor::Type id) { return int(id) == 0; });
+        mask(row) = masked ? 0 : 1;
+        inIt = rowEnd;
     }
 
     return true;
 }
 
-EmbeddingLayer::EmbeddingLayer(Tensor&& weights) noexcept :
-    _weights(std::move(weights))
+bool EmbeddingLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! checkInput(inDims))
+    {
+        return false;
+    }
+
+    outDims = inDims;
+
+    if(! _fused)
+    {
+        outDims.push_back(_weights.getDims()[1]);
+    }
+
+    return true;
+}
+
+bool EmbeddingLayer::isInPlace() const noexcept
+{
+    return _fused;
+}
+
+bool EmbeddingLayer::merge(std::unique_ptr<Layer>& nextLayer)
+{
+    auto lstmLayer = dynamic_cast<LstmLayer*>(nextLayer.get());
+
+    if(! _fused && lstmLayer && lstmLayer->fuseEmbedding(_weights, PT_EMBEDDING_PROJECTION_MAX_SIZE))
+    {
+        // Embeddings are not needed anymore:
+        _fused = true;
+        _weights = Tensor();
+    }
+
+    // The LSTM layer is still needed, so it is not merged:
+    return false;
+}
+
+EmbeddingLayer::EmbeddingLayer(Tensor&& weights, bool maskZero) noexcept :
+    _weights(std::move(weights)),
+    _maskZero(maskZero)
 {
 }
 
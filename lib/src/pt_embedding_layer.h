@@ -22,10 +22,20 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    bool isInPlace() const noexcept final;
+
+    // If the next layer is a LSTM one, its input projection is precomputed for each embedding
+    // (see LstmLayer::fuseEmbedding), so this layer only forwards the ids (and computes their mask):
+    bool merge(std::unique_ptr<Layer>& nextLayer) final;
+
 protected:
     Tensor _weights;
+    bool _maskZero;
+    bool _fused = false;
 
-    explicit EmbeddingLayer(Tensor&& weights) noexcept;
+    EmbeddingLayer(Tensor&& weights, bool maskZero) noexcept;
 };
 
 }
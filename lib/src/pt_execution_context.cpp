@@ -0,0 +1,131 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_execution_context.h"
+
+#include <algorithm>
+#include "pt_model.h"
+#include "pt_logger.h"
+
+namespace pt
+{
+
+ExecutionContext::ExecutionContext(const Model& model) :
+    _model(model),
+    _ownDispatcher(1),
+    _dispatcher(_ownDispatcher)
+{
+}
+
+ExecutionContext::ExecutionContext(const Model& model, Dispatcher& dispatcher) :
+    _model(model),
+    _ownDispatcher(1),
+    _dispatcher(dispatcher)
+{
+}
+
+bool ExecutionContext::plan(const Tensor::DimsVector& inDims)
+{
+    if(inDims.empty())
+    {
+        PT_LOG_ERROR << "Input dims are empty" << std::endl;
+        return false;
+    }
+
+    // Each intermediate tensor lives from the layer which writes it to the next one,
+    // so two buffers big enough to store any of them are enough:
+    _layerInDims = inDims;
+
+    std::size_t maxSize = 1;
+
+    for(std::size_t dim : inDims)
+    {
+        maxSize *= dim;
+    }
+
+    for(const auto& layer : _model.getLayers())
+    {
+        if(! layer->getOutputDims(_layerInDims, _layerOutDims))
+        {
+            PT_LOG_ERROR << "Layer output dims inference failed" << std::endl;
+            _inDims.clear();
+            return false;
+        }
+
+        std::size_t outSize = 1;
+
+        for(std::size_t dim : _layerOutDims)
+        {
+            outSize *= dim;
+        }
+
+        maxSize = std::max(maxSize, layer->getInputBufferSize(_layerInDims));
+        maxSize = std::max(maxSize, outSize);
+        _layerInDims.swap(_layerOutDims);
+    }
+
+    // Buffers start at Tensor::Alignment boundaries:
+    std::size_t bufferSize = ((maxSize + Tensor::VectorSize - 1) / Tensor::VectorSize) * Tensor::VectorSize;
+
+    if(_arena.size() < bufferSize * 2)
+    {
+        _arena.resize(bufferSize * 2);
+    }
+
+    _bufferSize = bufferSize;
+    _resetBuffers();
+    _inDims = inDims;
+    _outDims = _layerInDims;
+    return true;
+}
+
+void ExecutionContext::_resetBuffers() noexcept
+{
+    _buffers[0].clear();
+    _buffers[0].setBuffer(_arena.data(), _bufferSize);
+    _buffers[1].clear();
+    _buffers[1].setBuffer(_arena.data() + _bufferSize, _bufferSize);
+}
+
+void ExecutionContext::_wrap(Tensor& tensor, Tensor::Type* data, const Tensor::DimsVector& dims)
+{
+    if(data)
+    {
+        std::size_t size = 1;
+
+        for(std::size_t dim : dims)
+        {
+            size *= dim;
+        }
+
+        tensor.clear();
+        tensor.setBuffer(data, size);
+    }
+
+    switch(dims.size())
+    {
+
+    case 1:
+        tensor.resize(dims[0]);
+        break;
+
+    case 2:
+        tensor.resize(dims[0], dims[1]);
+        break;
+
+    case 3:
+        tensor.resize(dims[0], dims[1], dims[2]);
+        break;
+
+    default:
+        PT_ASSERT(dims.size() == 4);
+        tensor.resize(dims[0], dims[1], dims[2], dims[3]);
+        break;
+    }
+}
+
+}
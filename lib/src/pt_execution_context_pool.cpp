@@ -0,0 +1,105 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_execution_context_pool.h"
+
+#include <algorithm>
+#include "pt_model.h"
+
+namespace pt
+{
+
+ExecutionContextPool::Handle::Handle(Handle&& other) noexcept :
+    _pool(other._pool),
+    _context(other._context)
+{
+    other._context = nullptr;
+}
+
+ExecutionContextPool::Handle::~Handle() noexcept
+{
+    if(_context)
+    {
+        _pool->_release(_context);
+    }
+}
+
+ExecutionContextPool::Handle::Handle(ExecutionContextPool& pool, ExecutionContext* context) noexcept :
+    _pool(&pool),
+    _context(context)
+{
+}
+
+ExecutionContextPool::ExecutionContextPool(const Model& model, std::size_t contextsCount) :
+    _model(model),
+    _slotsCount(std::max(contextsCount, std::size_t(1)))
+{
+    _slots.reset(new Slot[_slotsCount]);
+
+    for(std::size_t index = 0; index != _slotsCount; ++index)
+    {
+        _slots[index].context.store(new ExecutionContext(model), std::memory_order_relaxed);
+    }
+}
+
+ExecutionContextPool::~ExecutionContextPool() noexcept
+{
+    // All handles must have been destroyed, so all contexts are stored in the slots:
+    for(std::size_t index = 0; index != _slotsCount; ++index)
+    {
+        delete _slots[index].context.load(std::memory_order_acquire);
+    }
+}
+
+ExecutionContextPool::Handle ExecutionContextPool::acquire()
+{
+    for(std::size_t index = 0; index != _slotsCount; ++index)
+    {
+        std::atomic<ExecutionContext*>& slot = _slots[index].context;
+
+        // Empty slots are skipped without writing to them, to avoid bouncing their cache lines between threads:
+        if(slot.load(std::memory_order_relaxed))
+        {
+            if(ExecutionContext* context = slot.exchange(nullptr, std::memory_order_acquire))
+            {
+                return Handle(*this, context);
+            }
+        }
+    }
+
+    return Handle(*this, new ExecutionContext(_model));
+}
+
+bool ExecutionContextPool::predict(const Tensor& in, Tensor& out)
+{
+    Handle context = acquire();
+    return _model.predict(*context, in, out);
+}
+
+bool ExecutionContextPool::predict(const ConstTensorView& in, const TensorView& out)
+{
+    Handle context = acquire();
+    return _model.predict(*context, in, out);
+}
+
+void ExecutionContextPool::_release(ExecutionContext* context) noexcept
+{
+    for(std::size_t index = 0; index != _slotsCount; ++index)
+    {
+        ExecutionContext* expected = nullptr;
+
+        if(_slots[index].context.compare_exchange_strong(expected, context, std::memory_order_release,
+                                                         std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+
+    delete context;
+}
+
+}
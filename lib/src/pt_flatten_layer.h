@@ -22,10 +22,28 @@ public:
 
     bool apply(LayerData& layerData) const final
     {
-        layerData.out = std::move(layerData.in);
+        std::swap(layerData.in, layerData.out);
         layerData.out.flatten();
         return true;
     }
+
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final
+    {
+        std::size_t size = 1;
+
+        for(std::size_t dim : inDims)
+        {
+            size *= dim;
+        }
+
+        outDims.assign(1, size);
+        return true;
+    }
+
+    bool isInPlace() const noexcept final
+    {
+        return true;
+    }
 };
 
 }
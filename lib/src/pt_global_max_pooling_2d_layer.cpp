@@ -25,8 +25,8 @@ namespace
         const auto& iw = in.getDims();
         const auto& ow = out.getDims();
 
-        auto inData = in.getData().data();
-        auto outData = const_cast<Tensor::Type*>(out.getData().data());
+        auto inData = in.begin();
+        auto outData = out.begin();
 
         size_t its = ow[2];
 
@@ -73,4 +73,17 @@ bool GlobalMaxPooling2DLayer::apply(LayerData& layerData) const
     return true;
 }
 
+bool GlobalMaxPooling2DLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(inDims.size() != 3)
+    {
+        PT_LOG_ERROR << "Input tensor dims count must be 3" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
+    }
+
+    outDims.assign(1, inDims[2]);
+    return true;
+}
+
 }
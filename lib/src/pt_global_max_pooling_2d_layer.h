@@ -21,6 +21,8 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
     GlobalMaxPooling2DLayer()
     {
     }
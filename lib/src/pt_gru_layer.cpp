@@ -0,0 +1,361 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_gru_layer.h"
+
+#include <algorithm>
+#include "pt_parser.h"
+#include "pt_layer_data.h"
+#include "pt_dispatcher.h"
+#include "pt_kernels.h"
+#include "pt_logger.h"
+
+namespace pt
+{
+
+// Temporary tensors of a sequence, stored in the given scratch tensors:
+struct GruLayer::TempData
+{
+    static constexpr std::size_t TensorsCount = 5;
+
+    Tensor& projection;
+    Tensor& gates; // Update and reset gates.
+    Tensor& candidate;
+    Tensor& recurrent; // Candidate gate recurrent product (reset_after) or r * ht.
+    Tensor& ht;
+
+    TempData(std::size_t units, Tensor* tensors) :
+        projection(tensors[0]),
+        gates(tensors[1]),
+        candidate(tensors[2]),
+        recurrent(tensors[3]),
+        ht(tensors[4])
+    {
+        gates.resize(2 * units);
+        candidate.resize(units);
+        recurrent.resize(units);
+        ht.resize(units);
+        ht.fill(0);
+    }
+};
+
+std::unique_ptr<GruLayer> GruLayer::create(std::istream& stream)
+{
+    auto weights = Tensor::create(2, stream);
+
+    if(! weights)
+    {
+        PT_LOG_ERROR << "Weights tensor parse failed" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    auto recurrentWeights = Tensor::create(2, stream);
+
+    if(! recurrentWeights)
+    {
+        PT_LOG_ERROR << "Recurrent weights tensor parse failed" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    auto biases = Tensor::create(1, stream);
+
+    if(! biases)
+    {
+        PT_LOG_ERROR << "Biases tensor parse failed" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    auto recurrentBiases = Tensor::create(1, stream);
+
+    if(! recurrentBiases)
+    {
+        PT_LOG_ERROR << "Recurrent biases tensor parse failed" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    const auto& wDims = weights->getDims();
+    const auto& uDims = recurrentWeights->getDims();
+    auto units = uDims[1];
+    auto gatesSize = 3 * units;
+
+    if(wDims[0] != gatesSize || uDims[0] != gatesSize)
+    {
+        PT_LOG_ERROR << "W and U tensors dims[0] must be 3 * units" <<
+                        " (W dims: " << VectorPrinter<std::size_t>{ wDims } << ")" <<
+                        " (U dims: " << VectorPrinter<std::size_t>{ uDims } << ")" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    if(biases->getSize() != gatesSize || recurrentBiases->getSize() != gatesSize)
+    {
+        PT_LOG_ERROR << "Biases tensors size must be 3 * units" <<
+                        " (biases dims: " << VectorPrinter<std::size_t>{ biases->getDims() } << ")" <<
+                        " (recurrent biases dims: " << VectorPrinter<std::size_t>{ recurrentBiases->getDims() } <<
+                        ")" << " (units: " << units << ")" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    auto innerActivation = ActivationLayer::create(stream);
+
+    if(! innerActivation)
+    {
+        PT_LOG_ERROR << "Activation layer parse failed" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    auto activation = ActivationLayer::create(stream);
+
+    if(! activation)
+    {
+        PT_LOG_ERROR << "Activation layer parse failed" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    unsigned int resetAfter = 0;
+
+    if(! Parser::parse(stream, resetAfter))
+    {
+        PT_LOG_ERROR << "Reset after parse failed" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    unsigned int returnSequences = 0;
+
+    if(! Parser::parse(stream, returnSequences))
+    {
+        PT_LOG_ERROR << "Return sequences parse failed" << std::endl;
+        return std::unique_ptr<GruLayer>();
+    }
+
+    // Recurrent biases which are not multiplied by the reset gate are added to the input ones,
+    // so they are applied with the input projection (biases are copied first, since they can point
+    // to the read only pages of a mapped file):
+    auto foldedSize = resetAfter ? 2 * units : gatesSize;
+    Tensor foldedBiases(*biases);
+    Kernels::get().add(recurrentBiases->begin(), foldedBiases.begin(), int(foldedSize));
+
+    Tensor candidateRecurrentBiases;
+
+    if(resetAfter)
+    {
+        candidateRecurrentBiases.resize(units);
+        std::copy(recurrentBiases->begin() + long(2 * units), recurrentBiases->end(), candidateRecurrentBiases.begin());
+    }
+
+    return std::unique_ptr<GruLayer>(new GruLayer(std::move(*weights), std::move(*recurrentWeights),
+                                                  std::move(foldedBiases), std::move(candidateRecurrentBiases),
+                                                  std::move(innerActivation), std::move(activation),
+                                                  resetAfter, returnSequences));
+}
+
+bool GruLayer::apply(LayerData& layerData) const
+{
+    const Tensor& in = layerData.in;
+
+    if(! _checkInput(in.getDims()))
+    {
+        return false;
+    }
+
+    auto units = _getUnits();
+    auto steps = in.getDims()[0];
+    const Tensor::Type* mask;
+
+    if(! _getMask(layerData.mask, steps, mask))
+    {
+        return false;
+    }
+
+    TempData tempData(units, _getScratch(layerData.scratch, TempData::TensorsCount));
+    _project(in, mask, _weights, _biases, tempData.projection, layerData.dispatcher);
+
+    // Masked timesteps are skipped, so they keep the state unchanged and output the last ht, like in Keras:
+    Tensor& out = layerData.out;
+
+    if(_returnSequences)
+    {
+        out.resize(steps, units);
+
+        auto outIt = out.begin();
+
+        for(std::size_t s = 0; s != steps; ++s)
+        {
+            if(! _isMasked(mask, s))
+            {
+                _step(s, layerData.dispatcher, tempData);
+            }
+
+            outIt = std::copy(tempData.ht.begin(), tempData.ht.end(), outIt);
+        }
+    }
+    else
+    {
+        for(std::size_t s = 0; s != steps; ++s)
+        {
+            if(! _isMasked(mask, s))
+            {
+                _step(s, layerData.dispatcher, tempData);
+            }
+        }
+
+        tempData.ht.copyTo(out);
+
+        // The mask of the input timesteps doesn't apply to the output:
+        layerData.mask.clear();
+    }
+
+    out.eraseDummyDims();
+    return true;
+}
+
+bool GruLayer::applyStep(LayerData& layerData, Tensor& state) const
+{
+    const Tensor& in = layerData.in;
+
+    if(! _checkStepInput(in.getDims(), _weights.getDims()[1]))
+    {
+        return false;
+    }
+
+    if(state.getSize() != getStateSize())
+    {
+        PT_LOG_ERROR << "Invalid state size: " << state.getSize() << " (expected: " << getStateSize() << ")" <<
+                        std::endl;
+        return false;
+    }
+
+    const Tensor::Type* mask;
+
+    if(! _getMask(layerData.mask, 1, mask))
+    {
+        return false;
+    }
+
+    if(! _returnSequences)
+    {
+        layerData.mask.clear();
+    }
+
+    // A masked timestep keeps the state unchanged and outputs the last ht:
+    if(_isMasked(mask, 0))
+    {
+        state.copyTo(layerData.out);
+        return true;
+    }
+
+    TempData tempData(_getUnits(), _getScratch(layerData.scratch, TempData::TensorsCount));
+    state.copyTo(tempData.ht);
+
+    _project(in, nullptr, _weights, _biases, tempData.projection, layerData.dispatcher);
+    _step(0, layerData.dispatcher, tempData);
+
+    tempData.ht.copyTo(state);
+    tempData.ht.copyTo(layerData.out);
+    return true;
+}
+
+bool GruLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! _checkInput(inDims))
+    {
+        return false;
+    }
+
+    auto units = _getUnits();
+
+    if(_returnSequences && inDims[0] > 1)
+    {
+        outDims = { inDims[0], units };
+    }
+    else
+    {
+        outDims.assign(1, units);
+    }
+
+    return true;
+}
+
+GruLayer::GruLayer(Tensor&& weights, Tensor&& recurrentWeights, Tensor&& biases, Tensor&& recurrentBiases,
+                   std::unique_ptr<ActivationLayer>&& innerActivation, std::unique_ptr<ActivationLayer>&& activation,
+                   bool resetAfter, bool returnSequences) noexcept :
+    _weights(std::move(weights)),
+    _recurrentWeights(std::move(recurrentWeights)),
+    _biases(std::move(biases)),
+    _recurrentBiases(std::move(recurrentBiases)),
+    _innerActivation(std::move(innerActivation)),
+    _activation(std::move(activation)),
+    _resetAfter(resetAfter),
+    _returnSequences(returnSequences)
+{
+}
+
+bool GruLayer::_checkInput(const DimsVector& inDims) const
+{
+    if(inDims.size() != 2)
+    {
+        PT_LOG_ERROR << "Input tensor dims count must be 2" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
+    }
+
+    const auto& ww = _weights.getDims();
+
+    if(inDims[1] != ww[1])
+    {
+        PT_LOG_ERROR << "Input tensor dims[1] must be the same as W dims[1]" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" <<
+                            " (W dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void GruLayer::_step(std::size_t step, Dispatcher& dispatcher, TempData& tempData) const
+{
+    auto units = _getUnits();
+    auto projectionIt = tempData.projection.begin() + long(step * 3 * units);
+    Tensor& gates = tempData.gates;
+    Tensor& candidate = tempData.candidate;
+    auto htIt = tempData.ht.begin();
+
+    // Update and reset gates:
+    std::copy(projectionIt, projectionIt + long(2 * units), gates.begin());
+    _recurrentMultiplyAdd(htIt, _recurrentWeights, 0, 2 * units, gates.begin(), dispatcher);
+    _innerActivation->apply(gates);
+
+    auto zIt = gates.begin();
+    auto rIt = zIt + long(units);
+    auto candidateIt = candidate.begin();
+    auto recurrentIt = tempData.recurrent.begin();
+    std::copy(projectionIt + long(2 * units), projectionIt + long(3 * units), candidateIt);
+
+    if(_resetAfter)
+    {
+        // candidate += r * (ht * Uh^T + recurrent biases):
+        std::copy(_recurrentBiases.begin(), _recurrentBiases.end(), recurrentIt);
+        _recurrentMultiplyAdd(htIt, _recurrentWeights, 2 * units, 3 * units, recurrentIt, dispatcher);
+        Kernels::get().multiplyAdd(rIt, recurrentIt, candidateIt, int(units));
+    }
+    else
+    {
+        // candidate += (r * ht) * Uh^T:
+        std::copy(htIt, htIt + long(units), recurrentIt);
+        Kernels::get().multiply(rIt, recurrentIt, int(units));
+        _recurrentMultiplyAdd(recurrentIt, _recurrentWeights, 2 * units, 3 * units, candidateIt, dispatcher);
+    }
+
+    _activation->apply(candidate);
+
+    // ht = z * ht + (1 - z) * candidate = candidate + z * (ht - candidate), updated in place:
+    const Kernels& kernels = Kernels::get();
+    kernels.subtract(candidateIt, htIt, int(units));
+    kernels.multiply(zIt, htIt, int(units));
+    kernels.add(candidateIt, htIt, int(units));
+}
+
+}
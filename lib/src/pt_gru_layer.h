@@ -0,0 +1,66 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_GRU_LAYER_H
+#define PT_GRU_LAYER_H
+
+#include "pt_tensor.h"
+#include "pt_activation_layer.h"
+#include "pt_recurrent_layer.h"
+
+namespace pt
+{
+
+class GruLayer : public RecurrentLayer
+{
+
+public:
+    static std::unique_ptr<GruLayer> create(std::istream& stream);
+
+    bool apply(LayerData& layerData) const final;
+
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    // State is stored as ht:
+    std::size_t getStateSize() const noexcept final
+    {
+        return _getUnits();
+    }
+
+    bool applyStep(LayerData& layerData, Tensor& state) const final;
+
+protected:
+    struct TempData;
+
+    // Gates weights are packed in update, reset and candidate order, like in Keras:
+    Tensor _weights;
+    Tensor _recurrentWeights;
+    Tensor _biases;
+    Tensor _recurrentBiases; // Candidate gate ones, only valid if _resetAfter (the others are folded into _biases).
+    std::unique_ptr<ActivationLayer> _innerActivation;
+    std::unique_ptr<ActivationLayer> _activation;
+    bool _resetAfter;
+    bool _returnSequences;
+
+    GruLayer(Tensor&& weights, Tensor&& recurrentWeights, Tensor&& biases, Tensor&& recurrentBiases,
+             std::unique_ptr<ActivationLayer>&& innerActivation, std::unique_ptr<ActivationLayer>&& activation,
+             bool resetAfter, bool returnSequences) noexcept;
+
+    // Biases are packed as [3 * units]:
+    std::size_t _getUnits() const noexcept
+    {
+        return _biases.getSize() / 3;
+    }
+
+    bool _checkInput(const DimsVector& inDims) const;
+
+    void _step(std::size_t step, Dispatcher& dispatcher, TempData& tempData) const;
+};
+
+}
+
+#endif
@@ -14,7 +14,18 @@ namespace pt
 
 bool InputLayer::apply(LayerData& layerData) const
 {
-    layerData.out = layerData.in;
+    std::swap(layerData.in, layerData.out);
+    return true;
+}
+
+bool InputLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    outDims = inDims;
+    return true;
+}
+
+bool InputLayer::isInPlace() const noexcept
+{
     return true;
 }
     
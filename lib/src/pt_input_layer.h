@@ -23,8 +23,11 @@ public:
     static std::unique_ptr<InputLayer> create(std::istream& stream);
 
     bool apply(LayerData& layerData) const final;
-    
-    using DimsVector = std::vector<std::size_t>;
+
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    bool isInPlace() const noexcept final;
+
     // protected:
     //    
     //    std::string _name;
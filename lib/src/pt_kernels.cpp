@@ -0,0 +1,632 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_kernels.h"
+
+#include <algorithm>
+#include "pt_add.h"
+#include "pt_subtract.h"
+#include "pt_multiply.h"
+#include "pt_max.h"
+#include "pt_multiply_add.h"
+#include "pt_math.h"
+
+#if PT_RUNTIME_DISPATCH_ENABLE
+    #include "simdpp/dispatch/get_arch_raw_cpuid.h"
+
+    #define SIMDPP_USER_ARCH_INFO simdpp::get_arch_raw_cpuid()
+#endif
+
+namespace pt
+{
+
+namespace Variants
+{
+
+#if PT_RUNTIME_DISPATCH_ENABLE && SIMDPP_EMIT_DISPATCHER
+    // Declares get() for each arch variant and defines a get() dispatcher which calls the best one:
+    const Kernels& get();
+
+    SIMDPP_MAKE_DISPATCHER((const Kernels&)(get)())
+#else
+    namespace SIMDPP_ARCH_NAMESPACE
+    {
+        const Kernels& get();
+    }
+#endif
+
+namespace SIMDPP_ARCH_NAMESPACE
+{
+
+namespace
+{
+    FloatType dot(const FloatType* a, const FloatType* b, int length) noexcept
+    {
+        if(PT_LOOP_UNROLLING_ENABLE && length >= int(FloatSize) * 2)
+        {
+            return Vector2MultiplyAdd()(a, b, length);
+        }
+
+        if(length >= int(FloatSize))
+        {
+            return VectorMultiplyAdd()(a, b, length);
+        }
+
+        return ScalarMultiplyAdd()(a, b, length);
+    }
+
+    #if ! PT_DOUBLE_ENABLE
+        PT_INLINE simdpp::float32<4> addHalves(const simdpp::float32<4>& value) noexcept
+        {
+            return value;
+        }
+
+        // Adds the 128-bit parts of the given vector:
+        template<unsigned N>
+        PT_INLINE simdpp::float32<4> addHalves(const simdpp::float32<N>& value) noexcept
+        {
+            simdpp::float32<N / 2> low, high;
+            simdpp::split(value, low, high);
+            return addHalves(simdpp::float32<N / 2>(simdpp::add(low, high)));
+        }
+    #endif
+
+    // r[i] += horizontal sum of v[i]:
+    PT_INLINE void reduceAdd4(FloatVector& v0, FloatVector& v1, FloatVector& v2, FloatVector& v3,
+                              FloatType* r) noexcept
+    {
+        #if PT_DOUBLE_ENABLE
+            r[0] += simdpp::reduce_add(v0);
+            r[1] += simdpp::reduce_add(v1);
+            r[2] += simdpp::reduce_add(v2);
+            r[3] += simdpp::reduce_add(v3);
+        #else
+            // After transposing each 128-bit part, lane i of each part holds values of v[i], so the four sums
+            // need 3 vector additions instead of four horizontal reductions:
+            simdpp::transpose4(v0, v1, v2, v3);
+
+            FloatVector sum = simdpp::add(simdpp::add(v0, v1), simdpp::add(v2, v3));
+            simdpp::float32<4> sums = simdpp::load_u(r);
+            sums = simdpp::add(sums, addHalves(sum));
+            simdpp::store_u(r, sums);
+        #endif
+    }
+
+    // Computes Blocks * 4 rows of dotRows with a single pass over a:
+    template<int Blocks, bool Prefetch>
+    void dotRowsBlock(const FloatType* a, const FloatType* b, int bInc, int length, FloatType* r,
+                      int prefetchDistance) noexcept
+    {
+        constexpr auto vectorSize = int(FloatSize);
+        constexpr auto rows = Blocks * 4;
+
+        // Only one prefetch is issued for each cache line:
+        constexpr auto lineValues = int(64 / sizeof(FloatType));
+        constexpr auto lineMask = lineValues - 1;
+        FloatVector acc[rows];
+
+        for(int row = 0; row != rows; ++row)
+        {
+            acc[row] = makeVector(FloatType(0));
+        }
+
+        int index = 0;
+
+        for(int vectorsLength = length - vectorSize; index <= vectorsLength; index += vectorSize)
+        {
+            FloatVector aVector = simdpp::load_u(a + index);
+
+            if(Prefetch && (index & lineMask) == 0)
+            {
+                for(int row = 0; row != rows; ++row)
+                {
+                    simdpp::prefetch_read(b + row * bInc + index + prefetchDistance);
+                }
+            }
+
+            for(int row = 0; row != rows; ++row)
+            {
+                acc[row] = detail::madd(aVector, simdpp::load_u(b + row * bInc + index), acc[row]);
+            }
+        }
+
+        for(int block = 0; block != Blocks; ++block)
+        {
+            int row = block * 4;
+            reduceAdd4(acc[row], acc[row + 1], acc[row + 2], acc[row + 3], r + row);
+        }
+
+        for(int row = 0; row != rows; ++row)
+        {
+            r[row] += ScalarMultiplyAdd()(a + index, b + row * bInc + index, length - index);
+        }
+    }
+
+    template<bool Prefetch>
+    int dotRowsBlocks(const FloatType* a, const FloatType* b, int bInc, int rows, int length, FloatType* r,
+                      int prefetchDistance) noexcept
+    {
+        int row = 0;
+
+        // 8 rows use 8 accumulators, which along with the a vector and the b loads fit in the 16 vector
+        // registers of x86-64 and ARM NEON:
+        for(; row + 8 <= rows; row += 8)
+        {
+            dotRowsBlock<2, Prefetch>(a, b + row * bInc, bInc, length, r + row, prefetchDistance);
+        }
+
+        if(row + 4 <= rows)
+        {
+            dotRowsBlock<1, Prefetch>(a, b + row * bInc, bInc, length, r + row, prefetchDistance);
+            row += 4;
+        }
+
+        return row;
+    }
+
+    void dotRows(const FloatType* a, const FloatType* b, int bInc, int rows, int length, FloatType* r,
+                 int prefetchDistance) noexcept
+    {
+        int row = prefetchDistance ? dotRowsBlocks<true>(a, b, bInc, rows, length, r, prefetchDistance) :
+                                     dotRowsBlocks<false>(a, b, bInc, rows, length, r, 0);
+
+        for(; row != rows; ++row)
+        {
+            r[row] += dot(a, b + row * bInc, length);
+        }
+    }
+
+    // Native vectors of the int8 kernels:
+    using Int16Vector = simdpp::int16<SIMDPP_FAST_INT16_SIZE>;
+    using Int32Vector = simdpp::int32<SIMDPP_FAST_INT16_SIZE / 2>;
+
+    // Returns a[2i] * b[2i] + a[2i + 1] * b[2i + 1] for each lane i of the result (pmaddwd on x86):
+    PT_INLINE Int32Vector multiplyAddPairs(const Int16Vector& a, const Int16Vector& b) noexcept
+    {
+        #if SIMDPP_USE_AVX512BW
+            return Int32Vector(_mm512_madd_epi16(a.native(), b.native()));
+        #elif SIMDPP_USE_AVX2
+            return Int32Vector(_mm256_madd_epi16(a.native(), b.native()));
+        #elif SIMDPP_USE_SSE2
+            return Int32Vector(_mm_madd_epi16(a.native(), b.native()));
+        #else
+            // Products of values in [-127, 127] fit in 16 bits, and the lanes order doesn't matter
+            // since the accumulators are reduced anyway:
+            simdpp::int32<Int16Vector::length> products = simdpp::to_int32(simdpp::mul_lo(a, b));
+            Int32Vector low, high;
+            simdpp::split(products, low, high);
+            return simdpp::add(low, high);
+        #endif
+    }
+
+    // Computes Rows rows of dotRowsInt8 with a single pass over a:
+    template<int Rows>
+    void dotRowsInt8Block(const std::int16_t* a, const std::int8_t* b, int bInc, int length,
+                          const FloatType* bScales, FloatType aScale, FloatType* r) noexcept
+    {
+        // Each iteration loads one int8 vector of each row, which is widened to two int16 vectors:
+        constexpr auto vectorSize = int(Int16Vector::length);
+        constexpr auto chunkSize = vectorSize * 2;
+        Int32Vector zero = simdpp::make_zero();
+        Int32Vector acc[Rows];
+
+        for(int row = 0; row != Rows; ++row)
+        {
+            acc[row] = zero;
+        }
+
+        int index = 0;
+
+        for(int chunksLength = length - chunkSize; index <= chunksLength; index += chunkSize)
+        {
+            Int16Vector aLow = simdpp::load_u(a + index);
+            Int16Vector aHigh = simdpp::load_u(a + index + vectorSize);
+
+            for(int row = 0; row != Rows; ++row)
+            {
+                simdpp::int8<chunkSize> bValues = simdpp::load_u(b + row * bInc + index);
+                simdpp::int16<chunkSize> bWide = simdpp::to_int16(bValues);
+                Int32Vector sums = simdpp::add(multiplyAddPairs(aLow, bWide.vec(0)),
+                                               multiplyAddPairs(aHigh, bWide.vec(1)));
+                acc[row] = simdpp::add(acc[row], sums);
+            }
+        }
+
+        for(int row = 0; row != Rows; ++row)
+        {
+            const std::int8_t* bRow = b + row * bInc;
+            std::int32_t sum = simdpp::reduce_add(acc[row]);
+
+            for(int index2 = index; index2 != length; ++index2)
+            {
+                sum += std::int32_t(a[index2]) * std::int32_t(bRow[index2]);
+            }
+
+            r[row] += FloatType(sum) * aScale * bScales[row];
+        }
+    }
+
+    void dotRowsInt8(const std::int16_t* a, const std::int8_t* b, int bInc, int rows, int length,
+                     const FloatType* bScales, FloatType aScale, FloatType* r) noexcept
+    {
+        int row = 0;
+
+        for(; row + 4 <= rows; row += 4)
+        {
+            dotRowsInt8Block<4>(a, b + row * bInc, bInc, length, bScales + row, aScale, r + row);
+        }
+
+        for(; row != rows; ++row)
+        {
+            dotRowsInt8Block<1>(a, b + row * bInc, bInc, length, bScales + row, aScale, r + row);
+        }
+    }
+
+    void multiplyAdd(const FloatType* a, const FloatType* b, FloatType* r, int length) noexcept
+    {
+        if(PT_LOOP_UNROLLING_ENABLE && length >= int(FloatSize) * 2)
+        {
+            Vector2MultiplyAdd()(a, b, r, length);
+        }
+        else if(length >= int(FloatSize))
+        {
+            VectorMultiplyAdd()(a, b, r, length);
+        }
+        else
+        {
+            ScalarMultiplyAdd()(a, b, r, length);
+        }
+    }
+
+    void add(const FloatType* a, FloatType* r, int length) noexcept
+    {
+        if(PT_LOOP_UNROLLING_ENABLE && length >= int(FloatSize) * 2)
+        {
+            Vector2Add()(a, r, length);
+        }
+        else if(length >= int(FloatSize))
+        {
+            VectorAdd()(a, r, length);
+        }
+        else
+        {
+            ScalarAdd()(a, r, length);
+        }
+    }
+
+    void subtract(const FloatType* a, FloatType* r, int length) noexcept
+    {
+        if(PT_LOOP_UNROLLING_ENABLE && length >= int(FloatSize) * 2)
+        {
+            Vector2Subtract()(a, r, length);
+        }
+        else if(length >= int(FloatSize))
+        {
+            VectorSubtract()(a, r, length);
+        }
+        else
+        {
+            ScalarSubtract()(a, r, length);
+        }
+    }
+
+    void multiply(const FloatType* a, FloatType* r, int length) noexcept
+    {
+        if(PT_LOOP_UNROLLING_ENABLE && length >= int(FloatSize) * 2)
+        {
+            Vector2Multiply()(a, r, length);
+        }
+        else if(length >= int(FloatSize))
+        {
+            VectorMultiply()(a, r, length);
+        }
+        else
+        {
+            ScalarMultiply()(a, r, length);
+        }
+    }
+
+    void max(const FloatType* a, FloatType* r, int length) noexcept
+    {
+        if(PT_LOOP_UNROLLING_ENABLE && length >= int(FloatSize) * 2)
+        {
+            Vector2Max()(a, r, length);
+        }
+        else if(length >= int(FloatSize))
+        {
+            VectorMax()(a, r, length);
+        }
+        else
+        {
+            ScalarMax()(a, r, length);
+        }
+    }
+
+    #if PT_DOUBLE_ENABLE
+        using NarrowFloatVector = simdpp::float64<2>;
+    #else
+        using NarrowFloatVector = simdpp::float32<4>;
+    #endif
+
+    template<class Vector>
+    PT_INLINE Vector gemmMadd(const Vector& av, const Vector& bv, const Vector& rv) noexcept
+    {
+        #if PT_FMADD_ENABLE
+            return simdpp::fmadd(av, bv, rv);
+        #else
+            return simdpp::add(rv, simdpp::mul(av, bv));
+        #endif
+    }
+
+    // Computes Rows rows and Blocks vectors of columns of gemm (see pt_kernels.h), only writing the first
+    // columns values of each row:
+    template<class Vector, int Rows, int Blocks>
+    void gemmBlock(const FloatType* a, int length, const FloatType* b, int bInc, const FloatType* bias,
+                   FloatType* c, int cInc, int columns) noexcept
+    {
+        constexpr auto vectorSize = int(Vector::length);
+        Vector acc[Rows][Blocks];
+
+        for(int row = 0; row != Rows; ++row)
+        {
+            for(int block = 0; block != Blocks; ++block)
+            {
+                acc[row][block] = simdpp::load_u(bias + block * vectorSize);
+            }
+        }
+
+        for(int index = 0; index != length; ++index)
+        {
+            Vector bVectors[Blocks];
+
+            for(int block = 0; block != Blocks; ++block)
+            {
+                bVectors[block] = simdpp::load_u(b + block * vectorSize);
+            }
+
+            for(int row = 0; row != Rows; ++row)
+            {
+                Vector aVector = simdpp::load_splat(a + row * length + index);
+
+                for(int block = 0; block != Blocks; ++block)
+                {
+                    acc[row][block] = gemmMadd(aVector, bVectors[block], acc[row][block]);
+                }
+            }
+
+            b += bInc;
+        }
+
+        for(int row = 0; row != Rows; ++row)
+        {
+            FloatType* cRow = c + row * cInc;
+
+            for(int block = 0; block != Blocks; ++block)
+            {
+                int blockColumns = columns - block * vectorSize;
+
+                if(blockColumns >= vectorSize)
+                {
+                    simdpp::store_u(cRow + block * vectorSize, acc[row][block]);
+                }
+                else if(blockColumns > 0)
+                {
+                    // Last columns don't fill the vector:
+                    alignas(sizeof(Vector)) FloatType values[vectorSize];
+                    simdpp::store(values, acc[row][block]);
+                    std::copy(values, values + blockColumns, cRow + block * vectorSize);
+                }
+            }
+        }
+    }
+
+    template<class Vector, int Blocks>
+    void gemmRows(const FloatType* a, int rows, int length, const FloatType* b, int bInc, const FloatType* bias,
+                  FloatType* c, int cInc, int columns) noexcept
+    {
+        // 6 rows * 2 vectors use 12 accumulators, which along with the b vectors and the broadcasted a value
+        // fit in the 16 vector registers of x86-64 (SSE and AVX):
+        constexpr int blockRows = 6;
+        int row = 0;
+
+        for(; row + blockRows <= rows; row += blockRows)
+        {
+            gemmBlock<Vector, blockRows, Blocks>(a + row * length, length, b, bInc, bias, c + row * cInc, cInc,
+                                                 columns);
+        }
+
+        switch(rows - row)
+        {
+
+        case 5:
+            gemmBlock<Vector, 5, Blocks>(a + row * length, length, b, bInc, bias, c + row * cInc, cInc, columns);
+            break;
+
+        case 4:
+            gemmBlock<Vector, 4, Blocks>(a + row * length, length, b, bInc, bias, c + row * cInc, cInc, columns);
+            break;
+
+        case 3:
+            gemmBlock<Vector, 3, Blocks>(a + row * length, length, b, bInc, bias, c + row * cInc, cInc, columns);
+            break;
+
+        case 2:
+            gemmBlock<Vector, 2, Blocks>(a + row * length, length, b, bInc, bias, c + row * cInc, cInc, columns);
+            break;
+
+        case 1:
+            gemmBlock<Vector, 1, Blocks>(a + row * length, length, b, bInc, bias, c + row * cInc, cInc, columns);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    void gemm(const FloatType* a, int rows, int length, const FloatType* b, int bInc, const FloatType* bias,
+              FloatType* c, int cInc, int columns) noexcept
+    {
+        constexpr auto vectorSize = int(FloatSize);
+        constexpr auto narrowVectorSize = int(NarrowFloatVector::length);
+        int column = 0;
+
+        for(; column < columns && column + vectorSize * 2 <= bInc; column += vectorSize * 2)
+        {
+            gemmRows<FloatVector, 2>(a, rows, length, b + column, bInc, bias + column, c + column, cInc,
+                                     columns - column);
+        }
+
+        for(; column < columns && column + vectorSize <= bInc; column += vectorSize)
+        {
+            gemmRows<FloatVector, 1>(a, rows, length, b + column, bInc, bias + column, c + column, cInc,
+                                     columns - column);
+        }
+
+        // bInc is only a multiple of the vector size of the instruction set selected in pt_tweakme.h,
+        // which can be smaller than the vector size of this variant (AVX2 and AVX-512 under runtime dispatch),
+        // so the last columns are computed with 128-bit vectors:
+        if(narrowVectorSize < vectorSize)
+        {
+            for(; column < columns && column + narrowVectorSize * 2 <= bInc; column += narrowVectorSize * 2)
+            {
+                gemmRows<NarrowFloatVector, 2>(a, rows, length, b + column, bInc, bias + column, c + column, cInc,
+                                               columns - column);
+            }
+
+            for(; column < columns && column + narrowVectorSize <= bInc; column += narrowVectorSize)
+            {
+                gemmRows<NarrowFloatVector, 1>(a, rows, length, b + column, bInc, bias + column, c + column, cInc,
+                                               columns - column);
+            }
+        }
+
+        for(; column < columns; ++column)
+        {
+            for(int row = 0; row != rows; ++row)
+            {
+                const FloatType* aRow = a + row * length;
+                FloatType sum = bias[column];
+
+                for(int index = 0; index != length; ++index)
+                {
+                    sum += aRow[index] * b[index * bInc + column];
+                }
+
+                c[row * cInc + column] = sum;
+            }
+        }
+    }
+
+    void relu(FloatType* data, int length) noexcept
+    {
+        FloatVector zero = Math::splat(0);
+
+        Math::transform(data, length, [&zero](const FloatVector& value) -> FloatVector
+        {
+            return simdpp::max(value, zero);
+        },
+        [](FloatType value)
+        {
+            return value < 0 ? FloatType(0) : value;
+        });
+    }
+
+    void elu(FloatType* data, int length, FloatType alpha) noexcept
+    {
+        FloatVector alphaVector = Math::splat(alpha);
+        FloatVector zero = Math::splat(0);
+
+        Math::transform(data, length, [&alphaVector, &zero](const FloatVector& value) -> FloatVector
+        {
+            FloatVector negative = simdpp::mul(Math::expm1(value), alphaVector);
+            return simdpp::blend(negative, value, simdpp::cmp_lt(value, zero));
+        },
+        [alpha](FloatType value)
+        {
+            return value < 0 ? alpha * std::expm1(value) : value;
+        });
+    }
+
+    void selu(FloatType* data, int length) noexcept
+    {
+        constexpr auto alpha = FloatType(1.6732632423543772848170429916717);
+        constexpr auto scale = FloatType(1.0507009873554804934193349852946);
+
+        Math::transform(data, length, [](const FloatVector& value) -> FloatVector
+        {
+            FloatVector negative = simdpp::mul(Math::expm1(value), Math::splat(alpha));
+            FloatVector result = simdpp::blend(negative, value, simdpp::cmp_lt(value, Math::splat(0)));
+            return simdpp::mul(result, Math::splat(scale));
+        },
+        [](FloatType value)
+        {
+            return (value < 0 ? alpha * std::expm1(value) : value) * scale;
+        });
+    }
+
+    void softPlus(FloatType* data, int length) noexcept
+    {
+        Math::transform(data, length, [](const FloatVector& value){ return Math::softPlus(value); },
+                        [](FloatType value){ return Math::softPlus(value); });
+    }
+
+    void softSign(FloatType* data, int length) noexcept
+    {
+        FloatVector one = Math::splat(1);
+
+        Math::transform(data, length, [&one](const FloatVector& value) -> FloatVector
+        {
+            FloatVector d = simdpp::add(one, simdpp::abs(value));
+            return simdpp::div(value, d);
+        },
+        [](FloatType value)
+        {
+            return value / (FloatType(1) + std::abs(value));
+        });
+    }
+
+    void sigmoid(FloatType* data, int length) noexcept
+    {
+        Math::transform(data, length, [](const FloatVector& value){ return Math::sigmoid(value); },
+                        [](FloatType value){ return Math::sigmoid(value); });
+    }
+
+    void tanh(FloatType* data, int length) noexcept
+    {
+        Math::transform(data, length, [](const FloatVector& value){ return Math::tanh(value); },
+                        [](FloatType value){ return std::tanh(value); });
+    }
+
+    const Kernels kernels = {
+        SIMDPP_ARCH_NAME, dot, dotRows, dotRowsInt8, multiplyAdd, add, subtract, multiply, max, gemm, relu, elu, selu,
+        softPlus, softSign, sigmoid, tanh
+    };
+}
+
+const Kernels& get()
+{
+    return kernels;
+}
+
+}
+
+}
+
+#if ! PT_RUNTIME_DISPATCH_ENABLE || SIMDPP_EMIT_DISPATCHER
+    const Kernels& Kernels::get() noexcept
+    {
+        #if PT_RUNTIME_DISPATCH_ENABLE
+            // CPUID is only checked once:
+            static const Kernels& kernels = Variants::get();
+            return kernels;
+        #else
+            return Variants::SIMDPP_ARCH_NAMESPACE::get();
+        #endif
+    }
+#endif
+
+}
@@ -0,0 +1,86 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_KERNELS_H
+#define PT_KERNELS_H
+
+#include <cstdint>
+#include "pt_libsimdpp.h"
+
+namespace pt
+{
+
+// Hot loops of the library, which work with unaligned arrays of any length.
+//
+// By default they are compiled for the instruction set selected in pt_tweakme.h. With runtime dispatch enabled
+// (PT_RUNTIME_DISPATCH CMake option), pt_kernels.cpp is compiled once for each supported x86 instruction set
+// and the best variant supported by the CPU is selected with CPUID.
+//
+// Code compiled for a specific instruction set (pt_kernels.cpp and the helpers it includes, like pt_math.h)
+// lives in libsimdpp arch namespace, so the variants don't clash when they are linked together.
+struct Kernels
+{
+    // Returns the kernels variant selected for this CPU (the selection is done on the first call,
+    // which is done by Model::create):
+    static const Kernels& get() noexcept;
+
+    // libsimdpp arch namespace of the selected variant (e.g. "arch_avx2_fma3"):
+    const char* arch;
+
+    // Returns the sum of a[i] * b[i]:
+    FloatType (*dot)(const FloatType* a, const FloatType* b, int length) noexcept;
+
+    // r[row] += sum(a[i] * b[row][i]) for each of the rows rows of b, which are bInc values apart.
+    // Blocks of rows share each a load and their horizontal sums are reduced together.
+    // If prefetchDistance is not 0, b values which are prefetchDistance values ahead of the loaded ones
+    // are prefetched (useful when b is streamed from memory):
+    void (*dotRows)(const FloatType* a, const FloatType* b, int bInc, int rows, int length, FloatType* r,
+                    int prefetchDistance) noexcept;
+
+    // r[row] += aScale * bScales[row] * sum(a[i] * b[row][i]) for each of the rows rows of b, which are bInc
+    // values apart. Values of a and b must be in [-127, 127] (see QuantizedTensor), so products are summed
+    // in 32 bits integers without overflow if length is lower than 2^17:
+    void (*dotRowsInt8)(const std::int16_t* a, const std::int8_t* b, int bInc, int rows, int length,
+                        const FloatType* bScales, FloatType aScale, FloatType* r) noexcept;
+
+    // r[i] += a[i] * b[i]:
+    void (*multiplyAdd)(const FloatType* a, const FloatType* b, FloatType* r, int length) noexcept;
+
+    // r[i] += a[i]:
+    void (*add)(const FloatType* a, FloatType* r, int length) noexcept;
+
+    // r[i] -= a[i]:
+    void (*subtract)(const FloatType* a, FloatType* r, int length) noexcept;
+
+    // r[i] *= a[i]:
+    void (*multiply)(const FloatType* a, FloatType* r, int length) noexcept;
+
+    // r[i] = max(r[i], a[i]):
+    void (*max)(const FloatType* a, FloatType* r, int length) noexcept;
+
+    // c[row][column] = bias[column] + sum(a[row][i] * b[i][column]) for i in [0, length):
+    // * a rows are length values apart.
+    // * b rows and bias have bInc values (columns <= bInc, values after the first columns ones are ignored).
+    // * c rows are cInc values apart and only their first columns values are written.
+    //
+    // Blocks of rows and columns are accumulated in registers, so each b load is reused for many rows:
+    void (*gemm)(const FloatType* a, int rows, int length, const FloatType* b, int bInc, const FloatType* bias,
+                 FloatType* c, int cInc, int columns) noexcept;
+
+    // In place activations:
+    void (*relu)(FloatType* data, int length) noexcept;
+    void (*elu)(FloatType* data, int length, FloatType alpha) noexcept;
+    void (*selu)(FloatType* data, int length) noexcept;
+    void (*softPlus)(FloatType* data, int length) noexcept;
+    void (*softSign)(FloatType* data, int length) noexcept;
+    void (*sigmoid)(FloatType* data, int length) noexcept;
+    void (*tanh)(FloatType* data, int length) noexcept;
+};
+
+}
+
+#endif
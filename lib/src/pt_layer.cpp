@@ -8,6 +8,7 @@
 #include "pt_layer.h"
 
 #include "pt_parser.h"
+#include "pt_layer_data.h"
 #include "pt_dense_layer.h"
 #include "pt_conv_1d_layer.h"
 #include "pt_conv_2d_layer.h"
@@ -17,11 +18,14 @@
 #include "pt_activation_layer.h"
 #include "pt_max_pooling_2d_layer.h"
 #include "pt_lstm_layer.h"
+#include "pt_gru_layer.h"
+#include "pt_simple_rnn_layer.h"
 #include "pt_embedding_layer.h"
 #include "pt_batch_normalization_layer.h"
 #include "pt_leaky_relu_layer.h"
 #include "pt_global_max_pooling_2d_layer.h"
 #include "pt_input_layer.h"
+#include "pt_masking_layer.h"
 
 
 namespace pt
@@ -44,7 +48,10 @@ namespace
         BatchNormalization = 12,
         LeakyRelu = 13,
         GlobalMaxPooling2D = 14,
-        Input = 15
+        Input = 15,
+        Masking = 16,
+        Gru = 17,
+        SimpleRnn = 18
     };
 }
 
@@ -119,6 +126,18 @@ std::unique_ptr<Layer> Layer::create(std::istream& stream)
         layer = InputLayer::create(stream);
         break;
 
+    case Masking:
+        layer = MaskingLayer::create(stream);
+        break;
+
+    case Gru:
+        layer = GruLayer::create(stream);
+        break;
+
+    case SimpleRnn:
+        layer = SimpleRnnLayer::create(stream);
+        break;
+
     default:
         PT_LOG_ERROR << "Unknown layer ID: " << layerID << std::endl;
     }
@@ -130,4 +149,48 @@ Layer::~Layer() noexcept
 {
 }
 
+bool Layer::applyBatch(BatchLayerData& batchLayerData) const
+{
+    auto& in = batchLayerData.in;
+    auto& out = batchLayerData.out;
+    auto& masks = batchLayerData.masks;
+    out.resize(in.size());
+    masks.resize(in.size());
+
+    for(std::size_t index = 0, count = in.size(); index != count; ++index)
+    {
+        LayerData layerData{ in[index], out[index], masks[index], batchLayerData.scratch, batchLayerData.dispatcher,
+                             batchLayerData.config };
+
+        if(! apply(layerData))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::size_t Layer::getInputBufferSize(const DimsVector& inDims) const
+{
+    std::size_t size = 1;
+
+    for(std::size_t dim : inDims)
+    {
+        size *= dim;
+    }
+
+    return size;
+}
+
+bool Layer::isInPlace() const noexcept
+{
+    return false;
+}
+
+bool Layer::merge(std::unique_ptr<Layer>&)
+{
+    return false;
+}
+
 }
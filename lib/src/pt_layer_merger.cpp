@@ -0,0 +1,84 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_layer_merger.h"
+
+#include "pt_tensor.h"
+#include "pt_linear_activation_layer.h"
+#include "pt_batch_normalization_layer.h"
+
+namespace pt
+{
+
+namespace
+{
+    // Tensors read from a mapped file point to its read only pages, so they are copied before being modified:
+    void makeWritable(Tensor& tensor)
+    {
+        if(tensor.getBufferSize())
+        {
+            tensor = Tensor(tensor);
+        }
+    }
+
+    bool foldBatchNormalization(Tensor& weights, Tensor& biases, const BatchNormalizationLayer& batchNormalization)
+    {
+        const Tensor& scales = batchNormalization.getWeights();
+        const Tensor& offsets = batchNormalization.getBiases();
+        auto channels = biases.getSize();
+
+        if(scales.getDims().size() != 1 || scales.getSize() != channels || weights.getDims()[0] != channels)
+        {
+            return false;
+        }
+
+        // (w * in + b) * s + o = (w * s) * in + (b * s + o):
+        makeWritable(weights);
+        makeWritable(biases);
+
+        auto rowSize = weights.getSize() / channels;
+        auto wIt = weights.begin();
+
+        for(std::size_t channel = 0; channel != channels; ++channel)
+        {
+            FloatType scale = scales.begin()[channel];
+
+            for(auto wEnd = wIt + rowSize; wIt != wEnd; ++wIt)
+            {
+                *wIt *= scale;
+            }
+
+            biases.begin()[channel] = biases.begin()[channel] * scale + offsets.begin()[channel];
+        }
+
+        return true;
+    }
+}
+
+bool LayerMerger::merge(Tensor& weights, Tensor& biases, std::unique_ptr<ActivationLayer>& activation,
+                        std::unique_ptr<Layer>& nextLayer)
+{
+    if(! dynamic_cast<const LinearActivationLayer*>(activation.get()))
+    {
+        return false;
+    }
+
+    if(auto batchNormalization = dynamic_cast<const BatchNormalizationLayer*>(nextLayer.get()))
+    {
+        return foldBatchNormalization(weights, biases, *batchNormalization);
+    }
+
+    if(dynamic_cast<const ActivationLayer*>(nextLayer.get()))
+    {
+        activation.reset(static_cast<ActivationLayer*>(nextLayer.release()));
+        return true;
+    }
+
+    return false;
+}
+
+}
@@ -0,0 +1,35 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_LAYER_MERGER_H
+#define PT_LAYER_MERGER_H
+
+#include <memory>
+
+namespace pt
+{
+
+class Tensor;
+class Layer;
+class ActivationLayer;
+
+namespace LayerMerger
+{
+    // Merges the next layer into a layer which computes activation(weights * in + biases), with one row of weights
+    // (weights dims[0]) for each output channel, like Dense, Conv1D and Conv2D layers:
+    //
+    // * A batch normalization is folded into weights and biases if the activation is linear.
+    // * An activation (including ELU and LeakyReLU layers) replaces a linear activation.
+    //
+    // Returns true if the next layer has been merged:
+    bool merge(Tensor& weights, Tensor& biases, std::unique_ptr<ActivationLayer>& activation,
+               std::unique_ptr<Layer>& nextLayer);
+}
+
+}
+
+#endif
@@ -8,7 +8,7 @@
 #include "pt_leaky_relu_layer.h"
 
 #include "pt_parser.h"
-#include "pt_layer_data.h"
+#include "pt_tensor.h"
 
 namespace pt
 {
@@ -26,19 +26,15 @@ std::unique_ptr<LeakyReluLayer> LeakyReluLayer::create(std::istream& stream)
     return std::unique_ptr<LeakyReluLayer>(new LeakyReluLayer(FloatType(alpha)));
 }
 
-bool LeakyReluLayer::apply(LayerData& layerData) const
+void LeakyReluLayer::apply(Tensor& out) const
 {
-    layerData.out = std::move(layerData.in);
-
-    for(FloatType& value : layerData.out)
+    for(FloatType& value : out)
     {
         if(value < 0)
         {
             value *= _alpha;
         }
     }
-
-    return true;
 }
 
 LeakyReluLayer::LeakyReluLayer(FloatType alpha) noexcept :
@@ -9,18 +9,20 @@
 #define PT_LEAKY_RELU_LAYER_H
 
 #include "pt_libsimdpp.h"
-#include "pt_layer.h"
+#include "pt_activation_layer.h"
 
 namespace pt
 {
 
-class LeakyReluLayer : public Layer
+class LeakyReluLayer : public ActivationLayer
 {
 
 public:
+    using ActivationLayer::apply;
+
     static std::unique_ptr<LeakyReluLayer> create(std::istream& stream);
 
-    bool apply(LayerData& layerData) const final;
+    void apply(Tensor& out) const final;
 
 protected:
     FloatType _alpha;
@@ -9,7 +9,8 @@
 
 #include <array>
 #include "pt_layer_data.h"
-#include "pt_multiply_add.h"
+#include "pt_dispatcher.h"
+#include "pt_kernels.h"
 #include "pt_logger.h"
 
 namespace pt
@@ -17,7 +18,6 @@ namespace pt
 
 namespace
 {
-    template<class MultiplyAddType>
     void multiplyAddImpl(const Tensor& weights, const Tensor& biases, LayerData& layerData)
     {
         const Tensor& in = layerData.in;
@@ -30,32 +30,62 @@ namespace
         auto wInc = int(ww[2] * ww[1]);
         auto wInc2 = int(ww[2]);
 
-        auto inIt = in.begin();
-        auto outIt = out.begin();
-        auto bIt = biases.begin();
-        MultiplyAddType multiplyAdd;
+        auto inBegin = in.begin();
+        auto outBegin = out.begin();
+        auto bBegin = biases.begin();
 
         auto weightsBegin = weights.begin();
         int its = int(weights.end() - weightsBegin) / wInc;
-        int taskEnd = its;
 
-        for(auto wIt = weightsBegin, wEnd = weightsBegin + (taskEnd * wInc);
-            wIt != wEnd; wIt += wInc)
+        layerData.dispatcher.run(its, wInc, [&](int taskBegin, int taskEnd)
         {
-            auto outIt2 = outIt;
-            auto bIt2 = bIt;
+            auto inIt = inBegin + (taskBegin * inInc);
+            auto outIt = outBegin + (taskBegin * bOutInc);
+            auto bIt = bBegin + (taskBegin * bOutInc);
+            auto dot = Kernels::get().dot;
 
-            for(auto wIt2 = wIt; wIt2 != wIt + wInc; wIt2 += wInc2)
+            for(auto wIt = weightsBegin + (taskBegin * wInc), wEnd = weightsBegin + (taskEnd * wInc);
+                wIt != wEnd; wIt += wInc)
             {
-                *outIt2 = *bIt2 + multiplyAdd(&*inIt, &*wIt2, wInc2);
-                ++outIt2;
-                ++bIt2;
+                auto outIt2 = outIt;
+                auto bIt2 = bIt;
+
+                for(auto wIt2 = wIt; wIt2 != wIt + wInc; wIt2 += wInc2)
+                {
+                    *outIt2 = *bIt2 + dot(&*inIt, &*wIt2, wInc2);
+                    ++outIt2;
+                    ++bIt2;
+                }
+
+                inIt += inInc;
+                outIt += bOutInc;
+                bIt += bOutInc;
             }
+        });
+    }
+
+    bool checkInput(const Tensor::DimsVector& iw, const Tensor& weights)
+    {
+        if(iw.size() != 2)
+        {
+            PT_LOG_ERROR << "Input tensor dims count must be 2" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{iw} << ")" << std::endl;
+            return false;
+        }
+
+        const auto& ww = weights.getDims();
+        auto offset = (ww[2] / iw[1]) - 1;
 
-            inIt += inInc;
-            outIt += bOutInc;
-            bIt += bOutInc;
+        if(iw[0] != ww[0] + offset)
+        {
+            PT_LOG_ERROR << "Input tensor dims[0] must be the same as weights dims[0] + offset" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{iw} << ")" <<
+                                " (weights dims: " << VectorPrinter<std::size_t>{ww} << ")" <<
+                                " (offset: " << offset << ")" << std::endl;
+            return false;
         }
+
+        return true;
     }
 }
 
@@ -92,47 +122,30 @@ std::unique_ptr<LocallyConnected1DLayer> LocallyConnected1DLayer::create(std::is
 
 bool LocallyConnected1DLayer::apply(LayerData& layerData) const
 {
-    Tensor& in = layerData.in;
-    Tensor& out = layerData.out;
-    const auto& iw = in.getDims();
-
-    if(iw.size() != 2)
+    if(! checkInput(layerData.in.getDims(), _weights))
     {
-        PT_LOG_ERROR << "Input tensor dims count must be 2" <<
-                            " (input dims: " << VectorPrinter<std::size_t>{iw} << ")" << std::endl;
         return false;
     }
 
     const auto& ww = _weights.getDims();
-    auto offset = (ww[2] / iw[1]) - 1;
-
-    if(iw[0] != ww[0] + offset)
-    {
-        PT_LOG_ERROR << "Input tensor dims[0] must be the same as weights dims[0] + offset" <<
-                            " (input dims: " << VectorPrinter<std::size_t>{iw} << ")" <<
-                            " (weights dims: " << VectorPrinter<std::size_t>{ww} << ")" <<
-                            " (offset: " << offset << ")" << std::endl;
-        return false;
-    }
-
+    Tensor& out = layerData.out;
     out.resize(ww[0], ww[1]);
 
-    auto tensorSize = int(ww[2]);
+    multiplyAddImpl(_weights, _biases, layerData);
 
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
-    {
-        multiplyAddImpl<Vector2MultiplyAdd>(_weights, _biases, layerData);
-    }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
-    {
-        multiplyAddImpl<VectorMultiplyAdd>(_weights, _biases, layerData);
-    }
-    else
+    _activation->apply(out);
+    return true;
+}
+
+bool LocallyConnected1DLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! checkInput(inDims, _weights))
     {
-        multiplyAddImpl<ScalarMultiplyAdd>(_weights, _biases, layerData);
+        return false;
     }
 
-    _activation->apply(out);
+    const auto& ww = _weights.getDims();
+    outDims = { ww[0], ww[1] };
     return true;
 }
 
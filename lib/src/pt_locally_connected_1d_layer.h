@@ -22,6 +22,8 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
 protected:
     Tensor _weights;
     Tensor _biases;
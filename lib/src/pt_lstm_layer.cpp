@@ -7,136 +7,233 @@
 
 #include "pt_lstm_layer.h"
 
+#include <array>
+#include <algorithm>
 #include "pt_parser.h"
 #include "pt_layer_data.h"
+#include "pt_dispatcher.h"
+#include "pt_kernels.h"
+#include "pt_cpu_caches.h"
 #include "pt_logger.h"
 
 namespace pt
 {
 
+// Temporary tensors of a sequence, stored in the given scratch tensors:
 struct LstmLayer::TempData
 {
-    Tensor ht;
-    Tensor ct;
-    Tensor last;
-    Tensor inRow;
-    Tensor i;
-    Tensor f;
-    Tensor c;
-    Tensor o;
-    Tensor tmp1;
-    Tensor tmp2;
-
-    explicit TempData(std::size_t outDim)
+    static constexpr std::size_t TensorsCount = 7;
+
+    Tensor& projection;
+    Tensor& gates;
+    Tensor& cell;
+    Tensor& ct;
+    Tensor& ht;
+    Tensor& quantized; // Quantized inputs of the int8 weights (see QuantizedTensor::getBuffer).
+    Tensor& quantizedScales; // Scale of each quantized input timestep.
+
+    // Refers to tensors initialized before:
+    explicit TempData(Tensor* tensors) :
+        projection(tensors[0]),
+        gates(tensors[1]),
+        cell(tensors[2]),
+        ct(tensors[3]),
+        ht(tensors[4]),
+        quantized(tensors[5]),
+        quantizedScales(tensors[6])
     {
-        ht.resize(1, outDim);
-        ct.resize(1, outDim);
     }
 
-    void dot(const Tensor& w, const Tensor& b, const Tensor& u, Tensor& out)
+    // Initializes the tensors for a new sequence:
+    TempData(std::size_t units, Tensor* tensors) :
+        TempData(tensors)
     {
-        inRow.dot(w, tmp1);
-        tmp1.add(b, tmp2);
-        ht.dot(u, tmp1);
-        tmp2.add(tmp1, out);
+        gates.resize(3 * units);
+        cell.resize(units);
+        ct.resize(units);
+        ct.fill(0);
+        ht.resize(units);
+        ht.fill(0);
     }
 };
 
-std::unique_ptr<LstmLayer> LstmLayer::create(std::istream& stream)
+// Temporary tensors of a batch, stored in the given scratch tensors: the TempData tensors of each sample,
+// followed by the tensors of a timestep, with a row for each active sample:
+struct LstmLayer::BatchTempData
 {
-    auto wi = Tensor::create(2, stream);
-
-    if(! wi)
+    static constexpr std::size_t TensorsCount = 4; // Timestep tensors.
+
+    Tensor* sampleTensors;
+    Tensor& ht;
+    Tensor& gates;
+    Tensor& cell;
+    Tensor& zeros; // GEMM kernel biases.
+
+    BatchTempData(std::size_t samples, Tensor* tensors) :
+        sampleTensors(tensors),
+        ht(tensors[samples * TempData::TensorsCount]),
+        gates(tensors[samples * TempData::TensorsCount + 1]),
+        cell(tensors[samples * TempData::TensorsCount + 2]),
+        zeros(tensors[samples * TempData::TensorsCount + 3])
     {
-        PT_LOG_ERROR << "wi tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
     }
 
-    auto ui = Tensor::create(2, stream);
-
-    if(! ui)
+    // TempData tensors of the given sample:
+    Tensor* getSampleTensors(std::size_t sample) const noexcept
     {
-        PT_LOG_ERROR << "ui tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
+        return sampleTensors + (sample * TempData::TensorsCount);
     }
+};
 
-    auto bi = Tensor::create(2, stream);
-
-    if(! bi)
+namespace
+{
+    // ct = f * ct + i * c, with the activated input, forget and output gates stored in gates
+    // and the activated cell gate in cell. The new ct is stored in cell too, so it can be activated in place:
+    void updateCell(const Tensor::Type* gatesIt, Tensor::Type* cellIt, Tensor::Type* ctIt, std::size_t units) noexcept
     {
-        PT_LOG_ERROR << "bi tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
-    }
+        auto iIt = gatesIt;
+        auto fIt = gatesIt + units;
 
-    auto wf = Tensor::create(2, stream);
+        for(std::size_t index = 0; index != units; ++index)
+        {
+            Tensor::Type ct = fIt[index] * ctIt[index] + iIt[index] * cellIt[index];
+            ctIt[index] = ct;
+            cellIt[index] = ct;
+        }
+    }
 
-    if(! wf)
+    // ht = o * activation(ct), with the activated ct stored in cell:
+    void updateHidden(const Tensor::Type* gatesIt, const Tensor::Type* cellIt, Tensor::Type* htIt,
+                      std::size_t units) noexcept
     {
-        PT_LOG_ERROR << "wf tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
-    }
+        auto oIt = gatesIt + 2 * units;
 
-    auto uf = Tensor::create(2, stream);
+        for(std::size_t index = 0; index != units; ++index)
+        {
+            htIt[index] = oIt[index] * cellIt[index];
+        }
+    }
 
-    if(! uf)
+    // W, U and b tensors of the four gates, in file order (input, forget, cell and output):
+    template<class WeightsTensor>
+    struct Gates
     {
-        PT_LOG_ERROR << "uf tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
-    }
+        std::array<std::unique_ptr<WeightsTensor>, 4> w;
+        std::array<std::unique_ptr<WeightsTensor>, 4> u;
+        std::array<std::unique_ptr<Tensor>, 4> b;
+    };
+
+    // Parses the gates tensors (W and U are Tensor or QuantizedTensor) and validates their dims:
+    template<class WeightsTensor>
+    bool parseGates(std::istream& stream, Gates<WeightsTensor>& gates, std::size_t& units)
+    {
+        const char* names[] = { "i", "f", "c", "o" };
 
-    auto bf = Tensor::create(2, stream);
+        for(std::size_t gate = 0; gate != 4; ++gate)
+        {
+            gates.w[gate] = WeightsTensor::create(2, stream);
 
-    if(! bf)
-    {
-        PT_LOG_ERROR << "bf tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
-    }
+            if(! gates.w[gate])
+            {
+                PT_LOG_ERROR << "w" << names[gate] << " tensor parse failed" << std::endl;
+                return false;
+            }
 
-    auto wc = Tensor::create(2, stream);
+            gates.u[gate] = WeightsTensor::create(2, stream);
 
-    if(! wc)
-    {
-        PT_LOG_ERROR << "wc tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
-    }
+            if(! gates.u[gate])
+            {
+                PT_LOG_ERROR << "u" << names[gate] << " tensor parse failed" << std::endl;
+                return false;
+            }
 
-    auto uc = Tensor::create(2, stream);
+            gates.b[gate] = Tensor::create(2, stream);
 
-    if(! uc)
-    {
-        PT_LOG_ERROR << "uc tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
-    }
+            if(! gates.b[gate])
+            {
+                PT_LOG_ERROR << "b" << names[gate] << " tensor parse failed" << std::endl;
+                return false;
+            }
+        }
 
-    auto bc = Tensor::create(2, stream);
+        const auto& wDims = gates.w[0]->getDims();
+        const auto& uDims = gates.u[0]->getDims();
+        units = uDims[1];
 
-    if(! bc)
-    {
-        PT_LOG_ERROR << "bc tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
-    }
+        for(const auto& w : gates.w)
+        {
+            if(w->getDims()[0] != units || w->getDims() != wDims)
+            {
+                PT_LOG_ERROR << "Invalid W tensor dims" <<
+                                " (W dims: " << VectorPrinter<std::size_t>{ w->getDims() } << ")" <<
+                                " (units: " << units << ")" << std::endl;
+                return false;
+            }
+        }
 
-    auto wo = Tensor::create(2, stream);
+        for(const auto& u : gates.u)
+        {
+            if(u->getDims()[0] != units || u->getDims() != uDims)
+            {
+                PT_LOG_ERROR << "Invalid U tensor dims" <<
+                                " (U dims: " << VectorPrinter<std::size_t>{ u->getDims() } << ")" <<
+                                " (units: " << units << ")" << std::endl;
+                return false;
+            }
+        }
 
-    if(! wo)
+        for(const auto& b : gates.b)
+        {
+            if(b->getDims()[0] != 1 || b->getDims()[1] != units)
+            {
+                PT_LOG_ERROR << "Invalid b tensor dims" <<
+                                " (b dims: " << VectorPrinter<std::size_t>{ b->getDims() } << ")" <<
+                                " (units: " << units << ")" << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Stacks the rows of the given gates tensors in a new tensor:
+    Tensor packGates(const Tensor& i, const Tensor& f, const Tensor& o, const Tensor& c)
     {
-        PT_LOG_ERROR << "wo tensor parse failed" << std::endl;
-        return std::unique_ptr<LstmLayer>();
+        const auto& dims = i.getDims();
+        std::size_t size = i.getSize();
+        Tensor out(4 * dims[0], dims[1]);
+        auto outIt = out.begin();
+
+        for(const Tensor* gate : { &i, &f, &o, &c })
+        {
+            PT_ASSERT(gate->getDims() == dims);
+
+            outIt = std::copy(gate->begin(), gate->end(), outIt);
+        }
+
+        PT_ASSERT(outIt == out.begin() + long(4 * size));
+        return out;
     }
+}
 
-    auto uo = Tensor::create(2, stream);
+std::unique_ptr<LstmLayer> LstmLayer::create(std::istream& stream)
+{
+    bool quantized = false;
 
-    if(! uo)
+    if(! QuantizedTensor::parseType(stream, quantized))
     {
-        PT_LOG_ERROR << "uo tensor parse failed" << std::endl;
+        PT_LOG_ERROR << "Weights type parse failed" << std::endl;
         return std::unique_ptr<LstmLayer>();
     }
 
-    auto bo = Tensor::create(2, stream);
+    // W and U tensors are quantized or not depending on the weights type, biases are always float:
+    Gates<Tensor> floatGates;
+    Gates<QuantizedTensor> quantizedGates;
+    std::size_t units = 0;
 
-    if(! bo)
+    if(quantized ? ! parseGates(stream, quantizedGates, units) : ! parseGates(stream, floatGates, units))
     {
-        PT_LOG_ERROR << "bo tensor parse failed" << std::endl;
+        PT_LOG_ERROR << "Gates tensors parse failed" << std::endl;
         return std::unique_ptr<LstmLayer>();
     }
 
@@ -164,111 +261,590 @@ std::unique_ptr<LstmLayer> LstmLayer::create(std::istream& stream)
         return std::unique_ptr<LstmLayer>();
     }
 
-    return std::unique_ptr<LstmLayer>(new LstmLayer(std::move(*wi), std::move(*ui), std::move(*bi),
-                                                    std::move(*wf), std::move(*uf), std::move(*bf),
-                                                    std::move(*wc), std::move(*uc), std::move(*bc),
-                                                    std::move(*wo), std::move(*uo), std::move(*bo),
-                                                    std::move(innerActivation),
+    Tensor weights;
+    Tensor recurrentWeights;
+    QuantizedTensor quantizedWeights;
+    QuantizedTensor quantizedRecurrentWeights;
+    Tensor biases;
+
+    // Gates are stored in input, forget, cell and output order:
+    if(quantized)
+    {
+        const auto& w = quantizedGates.w;
+        const auto& u = quantizedGates.u;
+        const auto& b = quantizedGates.b;
+        quantizedWeights = QuantizedTensor::stack({ w[0].get(), w[1].get(), w[3].get(), w[2].get() });
+        quantizedRecurrentWeights = QuantizedTensor::stack({ u[0].get(), u[1].get(), u[3].get(), u[2].get() });
+        biases = packGates(*b[0], *b[1], *b[3], *b[2]);
+    }
+    else
+    {
+        const auto& w = floatGates.w;
+        const auto& u = floatGates.u;
+        const auto& b = floatGates.b;
+        weights = packGates(*w[0], *w[1], *w[3], *w[2]);
+        recurrentWeights = packGates(*u[0], *u[1], *u[3], *u[2]);
+        biases = packGates(*b[0], *b[1], *b[3], *b[2]);
+    }
+
+    return std::unique_ptr<LstmLayer>(new LstmLayer(std::move(weights), std::move(recurrentWeights),
+                                                    std::move(quantizedWeights), std::move(quantizedRecurrentWeights),
+                                                    std::move(biases), std::move(innerActivation),
                                                     std::move(activation), returnSequences));
 }
 
 bool LstmLayer::apply(LayerData& layerData) const
 {
     const Tensor& in = layerData.in;
-    const auto& iw = in.getDims();
 
-    if(iw.size() != 2)
+    if(! _checkInput(in.getDims()) || ! _checkIds(in))
+    {
+        return false;
+    }
+
+    auto units = _getUnits();
+    auto steps = in.getDims()[0];
+    const Tensor::Type* mask;
+
+    if(! _getMask(layerData.mask, steps, mask))
     {
-        PT_LOG_ERROR << "Input tensor dims count must be 2" <<
-                            " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
         return false;
     }
 
-    auto outDim = _bo.getDims()[1];
-    auto steps = iw[0];
+    TempData tempData(units, _getScratch(layerData.scratch, TempData::TensorsCount));
+    _project(in, mask, layerData.dispatcher, tempData);
 
-    TempData tempData(outDim);
+    // Masked timesteps are skipped, so they keep the state unchanged and output the last ht, like in Keras:
     Tensor& out = layerData.out;
 
     if(_returnSequences)
     {
-        out.resize(steps, outDim);
+        out.resize(steps, units);
 
         auto outIt = out.begin();
 
         for(std::size_t s = 0; s != steps; ++s)
         {
-            in.select(s, tempData.inRow);
-            _step(tempData, tempData.last);
-            std::copy(tempData.last.begin(), tempData.last.end(), outIt);
-            outIt += tempData.last.end() - tempData.last.begin();
+            if(! _isMasked(mask, s))
+            {
+                _step(in, s, layerData.dispatcher, tempData);
+            }
+
+            outIt = std::copy(tempData.ht.begin(), tempData.ht.end(), outIt);
         }
     }
     else
     {
         for(std::size_t s = 0; s != steps; ++s)
         {
-            in.select(s, tempData.inRow);
-            _step(tempData, out);
+            if(! _isMasked(mask, s))
+            {
+                _step(in, s, layerData.dispatcher, tempData);
+            }
         }
+
+        tempData.ht.copyTo(out);
+
+        // The mask of the input timesteps doesn't apply to the output:
+        layerData.mask.clear();
     }
 
     out.eraseDummyDims();
     return true;
 }
 
-LstmLayer::LstmLayer(Tensor&& wi, Tensor&& ui, Tensor&& bi, Tensor&& wf, Tensor&& uf, Tensor&& bf,
-                     Tensor&& wc, Tensor&& uc, Tensor&& bc, Tensor&& wo, Tensor&& uo, Tensor&& bo,
+bool LstmLayer::applyBatch(BatchLayerData& batchLayerData) const
+{
+    const std::vector<Tensor>& in = batchLayerData.in;
+    std::vector<Tensor>& out = batchLayerData.out;
+    std::vector<Tensor>& masks = batchLayerData.masks;
+    std::size_t samples = in.size();
+    std::size_t maxSteps = 0;
+
+    for(std::size_t sample = 0; sample != samples; ++sample)
+    {
+        const auto& sampleDims = in[sample].getDims();
+
+        if(! _checkInput(sampleDims) || ! _checkIds(in[sample]))
+        {
+            return false;
+        }
+
+        const Tensor::Type* sampleMask;
+
+        if(sample < masks.size() && ! _getMask(masks[sample], sampleDims[0], sampleMask))
+        {
+            return false;
+        }
+
+        maxSteps = std::max(maxSteps, sampleDims[0]);
+    }
+
+    auto units = _getUnits();
+    BatchTempData batchTempData(samples, _getScratch(batchLayerData.scratch,
+                                                     samples * TempData::TensorsCount + BatchTempData::TensorsCount));
+    out.resize(samples);
+
+    for(std::size_t sample = 0; sample != samples; ++sample)
+    {
+        TempData tempData(units, batchTempData.getSampleTensors(sample));
+        _project(in[sample], _getSampleMask(batchLayerData, sample), batchLayerData.dispatcher, tempData);
+
+        if(_returnSequences)
+        {
+            out[sample].resize(in[sample].getDims()[0], units);
+        }
+    }
+
+    // All sequences advance in lockstep. With float weights, the recurrent products of all active samples
+    // are computed at once by the GEMM kernel, so each timestep reads the recurrent weights only once.
+    // Otherwise (or if only one sample is active), the samples are advanced one by one
+    // while the recurrent weights are still in cache:
+    for(std::size_t s = 0; s != maxSteps; ++s)
+    {
+        std::size_t activeSamples = 0;
+
+        for(std::size_t sample = 0; sample != samples; ++sample)
+        {
+            if(_isActive(batchLayerData, sample, s))
+            {
+                ++activeSamples;
+            }
+        }
+
+        if(_recurrentWeights.isValid() && activeSamples > 1)
+        {
+            _stepBatch(batchLayerData, s, activeSamples, batchTempData);
+        }
+        else
+        {
+            for(std::size_t sample = 0; sample != samples; ++sample)
+            {
+                if(_isActive(batchLayerData, sample, s))
+                {
+                    TempData tempData(batchTempData.getSampleTensors(sample));
+                    _step(in[sample], s, batchLayerData.dispatcher, tempData);
+                }
+            }
+        }
+
+        if(_returnSequences)
+        {
+            for(std::size_t sample = 0; sample != samples; ++sample)
+            {
+                if(s < in[sample].getDims()[0])
+                {
+                    const Tensor& ht = TempData(batchTempData.getSampleTensors(sample)).ht;
+                    std::copy(ht.begin(), ht.end(), out[sample].begin() + long(s * units));
+                }
+            }
+        }
+    }
+
+    for(std::size_t sample = 0; sample != samples; ++sample)
+    {
+        if(! _returnSequences)
+        {
+            TempData(batchTempData.getSampleTensors(sample)).ht.copyTo(out[sample]);
+        }
+
+        out[sample].eraseDummyDims();
+    }
+
+    if(! _returnSequences)
+    {
+        masks.clear();
+    }
+
+    return true;
+}
+
+bool LstmLayer::applyStep(LayerData& layerData, Tensor& state) const
+{
+    const Tensor& in = layerData.in;
+
+    // Embedding ids inputs (see fuseEmbedding) have one id for each timestep:
+    auto inputSize = _inputTable.isValid() ? 1 : _getInputSize();
+
+    if(! _checkStepInput(in.getDims(), inputSize) || ! _checkIds(in))
+    {
+        return false;
+    }
+
+    if(state.getSize() != getStateSize())
+    {
+        PT_LOG_ERROR << "Invalid state size: " << state.getSize() << " (expected: " << getStateSize() << ")" <<
+                        std::endl;
+        return false;
+    }
+
+    const Tensor::Type* mask;
+
+    if(! _getMask(layerData.mask, 1, mask))
+    {
+        return false;
+    }
+
+    auto units = _getUnits();
+    auto stateMiddle = state.begin() + long(units);
+
+    if(! _returnSequences)
+    {
+        layerData.mask.clear();
+    }
+
+    // A masked timestep keeps the state unchanged and outputs the last ht:
+    if(_isMasked(mask, 0))
+    {
+        Tensor& out = layerData.out;
+        out.resize(units);
+        std::copy(state.begin(), stateMiddle, out.begin());
+        return true;
+    }
+
+    TempData tempData(units, _getScratch(layerData.scratch, TempData::TensorsCount));
+    std::copy(state.begin(), stateMiddle, tempData.ht.begin());
+    std::copy(stateMiddle, state.end(), tempData.ct.begin());
+
+    _project(in, nullptr, layerData.dispatcher, tempData);
+    _step(in, 0, layerData.dispatcher, tempData);
+
+    std::copy(tempData.ht.begin(), tempData.ht.end(), state.begin());
+    std::copy(tempData.ct.begin(), tempData.ct.end(), stateMiddle);
+    tempData.ht.copyTo(layerData.out);
+    return true;
+}
+
+bool LstmLayer::fuseEmbedding(const Tensor& embeddings, std::size_t maxTableSize)
+{
+    const auto& ew = embeddings.getDims();
+    auto vocabularySize = ew[0];
+    auto inputSize = _getInputSize();
+    auto gatesSize = _biases.getSize();
+
+    if(_inputTable.isValid() || ew[1] != inputSize || vocabularySize * gatesSize * sizeof(Tensor::Type) > maxTableSize)
+    {
+        return false;
+    }
+
+    // W^T (dequantized if needed) is the b matrix of the GEMM kernel:
+    Tensor transposedWeights(inputSize, gatesSize);
+    auto transposedIt = transposedWeights.begin();
+
+    for(std::size_t row = 0; row != gatesSize; ++row)
+    {
+        for(std::size_t column = 0; column != inputSize; ++column)
+        {
+            Tensor::Type weight;
+
+            if(_quantizedWeights.isValid())
+            {
+                weight = _quantizedWeights.getScales().begin()[row] *
+                        _quantizedWeights.getData()[row * inputSize + column];
+            }
+            else
+            {
+                weight = _weights.begin()[row * inputSize + column];
+            }
+
+            transposedIt[column * gatesSize + row] = weight;
+        }
+    }
+
+    // Embeddings are multiplied in blocks of rows which fit in the L1 data cache,
+    // so they are reused for all columns blocks:
+    Tensor table(vocabularySize, gatesSize);
+    auto gemm = Kernels::get().gemm;
+    auto blockRows = std::max(CpuCaches::get().l1DataSize / 2 / (inputSize * sizeof(Tensor::Type)),
+                              std::size_t(1));
+
+    for(std::size_t row = 0; row < vocabularySize; row += blockRows)
+    {
+        auto rows = std::min(blockRows, vocabularySize - row);
+        gemm(embeddings.begin() + long(row * inputSize), int(rows), int(inputSize), transposedWeights.begin(),
+             int(gatesSize), _biases.begin(), table.begin() + long(row * gatesSize), int(gatesSize), int(gatesSize));
+    }
+
+    _inputTable = std::move(table);
+    return true;
+}
+
+bool LstmLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! _checkInput(inDims))
+    {
+        return false;
+    }
+
+    auto units = _getUnits();
+
+    if(_returnSequences && inDims[0] > 1)
+    {
+        outDims = { inDims[0], units };
+    }
+    else
+    {
+        outDims.assign(1, units);
+    }
+
+    return true;
+}
+
+LstmLayer::LstmLayer(Tensor&& weights, Tensor&& recurrentWeights, QuantizedTensor&& quantizedWeights,
+                     QuantizedTensor&& quantizedRecurrentWeights, Tensor&& biases,
                      std::unique_ptr<ActivationLayer>&& innerActivation,
-                     std::unique_ptr<ActivationLayer>&& activation, bool returnSequences) noexcept :
-    _wi(std::move(wi)),
-    _ui(std::move(ui)),
-    _bi(std::move(bi)),
-    _wf(std::move(wf)),
-    _uf(std::move(uf)),
-    _bf(std::move(bf)),
-    _wc(std::move(wc)),
-    _uc(std::move(uc)),
-    _bc(std::move(bc)),
-    _wo(std::move(wo)),
-    _uo(std::move(uo)),
-    _bo(std::move(bo)),
+                     std::unique_ptr<ActivationLayer>&& activation, bool returnSequences) :
+    _weights(std::move(weights)),
+    _recurrentWeights(std::move(recurrentWeights)),
+    _quantizedWeights(std::move(quantizedWeights)),
+    _quantizedRecurrentWeights(std::move(quantizedRecurrentWeights)),
+    _biases(std::move(biases)),
     _innerActivation(std::move(innerActivation)),
     _activation(std::move(activation)),
     _returnSequences(returnSequences)
 {
 }
 
-void LstmLayer::_step(TempData& tempData, Tensor& out) const
+bool LstmLayer::_checkInput(const DimsVector& inDims) const
+{
+    if(_inputTable.isValid())
+    {
+        if(inDims.size() != 1)
+        {
+            PT_LOG_ERROR << "Input tensor dims count must be 1 (embedding ids)" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    if(inDims.size() != 2)
+    {
+        PT_LOG_ERROR << "Input tensor dims count must be 2" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
+    }
+
+    const auto& ww = _quantizedWeights.isValid() ? _quantizedWeights.getDims() : _weights.getDims();
+
+    if(inDims[1] != ww[1])
+    {
+        PT_LOG_ERROR << "Input tensor dims[1] must be the same as W dims[1]" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" <<
+                            " (W dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void LstmLayer::_project(const Tensor& in, const Tensor::Type* mask, Dispatcher& dispatcher,
+                         TempData& tempData) const
+{
+    // The input projection is already stored in the input table if the input is embedding ids
+    // (see fuseEmbedding):
+    if(_inputTable.isValid())
+    {
+        return;
+    }
+
+    if(_quantizedWeights.isValid())
+    {
+        RecurrentLayer::_project(in, mask, _quantizedWeights, _biases, tempData.projection, tempData.quantized,
+                                 tempData.quantizedScales, dispatcher);
+    }
+    else
+    {
+        RecurrentLayer::_project(in, mask, _weights, _biases, tempData.projection, dispatcher);
+    }
+}
+
+bool LstmLayer::_checkIds(const Tensor& in) const
+{
+    if(! _inputTable.isValid())
+    {
+        return true;
+    }
+
+    auto rows = _inputTable.getDims()[0];
+
+    for(Tensor::Type id : in)
+    {
+        // Negated comparisons reject NaN too:
+        if(! (id >= 0 && id < Tensor::Type(rows)))
+        {
+            PT_LOG_ERROR << "Invalid embedding id: " << id << " (vocabulary size: " << rows << ")" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const Tensor::Type* LstmLayer::_getSampleMask(const BatchLayerData& batchLayerData, std::size_t sample) noexcept
 {
-    tempData.dot(_wi, _bi, _ui, tempData.i);
-    _innerActivation->apply(tempData.i);
+    const auto& masks = batchLayerData.masks;
 
-    tempData.dot(_wf, _bf, _uf, tempData.f);
-    _innerActivation->apply(tempData.f);
+    if(sample < masks.size() && masks[sample].isValid())
+    {
+        return masks[sample].begin();
+    }
 
-    tempData.dot(_wc, _bc, _uc, tempData.c);
-    _activation->apply(tempData.c);
+    return nullptr;
+}
 
-    tempData.dot(_wo, _bo, _uo, tempData.o);
-    _innerActivation->apply(tempData.o);
+bool LstmLayer::_isActive(const BatchLayerData& batchLayerData, std::size_t sample, std::size_t step) noexcept
+{
+    return step < batchLayerData.in[sample].getDims()[0] && ! _isMasked(_getSampleMask(batchLayerData, sample), step);
+}
 
-    // join
+const Tensor::Type* LstmLayer::_getProjection(const Tensor& in, std::size_t step,
+                                              const TempData& tempData) const noexcept
+{
+    auto gatesSize = _biases.getSize();
 
-    tempData.f.multiply(tempData.ct, tempData.tmp1);
+    if(_inputTable.isValid())
+    {
+        // The input is an embedding id, so its projection is a row of the table:
+        auto id = std::size_t(in.begin()[step]);
+        PT_ASSERT(id < _inputTable.getDims()[0]);
 
-    tempData.i.multiply(tempData.c, tempData.tmp2);
+        return _inputTable.begin() + long(id * gatesSize);
+    }
 
-    // join
-    // seq
+    return tempData.projection.begin() + long(step * gatesSize);
+}
 
-    tempData.tmp1.add(tempData.tmp2, tempData.ct);
+void LstmLayer::_step(const Tensor& in, std::size_t step, Dispatcher& dispatcher, TempData& tempData) const
+{
+    auto units = _getUnits();
+    auto gatesSize = 4 * units;
+    const Tensor::Type* projectionIt = _getProjection(in, step, tempData);
+
+    // Input, forget and output gates are stored in gates, and the cell gate in cell:
+    Tensor& gates = tempData.gates;
+    Tensor& cell = tempData.cell;
+    std::copy(projectionIt, projectionIt + long(3 * units), gates.begin());
+    std::copy(projectionIt + long(3 * units), projectionIt + long(gatesSize), cell.begin());
+
+    Tensor& ht = tempData.ht;
+
+    if(_quantizedRecurrentWeights.isValid())
+    {
+        _recurrentMultiplyAdd(ht.begin(), _quantizedRecurrentWeights, 0, 3 * units, gates.begin(),
+                              tempData.quantized, dispatcher);
+        _recurrentMultiplyAdd(ht.begin(), _quantizedRecurrentWeights, 3 * units, gatesSize, cell.begin(),
+                              tempData.quantized, dispatcher);
+    }
+    else
+    {
+        _recurrentMultiplyAdd(ht.begin(), _recurrentWeights, 0, 3 * units, gates.begin(), dispatcher);
+        _recurrentMultiplyAdd(ht.begin(), _recurrentWeights, 3 * units, gatesSize, cell.begin(), dispatcher);
+    }
 
-    tempData.ct.copyTo(tempData.c);
-    _activation->apply(tempData.c);
+    _innerActivation->apply(gates);
+    _activation->apply(cell);
 
-    tempData.o.multiply(tempData.c, tempData.ht);
-    tempData.ht.copyTo(out);
+    // ct = f * ct + i * c, ht = o * activation(ct), updated in place:
+    updateCell(gates.begin(), cell.begin(), tempData.ct.begin(), units);
+    _activation->apply(cell);
+    updateHidden(gates.begin(), cell.begin(), ht.begin(), units);
+}
+
+void LstmLayer::_stepBatch(const BatchLayerData& batchLayerData, std::size_t step, std::size_t rows,
+                           BatchTempData& batchTempData) const
+{
+    auto units = _getUnits();
+    auto gatesSize = 3 * units;
+
+    std::call_once(_recurrentTransposedFlag, [this, units]
+    {
+        _recurrentGatesWeights = _transposeRows(_recurrentWeights, 0, 3 * units);
+        _recurrentCellWeights = _transposeRows(_recurrentWeights, 3 * units, 4 * units);
+    });
+
+    Tensor& batchHt = batchTempData.ht;
+    Tensor& batchGates = batchTempData.gates;
+    Tensor& batchCell = batchTempData.cell;
+    Tensor& zeros = batchTempData.zeros;
+    batchHt.resize(rows, units);
+    batchGates.resize(rows, gatesSize);
+    batchCell.resize(rows, units);
+
+    if(zeros.getSize() != gatesSize)
+    {
+        zeros.resize(gatesSize);
+        zeros.fill(0);
+    }
+
+    // Rows are the active samples in order:
+    for(std::size_t sample = 0, row = 0; row != rows; ++sample)
+    {
+        if(_isActive(batchLayerData, sample, step))
+        {
+            const Tensor& ht = TempData(batchTempData.getSampleTensors(sample)).ht;
+            std::copy(ht.begin(), ht.end(), batchHt.begin() + long(row * units));
+            ++row;
+        }
+    }
+
+    // [rows, units] x [units, 4 * units] GEMM, split by rows between threads:
+    auto htBegin = batchHt.begin();
+    auto gatesBegin = batchGates.begin();
+    auto cellBegin = batchCell.begin();
+
+    batchLayerData.dispatcher.run(int(rows), int(4 * units * units), [&](int taskBegin, int taskEnd)
+    {
+        auto gemm = Kernels::get().gemm;
+        auto taskHt = htBegin + taskBegin * int(units);
+        auto taskRows = taskEnd - taskBegin;
+
+        gemm(taskHt, taskRows, int(units), _recurrentGatesWeights.begin(), int(gatesSize), zeros.begin(),
+             gatesBegin + taskBegin * int(gatesSize), int(gatesSize), int(gatesSize));
+        gemm(taskHt, taskRows, int(units), _recurrentCellWeights.begin(), int(units), zeros.begin(),
+             cellBegin + taskBegin * int(units), int(units), int(units));
+    });
+
+    auto add = Kernels::get().add;
+
+    for(std::size_t sample = 0, row = 0; row != rows; ++sample)
+    {
+        if(_isActive(batchLayerData, sample, step))
+        {
+            TempData tempData(batchTempData.getSampleTensors(sample));
+            const Tensor::Type* projectionIt = _getProjection(batchLayerData.in[sample], step, tempData);
+            add(projectionIt, gatesBegin + row * gatesSize, int(gatesSize));
+            add(projectionIt + gatesSize, cellBegin + row * units, int(units));
+            ++row;
+        }
+    }
+
+    _innerActivation->apply(batchGates);
+    _activation->apply(batchCell);
+
+    // ct = f * ct + i * c, ht = o * activation(ct), updated in place:
+    for(std::size_t sample = 0, row = 0; row != rows; ++sample)
+    {
+        if(_isActive(batchLayerData, sample, step))
+        {
+            updateCell(gatesBegin + row * gatesSize, cellBegin + row * units,
+                       TempData(batchTempData.getSampleTensors(sample)).ct.begin(), units);
+            ++row;
+        }
+    }
+
+    _activation->apply(batchCell);
+
+    for(std::size_t sample = 0, row = 0; row != rows; ++sample)
+    {
+        if(_isActive(batchLayerData, sample, step))
+        {
+            updateHidden(gatesBegin + row * gatesSize, cellBegin + row * units,
+                         TempData(batchTempData.getSampleTensors(sample)).ht.begin(), units);
+            ++row;
+        }
+    }
 }
 
 }
@@ -8,13 +8,18 @@
 #ifndef PT_LSTM_LAYER_H
 #define PT_LSTM_LAYER_H
 
+#include <mutex>
 #include "pt_tensor.h"
+#include "pt_quantized_tensor.h"
 #include "pt_activation_layer.h"
+#include "pt_recurrent_layer.h"
 
 namespace pt
 {
 
-class LstmLayer : public Layer
+class Dispatcher;
+
+class LstmLayer : public RecurrentLayer
 {
 
 public:
@@ -22,31 +27,88 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool applyBatch(BatchLayerData& batchLayerData) const final;
+
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    // State is stored as [ht, ct]:
+    std::size_t getStateSize() const noexcept final
+    {
+        return 2 * _getUnits();
+    }
+
+    bool applyStep(LayerData& layerData, Tensor& state) const final;
+
+    // Precomputes the input projection (x * W^T + b) of each row of the given embeddings table, so the input of
+    // this layer becomes a sequence of embedding ids (called when an Embedding layer precedes this one).
+    // Returns false without modifying the layer if the projections table would take more than maxTableSize bytes:
+    bool fuseEmbedding(const Tensor& embeddings, std::size_t maxTableSize);
+
 protected:
     struct TempData;
+    struct BatchTempData;
+
+    // Gates weights are packed in input, forget, output and cell order,
+    // so the gates which use the inner activation are contiguous.
+    // Only the float or the quantized weights are valid, depending on the weights type stored in the model file:
+    Tensor _weights;
+    Tensor _recurrentWeights;
+    QuantizedTensor _quantizedWeights;
+    QuantizedTensor _quantizedRecurrentWeights;
+    Tensor _biases;
 
-    Tensor _wi;
-    Tensor _ui;
-    Tensor _bi;
-    Tensor _wf;
-    Tensor _uf;
-    Tensor _bf;
-    Tensor _wc;
-    Tensor _uc;
-    Tensor _bc;
-    Tensor _wo;
-    Tensor _uo;
-    Tensor _bo;
+    // U^T of the input, forget and output gates ([units, 3 * units]) and of the cell gate ([units, units]),
+    // used by applyBatch to compute the recurrent products of all samples with the GEMM kernel
+    // (only with float weights). They are built the first time they are needed, so layers which never
+    // advance many samples at once don't store U twice:
+    mutable std::once_flag _recurrentTransposedFlag;
+    mutable Tensor _recurrentGatesWeights;
+    mutable Tensor _recurrentCellWeights;
+
+    Tensor _inputTable; // Input projections of each embedding id (see fuseEmbedding).
     std::unique_ptr<ActivationLayer> _innerActivation;
     std::unique_ptr<ActivationLayer> _activation;
     bool _returnSequences;
 
-    LstmLayer(Tensor&& wi, Tensor&& ui, Tensor&& bi, Tensor&& wf, Tensor&& uf, Tensor&& bf,
-          Tensor&& wc, Tensor&& uc, Tensor&& bc, Tensor&& wo, Tensor&& uo, Tensor&& bo,
-	      std::unique_ptr<ActivationLayer>&& innerActivation,
-	      std::unique_ptr<ActivationLayer>&& activation, bool returnSequences) noexcept;
+    LstmLayer(Tensor&& weights, Tensor&& recurrentWeights, QuantizedTensor&& quantizedWeights,
+              QuantizedTensor&& quantizedRecurrentWeights, Tensor&& biases,
+              std::unique_ptr<ActivationLayer>&& innerActivation,
+              std::unique_ptr<ActivationLayer>&& activation, bool returnSequences);
+
+    // Biases are packed as [4, units]:
+    std::size_t _getUnits() const noexcept
+    {
+        return _biases.getDims()[1];
+    }
+
+    std::size_t _getInputSize() const noexcept
+    {
+        return _quantizedWeights.isValid() ? _quantizedWeights.getDims()[1] : _weights.getDims()[1];
+    }
+
+    bool _checkInput(const DimsVector& inDims) const;
+
+    // Embedding ids inputs (see fuseEmbedding) must be rows of the projections table:
+    bool _checkIds(const Tensor& in) const;
+
+    // Projects the input with the float or the int8 weights (see RecurrentLayer::_project). mask can be null:
+    void _project(const Tensor& in, const Tensor::Type* mask, Dispatcher& dispatcher, TempData& tempData) const;
+
+    // Returns the input projection of the given timestep:
+    const Tensor::Type* _getProjection(const Tensor& in, std::size_t step, const TempData& tempData) const noexcept;
+
+    void _step(const Tensor& in, std::size_t step, Dispatcher& dispatcher, TempData& tempData) const;
+
+    // Returns the timesteps mask values of the given batch sample (nullptr if it is not masked).
+    // Batch masks must have been validated with _getMask:
+    static const Tensor::Type* _getSampleMask(const BatchLayerData& batchLayerData, std::size_t sample) noexcept;
+
+    // Returns true if the sequence of the given batch sample is not finished and its timestep is not masked:
+    static bool _isActive(const BatchLayerData& batchLayerData, std::size_t sample, std::size_t step) noexcept;
 
-    void _step(TempData& tempData, Tensor& out) const;
+    // Advances the rows active samples (see _isActive) one timestep at once:
+    void _stepBatch(const BatchLayerData& batchLayerData, std::size_t step, std::size_t rows,
+                    BatchTempData& batchTempData) const;
 };
 
 }
@@ -0,0 +1,114 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_mapped_file.h"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#include "pt_logger.h"
+
+namespace pt
+{
+
+std::unique_ptr<MappedFile> MappedFile::create(const std::string& filePath)
+{
+    #ifdef _WIN32
+        HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if(file == INVALID_HANDLE_VALUE)
+        {
+            PT_LOG_ERROR << "File open failed: " << filePath << std::endl;
+            return std::unique_ptr<MappedFile>();
+        }
+
+        LARGE_INTEGER fileSize;
+
+        if(! GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0)
+        {
+            PT_LOG_ERROR << "Invalid file size: " << filePath << std::endl;
+            CloseHandle(file);
+            return std::unique_ptr<MappedFile>();
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+
+        if(! mapping)
+        {
+            PT_LOG_ERROR << "File mapping failed: " << filePath << std::endl;
+            return std::unique_ptr<MappedFile>();
+        }
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+
+        if(! data)
+        {
+            PT_LOG_ERROR << "File mapping failed: " << filePath << std::endl;
+            return std::unique_ptr<MappedFile>();
+        }
+
+        auto size = std::size_t(fileSize.QuadPart);
+    #else
+        int file = open(filePath.c_str(), O_RDONLY);
+
+        if(file < 0)
+        {
+            PT_LOG_ERROR << "File open failed: " << filePath << std::endl;
+            return std::unique_ptr<MappedFile>();
+        }
+
+        struct stat fileStat;
+
+        if(fstat(file, &fileStat) != 0 || fileStat.st_size <= 0)
+        {
+            PT_LOG_ERROR << "Invalid file size: " << filePath << std::endl;
+            close(file);
+            return std::unique_ptr<MappedFile>();
+        }
+
+        auto size = std::size_t(fileStat.st_size);
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+
+        if(data == MAP_FAILED)
+        {
+            PT_LOG_ERROR << "File mapping failed: " << filePath << std::endl;
+            return std::unique_ptr<MappedFile>();
+        }
+    #endif
+
+    return std::unique_ptr<MappedFile>(new MappedFile(static_cast<char*>(data), size));
+}
+
+MappedFile::~MappedFile() noexcept
+{
+    #ifdef _WIN32
+        UnmapViewOfFile(_data);
+    #else
+        munmap(_data, _size);
+    #endif
+}
+
+MappedFile::MappedFile(char* data, std::size_t size) noexcept :
+    _data(data),
+    _size(size)
+{
+}
+
+}
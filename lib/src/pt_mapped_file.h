@@ -0,0 +1,52 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_MAPPED_FILE_H
+#define PT_MAPPED_FILE_H
+
+#include <memory>
+#include <string>
+
+namespace pt
+{
+
+// Read-only file mapped in memory.
+//
+// Pages are mapped read only, so they are always shared with the page cache (and with other processes
+// mapping the same file). Tensors which point to them must be copied before being modified.
+class MappedFile
+{
+
+public:
+    static std::unique_ptr<MappedFile> create(const std::string& filePath);
+
+    ~MappedFile() noexcept;
+
+    MappedFile(const MappedFile& other) = delete;
+
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    char* getData() const noexcept
+    {
+        return _data;
+    }
+
+    std::size_t getSize() const noexcept
+    {
+        return _size;
+    }
+
+protected:
+    char* _data;
+    std::size_t _size;
+
+    MappedFile(char* data, std::size_t size) noexcept;
+};
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_masking_layer.h"
+
+#include <algorithm>
+#include "pt_parser.h"
+#include "pt_layer_data.h"
+#include "pt_logger.h"
+
+namespace pt
+{
+
+namespace
+{
+    bool checkInput(const Tensor::DimsVector& iw)
+    {
+        if(iw.size() < 2)
+        {
+            PT_LOG_ERROR << "Input tensor dims count must be at least 2" <<
+                                " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+}
+
+std::unique_ptr<MaskingLayer> MaskingLayer::create(std::istream& stream)
+{
+    float maskValue = 0;
+
+    if(! Parser::parse(stream, maskValue))
+    {
+        PT_LOG_ERROR << "Mask value parse failed" << std::endl;
+        return std::unique_ptr<MaskingLayer>();
+    }
+
+    return std::unique_ptr<MaskingLayer>(new MaskingLayer(FloatType(maskValue)));
+}
+
+bool MaskingLayer::apply(LayerData& layerData) const
+{
+    if(! checkInput(layerData.in.getDims()))
+    {
+        return false;
+    }
+
+    std::swap(layerData.in, layerData.out);
+
+    Tensor& out = layerData.out;
+    Tensor& mask = layerData.mask;
+    auto rows = out.getDims()[0];
+    auto rowSize = out.getSize() / rows;
+    auto maskValue = _maskValue;
+    auto rowIt = out.begin();
+    mask.resize(rows);
+
+    for(std::size_t row = 0; row != rows; ++row)
+    {
+        auto rowEnd = rowIt + rowSize;
+        bool masked = std::all_of(rowIt, rowEnd, [maskValue](Tensor::Type value)
+        {
+            return ! (value < maskValue || value > maskValue);
+        });
+
+        if(masked)
+        {
+            std::fill(rowIt, rowEnd, Tensor::Type(0));
+        }
+
+        mask(row) = masked ? 0 : 1;
+        rowIt = rowEnd;
+    }
+
+    return true;
+}
+
+bool MaskingLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! checkInput(inDims))
+    {
+        return false;
+    }
+
+    outDims = inDims;
+    return true;
+}
+
+bool MaskingLayer::isInPlace() const noexcept
+{
+    return true;
+}
+
+MaskingLayer::MaskingLayer(FloatType maskValue) noexcept :
+    _maskValue(maskValue)
+{
+}
+
+}
@@ -0,0 +1,39 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_MASKING_LAYER_H
+#define PT_MASKING_LAYER_H
+
+#include "pt_tensor.h"
+#include "pt_layer.h"
+
+namespace pt
+{
+
+// Masks the timesteps (input dims[0] rows) whose values are all equal to the mask value,
+// so the next recurrent layers skip them (see LayerData). Masked timesteps are set to 0, like in Keras:
+class MaskingLayer : public Layer
+{
+
+public:
+    static std::unique_ptr<MaskingLayer> create(std::istream& stream);
+
+    bool apply(LayerData& layerData) const final;
+
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    bool isInPlace() const noexcept final;
+
+protected:
+    FloatType _maskValue;
+
+    explicit MaskingLayer(FloatType maskValue) noexcept;
+};
+
+}
+
+#endif
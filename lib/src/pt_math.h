@@ -0,0 +1,244 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_MATH_H
+#define PT_MATH_H
+
+#include <cmath>
+#include <algorithm>
+#include "pt_libsimdpp.h"
+
+namespace pt
+{
+
+// Vectorized transcendental functions.
+//
+// Single precision implementations are polynomial/rational approximations (Cephes for exp and log,
+// Eigen for tanh). Maximum errors measured against double precision results (the first value is measured
+// without -ffast-math, the second one with it, because it reassociates the exp range reduction):
+//
+// * exp(x), expm1(x): 1-2 ulp / 68 ulp (about 0.7 ulp per unit of |x|) in [-86.9, 88.37].
+//   Bigger inputs are clamped and smaller ones return 0 (or -1).
+// * log(x): 1 ulp / 2 ulp in [FLT_MIN, FLT_MAX].
+// * tanh(x): 7 ulp (4.2e-7 absolute). Inputs with magnitude greater than 7.9 return +-1.
+// * sigmoid(x): 2 ulp / 69 ulp, 9e-8 / 2.2e-7 absolute.
+// * softPlus(x): 2 ulp for positive inputs, 9e-8 / 1.2e-7 absolute for negative ones.
+//
+// All of them are well below the absolute tolerance used by the tests (1e-6).
+// With double precision tensors, they call the standard library functions lane by lane.
+//
+// Like the other kernels helpers, they live in the arch namespace (see pt_kernels.h).
+inline namespace SIMDPP_ARCH_NAMESPACE
+{
+
+namespace Math
+{
+    PT_INLINE FloatVector splat(FloatType value) noexcept
+    {
+        FloatVector result = makeVector(value);
+        return result;
+    }
+
+    #if PT_DOUBLE_ENABLE
+        template<class ScalarFunction>
+        PT_INLINE FloatVector lanes(const FloatVector& x, const ScalarFunction& function) noexcept
+        {
+            alignas(sizeof(FloatVector)) FloatType values[FloatSize];
+            simdpp::store(values, x);
+
+            for(FloatType& value : values)
+            {
+                value = function(value);
+            }
+
+            return simdpp::load(values);
+        }
+
+        PT_INLINE FloatVector exp(const FloatVector& x) noexcept
+        {
+            return lanes(x, [](FloatType value){ return std::exp(value); });
+        }
+
+        PT_INLINE FloatVector expm1(const FloatVector& x) noexcept
+        {
+            return lanes(x, [](FloatType value){ return std::expm1(value); });
+        }
+
+        PT_INLINE FloatVector log(const FloatVector& x) noexcept
+        {
+            return lanes(x, [](FloatType value){ return std::log(value); });
+        }
+
+        PT_INLINE FloatVector tanh(const FloatVector& x) noexcept
+        {
+            return lanes(x, [](FloatType value){ return std::tanh(value); });
+        }
+    #else
+        using IntVector = simdpp::int32<FloatSize>;
+
+        PT_INLINE FloatVector multiplyAdd(const FloatVector& a, const FloatVector& b,
+                                             const FloatVector& c) noexcept
+        {
+            #if PT_FMADD_ENABLE
+                return simdpp::fmadd(a, b, c);
+            #else
+                return simdpp::add(simdpp::mul(a, b), c);
+            #endif
+        }
+
+        // Splits x in n * ln(2) + r, with |r| <= ln(2) / 2, and returns r.
+        // pow2 is set to 2^(n - 1) (computing 2^n would overflow for the biggest inputs):
+        PT_INLINE FloatVector reduceExp(const FloatVector& x, FloatVector& pow2) noexcept
+        {
+            FloatVector cx = simdpp::min(simdpp::max(x, splat(-87.0f)), splat(88.3762626647949f));
+            FloatVector n = simdpp::floor(multiplyAdd(cx, splat(1.44269504088896341f), splat(0.5f)));
+
+            // ln(2) is split in two constants to subtract n * ln(2) without losing precision:
+            FloatVector r = multiplyAdd(n, splat(-0.693359375f), cx);
+            r = multiplyAdd(n, splat(2.12194440e-4f), r);
+
+            IntVector exponent = simdpp::add(simdpp::to_int32(n), IntVector(simdpp::make_int(126)));
+            pow2 = simdpp::bit_cast<FloatVector>(simdpp::shift_l<23>(exponent));
+            return r;
+        }
+
+        // Returns exp(r) - 1 for |r| <= ln(2) / 2:
+        PT_INLINE FloatVector reducedExpm1(const FloatVector& r) noexcept
+        {
+            FloatVector p = splat(1.9875691500e-4f);
+            p = multiplyAdd(p, r, splat(1.3981999507e-3f));
+            p = multiplyAdd(p, r, splat(8.3334519073e-3f));
+            p = multiplyAdd(p, r, splat(4.1665795894e-2f));
+            p = multiplyAdd(p, r, splat(1.6666665459e-1f));
+            p = multiplyAdd(p, r, splat(5.0000001201e-1f));
+            return multiplyAdd(p, simdpp::mul(r, r), r);
+        }
+
+        PT_INLINE FloatVector exp(const FloatVector& x) noexcept
+        {
+            FloatVector pow2;
+            FloatVector r = reduceExp(x, pow2);
+            FloatVector y = simdpp::add(reducedExpm1(r), splat(1.0f));
+            return simdpp::mul(simdpp::add(y, y), pow2);
+        }
+
+        PT_INLINE FloatVector expm1(const FloatVector& x) noexcept
+        {
+            // exp(x) - 1 = 2^n * (exp(r) - 1) + (2^n - 1), which is exact for small inputs (n = 0):
+            FloatVector pow2;
+            FloatVector r = reduceExp(x, pow2);
+            pow2 = simdpp::add(pow2, pow2);
+            return simdpp::add(simdpp::mul(reducedExpm1(r), pow2), simdpp::sub(pow2, splat(1.0f)));
+        }
+
+        PT_INLINE FloatVector log(const FloatVector& x) noexcept
+        {
+            // Splits x in 2^e * m, with sqrt(0.5) <= m < sqrt(2):
+            FloatVector cx = simdpp::max(x, splat(1.17549435e-38f));
+            IntVector bits = simdpp::bit_cast<IntVector>(cx);
+            IntVector exponent = simdpp::sub(simdpp::shift_r<23>(bits), IntVector(simdpp::make_int(126)));
+            IntVector mantissaBits = simdpp::bit_or(simdpp::bit_and(bits, IntVector(simdpp::make_int(0x807FFFFF))),
+                                                    IntVector(simdpp::make_int(0x3F000000)));
+            FloatVector m = simdpp::bit_cast<FloatVector>(mantissaBits);
+            FloatVector e = simdpp::to_float32(exponent);
+
+            auto small = simdpp::cmp_lt(m, splat(0.707106781186547524f));
+            e = simdpp::sub(e, simdpp::blend(splat(1.0f), splat(0.0f), small));
+            m = simdpp::sub(simdpp::add(m, simdpp::blend(m, splat(0.0f), small)), splat(1.0f));
+
+            FloatVector z = simdpp::mul(m, m);
+            FloatVector p = splat(7.0376836292e-2f);
+            p = multiplyAdd(p, m, splat(-1.1514610310e-1f));
+            p = multiplyAdd(p, m, splat(1.1676998740e-1f));
+            p = multiplyAdd(p, m, splat(-1.2420140846e-1f));
+            p = multiplyAdd(p, m, splat(1.4249322787e-1f));
+            p = multiplyAdd(p, m, splat(-1.6668057665e-1f));
+            p = multiplyAdd(p, m, splat(2.0000714765e-1f));
+            p = multiplyAdd(p, m, splat(-2.4999993993e-1f));
+            p = multiplyAdd(p, m, splat(3.3333331174e-1f));
+            p = simdpp::mul(simdpp::mul(p, m), z);
+            p = multiplyAdd(e, splat(-2.12194440e-4f), p);
+            p = multiplyAdd(z, splat(-0.5f), p);
+            return multiplyAdd(e, splat(0.693359375f), simdpp::add(m, p));
+        }
+
+        PT_INLINE FloatVector tanh(const FloatVector& x) noexcept
+        {
+            // Rational approximation x * P(x^2) / Q(x^2):
+            FloatVector cx = simdpp::min(simdpp::max(x, splat(-7.90531110763549805f)),
+                                            splat(7.90531110763549805f));
+            FloatVector x2 = simdpp::mul(cx, cx);
+
+            FloatVector p = splat(-2.76076847742355e-16f);
+            p = multiplyAdd(p, x2, splat(2.00018790482477e-13f));
+            p = multiplyAdd(p, x2, splat(-8.60467152213735e-11f));
+            p = multiplyAdd(p, x2, splat(5.12229709037114e-08f));
+            p = multiplyAdd(p, x2, splat(1.48572235717979e-05f));
+            p = multiplyAdd(p, x2, splat(6.37261928875436e-04f));
+            p = multiplyAdd(p, x2, splat(4.89352455891786e-03f));
+            p = simdpp::mul(p, cx);
+
+            FloatVector q = splat(1.19825839466702e-06f);
+            q = multiplyAdd(q, x2, splat(1.18534705686654e-04f));
+            q = multiplyAdd(q, x2, splat(2.26843463243900e-03f));
+            q = multiplyAdd(q, x2, splat(4.89352518554385e-03f));
+            return simdpp::div(p, q);
+        }
+    #endif
+
+    PT_INLINE FloatVector sigmoid(const FloatVector& x) noexcept
+    {
+        FloatVector one = splat(FloatType(1));
+        return simdpp::div(one, simdpp::add(one, exp(simdpp::neg(x))));
+    }
+
+    PT_INLINE FloatVector softPlus(const FloatVector& x) noexcept
+    {
+        // log(1 + exp(x)) = max(x, 0) + log(1 + exp(-|x|)), which doesn't overflow:
+        FloatVector one = splat(FloatType(1));
+        FloatVector y = log(simdpp::add(one, exp(simdpp::neg(simdpp::abs(x)))));
+        return simdpp::add(simdpp::max(x, splat(FloatType(0))), y);
+    }
+
+    PT_INLINE FloatType sigmoid(FloatType x) noexcept
+    {
+        FloatType z = std::exp(-std::abs(x));
+        return x < 0 ? z / (1 + z) : 1 / (1 + z);
+    }
+
+    PT_INLINE FloatType softPlus(FloatType x) noexcept
+    {
+        return std::max(x, FloatType(0)) + std::log1p(std::exp(-std::abs(x)));
+    }
+
+    // Replaces each value of the given array with vectorFunction(value), except the values of the last
+    // incomplete vector, which are replaced with scalarFunction(value):
+    template<class VectorFunction, class ScalarFunction>
+    void transform(FloatType* data, int length, const VectorFunction& vectorFunction,
+                   const ScalarFunction& scalarFunction)
+    {
+        int index = 0;
+
+        for(int vectorsLength = length - int(FloatSize); index <= vectorsLength; index += FloatSize)
+        {
+            FloatVector value = simdpp::load_u(data + index);
+            FloatVector result = vectorFunction(value);
+            simdpp::store_u(data + index, result);
+        }
+
+        for(; index != length; ++index)
+        {
+            data[index] = scalarFunction(data[index]);
+        }
+    }
+}
+
+}
+
+}
+
+#endif
@@ -9,55 +9,64 @@
 
 #include <array>
 #include "pt_parser.h"
+#include "pt_model_stream.h"
 #include "pt_layer_data.h"
-#include "pt_max.h"
+#include "pt_dispatcher.h"
+#include "pt_kernels.h"
 
 namespace pt
 {
 
 namespace
 {
-    template<class MaxType>
-    void maxImpl(int poolSizeY, int poolSizeX, LayerData& layerData)
+    // Output pixel (y, x) is the maximum of the pool window whose top left input pixel is
+    // (y * strideY, x * strideX), so only the output pixels kept by the strides are computed:
+    void maxImpl(int poolSizeY, int poolSizeX, int strideY, int strideX, LayerData& layerData)
     {
         const Tensor& in = layerData.in;
         Tensor& out = layerData.out;
 
         const auto& iw = in.getDims();
         const auto& ow = out.getDims();
+        auto depth = int(iw[2]);
         auto inIncY2 = int(iw[2] * iw[1]);
-        auto inIncY = inIncY2 * poolSizeY;
-        auto inIncX2 = int(iw[2]);
-        auto inIncX = inIncX2 * poolSizeX;
+        auto inIncY = inIncY2 * strideY;
+        auto inIncX2 = depth;
+        auto inIncX = inIncX2 * strideX;
+        auto poolIncY = inIncY2 * poolSizeY;
+        auto poolIncX = inIncX2 * poolSizeX;
         auto outInc2 = int(iw[2] * ow[1]);
-        auto outInc = outInc2 * int(ow[0]);
 
-        auto inData = in.getData().data();
-        auto outData = const_cast<Tensor::Type*>(out.getData().data());
-        MaxType max;
+        auto inBegin = in.begin();
+        auto outBegin = out.begin();
 
-        int its = outInc / outInc2;
-        int taskEnd = its;
+        int its = int(ow[0]);
 
-        for(auto outIt = outData, outEnd = outData + (taskEnd * outInc2);
-            outIt != outEnd; outIt += outInc2)
+        layerData.dispatcher.run(its, outInc2 * poolSizeY * poolSizeX, [&](int taskBegin, int taskEnd)
         {
-            auto inIt = inData;
-            inData += inIncY;
+            auto inData = inBegin + (taskBegin * inIncY);
+            auto max = Kernels::get().max;
 
-            for(auto outIt2 = outIt, outEnd2 = outIt + outInc2; outIt2 != outEnd2; outIt2 += inIncX2)
+            for(auto outIt = outBegin + (taskBegin * outInc2), outEnd = outBegin + (taskEnd * outInc2);
+                outIt != outEnd; outIt += outInc2)
             {
-                for(auto inIt2 = inIt, inEnd2 = inIt + inIncY; inIt2 != inEnd2; inIt2 += inIncY2)
+                auto inIt = inData;
+                inData += inIncY;
+
+                for(auto outIt2 = outIt, outEnd2 = outIt + outInc2; outIt2 != outEnd2; outIt2 += inIncX2)
                 {
-                    for(auto inIt3 = inIt2, inEnd3 = inIt2 + inIncX; inIt3 != inEnd3; inIt3 += inIncX2)
+                    for(auto inIt2 = inIt, inEnd2 = inIt + poolIncY; inIt2 != inEnd2; inIt2 += inIncY2)
                     {
-                        max(&*inIt3, &*outIt2, inIncX2);
+                        for(auto inIt3 = inIt2, inEnd3 = inIt2 + poolIncX; inIt3 != inEnd3; inIt3 += inIncX2)
+                        {
+                            max(&*inIt3, &*outIt2, depth);
+                        }
                     }
-                }
 
-                inIt += inIncX;
+                    inIt += inIncX;
+                }
             }
-        }
+        });
     }
 }
 
@@ -79,7 +88,40 @@ std::unique_ptr<MaxPooling2DLayer> MaxPooling2DLayer::create(std::istream& strea
         return std::unique_ptr<MaxPooling2DLayer>();
     }
 
-    return std::unique_ptr<MaxPooling2DLayer>(new MaxPooling2DLayer(int(poolSizeY), int(poolSizeX)));
+    if(poolSizeY == 0 || poolSizeX == 0)
+    {
+        PT_LOG_ERROR << "Invalid pool size: " << poolSizeY << "x" << poolSizeX << std::endl;
+        return std::unique_ptr<MaxPooling2DLayer>();
+    }
+
+    // Strides are stored since v4 files (before, they were the same as the pool size):
+    unsigned int strideY = poolSizeY;
+    unsigned int strideX = poolSizeX;
+    auto modelStream = dynamic_cast<ModelStream*>(&stream);
+
+    if(modelStream && modelStream->getVersion() >= 4)
+    {
+        if(! Parser::parse(stream, strideY))
+        {
+            PT_LOG_ERROR << "Stride Y parse failed" << std::endl;
+            return std::unique_ptr<MaxPooling2DLayer>();
+        }
+
+        if(! Parser::parse(stream, strideX))
+        {
+            PT_LOG_ERROR << "Stride X parse failed" << std::endl;
+            return std::unique_ptr<MaxPooling2DLayer>();
+        }
+
+        if(strideY == 0 || strideX == 0)
+        {
+            PT_LOG_ERROR << "Invalid strides: " << strideY << "x" << strideX << std::endl;
+            return std::unique_ptr<MaxPooling2DLayer>();
+        }
+    }
+
+    return std::unique_ptr<MaxPooling2DLayer>(new MaxPooling2DLayer(int(poolSizeY), int(poolSizeX),
+                                                                    int(strideY), int(strideX)));
 }
 
 bool MaxPooling2DLayer::apply(LayerData& layerData) const
@@ -94,26 +136,52 @@ bool MaxPooling2DLayer::apply(LayerData& layerData) const
         return false;
     }
 
+    auto outY = _getOutputSize(iw[0], _poolSizeY, _strideY);
+    auto outX = _getOutputSize(iw[1], _poolSizeX, _strideX);
+
+    if(! outY || ! outX)
+    {
+        PT_LOG_ERROR << "Input tensor is smaller than the pool size" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ iw } << ")" << std::endl;
+        return false;
+    }
+
     Tensor& out = layerData.out;
-    out.resize(iw[0] / std::size_t(_poolSizeY), iw[1] / std::size_t(_poolSizeX), iw[2]);
+    out.resize(outY, outX, iw[2]);
     out.fill(-std::numeric_limits<Tensor::Type>::infinity());
 
-    auto tensorSize = int(iw[2]);
+    maxImpl(_poolSizeY, _poolSizeX, _strideY, _strideX, layerData);
 
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
-    {
-        maxImpl<VectorMax>(_poolSizeY, _poolSizeX, layerData);
-    }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
+    return true;
+}
+
+bool MaxPooling2DLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(inDims.size() != 3)
     {
-        maxImpl<VectorMax>(_poolSizeY, _poolSizeX, layerData);
+        PT_LOG_ERROR << "Input tensor dims count must be 3" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
     }
-    else
+
+    auto outY = _getOutputSize(inDims[0], _poolSizeY, _strideY);
+    auto outX = _getOutputSize(inDims[1], _poolSizeX, _strideX);
+
+    if(! outY || ! outX)
     {
-        maxImpl<ScalarMax>(_poolSizeY, _poolSizeX, layerData);
+        PT_LOG_ERROR << "Input tensor is smaller than the pool size" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
     }
 
+    outDims = { outY, outX, inDims[2] };
     return true;
 }
 
+std::size_t MaxPooling2DLayer::_getOutputSize(std::size_t inSize, int poolSize, int stride) noexcept
+{
+    auto size = std::size_t(poolSize);
+    return inSize >= size ? (inSize - size) / std::size_t(stride) + 1 : 0;
+}
+
 }
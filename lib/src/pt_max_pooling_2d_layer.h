@@ -21,15 +21,24 @@ public:
 
     bool apply(LayerData& layerData) const final;
 
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
 protected:
     int _poolSizeY;
     int _poolSizeX;
+    int _strideY;
+    int _strideX;
 
-    MaxPooling2DLayer(int poolSizeY, int poolSizeX) noexcept :
+    MaxPooling2DLayer(int poolSizeY, int poolSizeX, int strideY, int strideX) noexcept :
         _poolSizeY(poolSizeY),
-        _poolSizeX(poolSizeX)
+        _poolSizeX(poolSizeX),
+        _strideY(strideY),
+        _strideX(strideX)
     {
     }
+
+    // Returns the output size of one dimension (0 if the input is smaller than the pool size):
+    static std::size_t _getOutputSize(std::size_t inSize, int poolSize, int stride) noexcept;
 };
 
 }
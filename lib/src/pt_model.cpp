@@ -8,25 +8,80 @@
 #include "pt_model.h"
 
 #include <string>
-#include <fstream>
+#include <cstdint>
 #include "pt_parser.h"
-
+#include "pt_mapped_file.h"
+#include "pt_model_stream.h"
+#include "pt_dispatcher.h"
+#include "pt_execution_context.h"
 #include "pt_layer_data.h"
+#include "pt_kernels.h"
+#include "pt_cpu_caches.h"
+#include "pt_input_layer.h"
+#include "pt_linear_activation_layer.h"
 
 namespace pt
 {
 
+namespace
+{
+    // "PTM2" in little endian:
+    constexpr unsigned int ModelMagic = 0x324D5450;
+
+    // Latest file format version (v3 adds the padding mode of Conv2D layers,
+    // v4 adds strides and dilation rates of convolution and pooling layers,
+    // v5 adds the weights type of Dense, Conv1D, Conv2D and LSTM layers, which can be int8 quantized,
+    // v6 adds the mask_zero flag of Embedding layers):
+    constexpr unsigned int ModelVersion = 6;
+
+    bool isNoOp(const Layer& layer) noexcept
+    {
+        return dynamic_cast<const InputLayer*>(&layer) || dynamic_cast<const LinearActivationLayer*>(&layer);
+    }
+
+    // Removes no-op layers and merges layers into the previous ones when it is possible
+    // (like batch normalizations and activations into dense and convolution layers),
+    // to reduce the passes over the intermediate tensors:
+    void optimize(std::vector<std::unique_ptr<Layer>>& layers)
+    {
+        for(std::size_t index = 0; index != layers.size() && layers.size() > 1; )
+        {
+            if(isNoOp(*layers[index]))
+            {
+                layers.erase(layers.begin() + std::ptrdiff_t(index));
+            }
+            else
+            {
+                ++index;
+            }
+        }
+
+        for(std::size_t index = 0; index + 1 < layers.size(); )
+        {
+            if(layers[index]->merge(layers[index + 1]))
+            {
+                layers.erase(layers.begin() + std::ptrdiff_t(index + 1));
+            }
+            else
+            {
+                ++index;
+            }
+        }
+    }
+}
+
 std::unique_ptr<Model> Model::create(const std::string& filePath)
 {
-    std::ifstream stream(filePath, std::ios::binary);
+    auto mappedFile = MappedFile::create(filePath);
 
-    if(! stream.good())
+    if(! mappedFile)
     {
         PT_LOG_ERROR << "File open failed: " << filePath << std::endl;
         return std::unique_ptr<Model>();
     }
 
-    auto model = create(stream);
+    ModelStream stream(mappedFile->getData(), mappedFile->getSize());
+    auto model = _create(stream);
 
     if(! model)
     {
@@ -34,44 +89,100 @@ std::unique_ptr<Model> Model::create(const std::string& filePath)
         return std::unique_ptr<Model>();
     }
 
+    // Weight tensors can point to the mapped file, so it must live as long as the model:
+    model->_mappedFile = std::move(mappedFile);
     return model;
 }
 
 std::unique_ptr<Model> Model::create(std::istream& stream)
 {
-    unsigned int layersCount = 0;
+    auto modelStream = dynamic_cast<ModelStream*>(&stream);
 
-    if(! Parser::parse(stream, layersCount))
+    if(modelStream)
     {
-        PT_LOG_ERROR << "Layers count parse failed" << std::endl;
-        return std::unique_ptr<Model>();
+        return _create(*modelStream);
     }
 
-    if(! layersCount)
+    ModelStream wrapperStream(stream.rdbuf());
+    auto model = _create(wrapperStream);
+
+    if(! model)
     {
-        PT_LOG_ERROR << "Invalid layers count: " << layersCount << std::endl;
-        return std::unique_ptr<Model>();
+        stream.setstate(std::ios_base::failbit);
     }
 
-    std::vector<std::unique_ptr<Layer>> layers;
+    return model;
+}
 
-    for(unsigned int i = 0; i != layersCount; ++i)
+Model::~Model() noexcept
+{
+}
+
+bool Model::predict(Tensor in, Tensor& out) const
+{
+    Dispatcher dispatcher(1);
+    return predict(dispatcher, std::move(in), out);
+}
+
+bool Model::predict(Dispatcher& dispatcher, Tensor in, Tensor& out) const
+{
+    if(! in.isValid())
     {
-        auto layer = Layer::create(stream);
+        PT_LOG_ERROR << "Input tensor is not valid" << std::endl;
+        return false;
+    }
 
-        if(! layer)
+    Tensor temp;
+    Tensor mask;
+    std::vector<Tensor> scratch;
+    Tensor* layerIn = &in;
+    Tensor* layerOut = &temp;
+    std::size_t layersCount = _layers.size();
+
+    for(std::size_t i = 0; i != layersCount - 1; ++i)
+    {
+        LayerData layerData{ *layerIn, *layerOut, mask, scratch, dispatcher, _config };
+
+        if(! _layers[i]->apply(layerData))
         {
-            PT_LOG_ERROR << "Layer parse failed" << std::endl;
-            return std::unique_ptr<Model>();
+            PT_LOG_ERROR << "Layer apply failed" << std::endl;
+            return false;
         }
 
-        layers.push_back(std::move(layer));
+        std::swap(layerIn, layerOut);
     }
 
-    return std::unique_ptr<Model>(new Model(std::move(layers)));
+    LayerData layerData{ *layerIn, out, mask, scratch, dispatcher, _config };
+
+    if(! _layers[layersCount - 1]->apply(layerData))
+    {
+        PT_LOG_ERROR << "Layer apply failed" << std::endl;
+        return false;
+    }
+
+    return true;
 }
 
-bool Model::predict(Tensor in, Tensor& out) const
+bool Model::predict(ExecutionContext& context, const Tensor& in, Tensor& out) const
+{
+    if(! in.isValid())
+    {
+        PT_LOG_ERROR << "Input tensor is not valid" << std::endl;
+        return false;
+    }
+
+    const Tensor* result = _predict(context, in, nullptr);
+
+    if(! result)
+    {
+        return false;
+    }
+
+    result->copyTo(out);
+    return true;
+}
+
+bool Model::predict(ExecutionContext& context, const ConstTensorView& in, const TensorView& out) const
 {
     if(! in.isValid())
     {
@@ -79,21 +190,61 @@ bool Model::predict(Tensor in, Tensor& out) const
         return false;
     }
 
-    LayerData layerData{ std::move(in), out, _config };
+    const Tensor* result = _predict(context, in, &out);
+
+    if(! result)
+    {
+        return false;
+    }
+
+    if(result->begin() != out.begin())
+    {
+        std::copy(result->begin(), result->end(), out.begin());
+    }
+
+    return true;
+}
+
+bool Model::predictBatch(const std::vector<Tensor>& in, std::vector<Tensor>& out) const
+{
+    Dispatcher dispatcher(1);
+    return predictBatch(dispatcher, in, out);
+}
+
+bool Model::predictBatch(Dispatcher& dispatcher, const std::vector<Tensor>& in,
+                         std::vector<Tensor>& out) const
+{
+    if(in.empty())
+    {
+        PT_LOG_ERROR << "Input tensors vector is empty" << std::endl;
+        return false;
+    }
+
+    for(const Tensor& sample : in)
+    {
+        if(! sample.isValid())
+        {
+            PT_LOG_ERROR << "Input tensor is not valid" << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<Tensor> scratch;
+    BatchLayerData batchLayerData{ in, out, {}, scratch, dispatcher, _config };
     std::size_t layersCount = _layers.size();
 
     for(std::size_t i = 0; i != layersCount - 1; ++i)
     {
-        if(! _layers[i]->apply(layerData))
+        if(! _layers[i]->applyBatch(batchLayerData))
         {
             PT_LOG_ERROR << "Layer apply failed" << std::endl;
             return false;
         }
 
-        layerData.in = std::move(layerData.out);
+        batchLayerData.in.swap(batchLayerData.out);
     }
 
-    if(! _layers[layersCount - 1]->apply(layerData))
+    if(! _layers[layersCount - 1]->applyBatch(batchLayerData))
     {
         PT_LOG_ERROR << "Layer apply failed" << std::endl;
         return false;
@@ -107,4 +258,178 @@ Model::Model(std::vector<std::unique_ptr<Layer>>&& layers) noexcept :
 {
 }
 
+const Tensor* Model::_predict(ExecutionContext& context, const ConstTensorView& in, const TensorView* out) const
+{
+    if(&context.getModel() != this)
+    {
+        PT_LOG_ERROR << "Execution context belongs to another model" << std::endl;
+        return nullptr;
+    }
+
+    if(! in.hasDims(context.getInputDims()) && ! context.plan(in.getDims()))
+    {
+        PT_LOG_ERROR << "Execution context plan failed" << std::endl;
+        return nullptr;
+    }
+
+    if(out && ! out->hasDims(context.getOutputDims()))
+    {
+        PT_LOG_ERROR << "Output tensor dims must be the model output dims" <<
+                        " (output dims: " << VectorPrinter<std::size_t>{ out->getDims() } << ")" <<
+                        " (expected: " << VectorPrinter<std::size_t>{ context.getOutputDims() } << ")" << std::endl;
+        return nullptr;
+    }
+
+    // Layers read from one tensor and write to a free one (in place layers swap them).
+    // The caller memory is used directly if it is aligned and the layers don't write to the input.
+    // Otherwise, the input is copied to the arena buffers and the output is copied from them:
+    context._resetBuffers();
+    context._mask.clear();
+
+    Tensor* layerIn = &context._buffers[0];
+    Tensor* freeTensor = &context._buffers[1];
+    const Layer& firstLayer = *_layers.front();
+
+    if(in.isAligned() && ! firstLayer.isInPlace() &&
+            firstLayer.getInputBufferSize(context.getInputDims()) <= in.getSize())
+    {
+        layerIn = &context._inTensor;
+        context._wrap(*layerIn, const_cast<Tensor::Type*>(in.begin()), context.getInputDims());
+    }
+    else
+    {
+        context._wrap(*layerIn, nullptr, context.getInputDims());
+        std::copy(in.begin(), in.end(), layerIn->begin());
+    }
+
+    // The output is written by the last layer which doesn't work in place:
+    std::size_t layersCount = _layers.size();
+    std::size_t outLayerIndex = layersCount;
+
+    if(out && out->isAligned())
+    {
+        for(std::size_t index = layersCount; index-- > 0;)
+        {
+            if(! _layers[index]->isInPlace())
+            {
+                outLayerIndex = index;
+                context._wrap(context._outTensor, out->begin(), context.getOutputDims());
+                break;
+            }
+        }
+    }
+
+    for(std::size_t index = 0; index != layersCount; ++index)
+    {
+        Tensor* layerOut = index == outLayerIndex ? &context._outTensor : freeTensor;
+        LayerData layerData{ *layerIn, *layerOut, context._mask, context._scratch, context.getDispatcher(),
+                             _config };
+
+        if(! _layers[index]->apply(layerData))
+        {
+            PT_LOG_ERROR << "Layer apply failed" << std::endl;
+            return nullptr;
+        }
+
+        // The caller input must not be written, so it is replaced with the unused arena buffer:
+        freeTensor = layerIn == &context._inTensor ? &context._buffers[0] : layerIn;
+        layerIn = layerOut;
+    }
+
+    return layerIn;
+}
+
+std::unique_ptr<Model> Model::_create(ModelStream& stream)
+{
+    // Select the kernels variant and detect the caches sizes of this CPU now instead of on the first prediction:
+    Kernels::get();
+    CpuCaches::get();
+
+    auto startPosition = stream.tellg();
+    unsigned int layersCount = 0;
+
+    if(! Parser::parse(stream, layersCount))
+    {
+        PT_LOG_ERROR << "Layers count parse failed" << std::endl;
+        return std::unique_ptr<Model>();
+    }
+
+    // v1 files start with the layers count, v2 files start with a magic number followed by
+    // the version, the layers count, a reserved field and a table with the offset of each layer:
+    std::vector<std::uint64_t> layerOffsets;
+
+    if(layersCount == ModelMagic)
+    {
+        unsigned int version = 0;
+
+        if(! Parser::parse(stream, version))
+        {
+            PT_LOG_ERROR << "Version parse failed" << std::endl;
+            return std::unique_ptr<Model>();
+        }
+
+        if(version < 2 || version > ModelVersion)
+        {
+            PT_LOG_ERROR << "Unsupported version: " << version << std::endl;
+            return std::unique_ptr<Model>();
+        }
+
+        unsigned int reserved = 0;
+
+        if(! Parser::parse(stream, layersCount) || ! Parser::parse(stream, reserved))
+        {
+            PT_LOG_ERROR << "Header parse failed" << std::endl;
+            return std::unique_ptr<Model>();
+        }
+
+        if(layersCount)
+        {
+            layerOffsets.resize(layersCount);
+
+            if(! Parser::parse(stream, layerOffsets.data(), layersCount))
+            {
+                PT_LOG_ERROR << "Layers table parse failed" << std::endl;
+                return std::unique_ptr<Model>();
+            }
+        }
+
+        stream.setVersion(version);
+    }
+
+    if(! layersCount)
+    {
+        PT_LOG_ERROR << "Invalid layers count: " << layersCount << std::endl;
+        return std::unique_ptr<Model>();
+    }
+
+    std::vector<std::unique_ptr<Layer>> layers;
+    layers.reserve(layersCount);
+
+    for(unsigned int i = 0; i != layersCount; ++i)
+    {
+        // Layers are located with the layers table if the stream is seekable:
+        if(! layerOffsets.empty() && startPosition != std::streampos(-1))
+        {
+            if(! stream.seekg(startPosition + std::streamoff(layerOffsets[i])))
+            {
+                PT_LOG_ERROR << "Layer seek failed: " << layerOffsets[i] << std::endl;
+                return std::unique_ptr<Model>();
+            }
+        }
+
+        auto layer = Layer::create(stream);
+
+        if(! layer)
+        {
+            PT_LOG_ERROR << "Layer parse failed" << std::endl;
+            return std::unique_ptr<Model>();
+        }
+
+        layers.push_back(std::move(layer));
+    }
+
+    optimize(layers);
+    return std::unique_ptr<Model>(new Model(std::move(layers)));
+}
+
 }
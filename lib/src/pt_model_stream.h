@@ -0,0 +1,124 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_MODEL_STREAM_H
+#define PT_MODEL_STREAM_H
+
+#include <istream>
+#include <streambuf>
+
+namespace pt
+{
+
+// Input stream used to parse a model file, which knows the file format version
+// and optionally reads from memory (a mapped file) instead of from another stream buffer:
+class ModelStream : public std::istream
+{
+
+public:
+    explicit ModelStream(std::streambuf* buffer) :
+        std::istream(buffer)
+    {
+    }
+
+    ModelStream(char* data, std::size_t size) :
+        std::istream(nullptr),
+        _memoryBuffer(data, size),
+        _inMemory(true)
+    {
+        rdbuf(&_memoryBuffer);
+    }
+
+    unsigned int getVersion() const noexcept
+    {
+        return _version;
+    }
+
+    void setVersion(unsigned int version) noexcept
+    {
+        _version = version;
+    }
+
+    // If the stream reads from memory, skips the next size bytes and returns a pointer to them.
+    // Otherwise returns nullptr:
+    char* map(std::size_t size) noexcept
+    {
+        return _inMemory ? _memoryBuffer.map(size) : nullptr;
+    }
+
+protected:
+    class MemoryBuffer : public std::streambuf
+    {
+
+    public:
+        MemoryBuffer() = default;
+
+        MemoryBuffer(char* data, std::size_t size) noexcept
+        {
+            setg(data, data, data + size);
+        }
+
+        char* map(std::size_t size) noexcept
+        {
+            char* data = gptr();
+
+            if(! data || std::size_t(egptr() - data) < size)
+            {
+                return nullptr;
+            }
+
+            setg(eback(), data + size, egptr());
+            return data;
+        }
+
+    protected:
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                         std::ios_base::openmode mode) override
+        {
+            char* target = nullptr;
+
+            if(! (mode & std::ios_base::in))
+            {
+                return pos_type(off_type(-1));
+            }
+
+            if(direction == std::ios_base::beg)
+            {
+                target = eback() + offset;
+            }
+            else if(direction == std::ios_base::cur)
+            {
+                target = gptr() + offset;
+            }
+            else
+            {
+                target = egptr() + offset;
+            }
+
+            if(target < eback() || target > egptr())
+            {
+                return pos_type(off_type(-1));
+            }
+
+            setg(eback(), target, egptr());
+            return pos_type(off_type(target - eback()));
+        }
+
+        pos_type seekpos(pos_type position, std::ios_base::openmode mode) override
+        {
+            return seekoff(off_type(position), std::ios_base::beg, mode);
+        }
+    };
+
+    MemoryBuffer _memoryBuffer;
+    unsigned int _version = 1;
+    bool _inMemory = false;
+};
+
+}
+
+#endif
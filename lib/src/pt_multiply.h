@@ -8,14 +8,17 @@
 #ifndef PT_MULTIPLY_H
 #define PT_MULTIPLY_H
 
-#include "pt_tensor.h"
+#include "pt_libsimdpp.h"
 
 namespace pt
 {
 
+inline namespace SIMDPP_ARCH_NAMESPACE
+{
+
 struct ScalarMultiply
 {
-    PT_INLINE void operator()(const Tensor::Type* a, Tensor::Type* r, int length) noexcept
+    PT_INLINE void operator()(const FloatType* a, FloatType* r, int length) noexcept
     {
         for(int index = 0; index != length; ++index)
         {
@@ -27,37 +30,49 @@ struct ScalarMultiply
 
 struct VectorMultiply
 {
-    PT_INLINE void operator()(const Tensor::Type* a, Tensor::Type* r, int length) noexcept
+    PT_INLINE void operator()(const FloatType* a, FloatType* r, int length) noexcept
     {
-        for(int index = 0; index != length; index += Tensor::VectorSize)
+        int index = 0;
+
+        for(int vectorsLength = length - int(FloatSize); index <= vectorsLength;
+            index += FloatSize)
         {
-            Tensor::Vector av = simdpp::load(a + index);
-            Tensor::Vector rv = simdpp::load(r + index);
+            FloatVector av = simdpp::load_u(a + index);
+            FloatVector rv = simdpp::load_u(r + index);
             rv = simdpp::mul(av, rv);
-            simdpp::store(r + index, rv);
+            simdpp::store_u(r + index, rv);
         }
+
+        ScalarMultiply()(a + index, r + index, length - index);
     }
 };
 
 
 struct Vector2Multiply
 {
-    PT_INLINE void operator()(const Tensor::Type* a, Tensor::Type* r, int length) noexcept
+    PT_INLINE void operator()(const FloatType* a, FloatType* r, int length) noexcept
     {
-        for(int index = 0, inc = Tensor::VectorSize; index != length; index += inc * 2)
+        int index = 0;
+
+        for(int inc = FloatSize, vectorsLength = length - inc * 2; index <= vectorsLength;
+            index += inc * 2)
         {
-            Tensor::Vector av1 = simdpp::load(a + index);
-            Tensor::Vector rv1 = simdpp::load(r + index);
-            Tensor::Vector av2 = simdpp::load(a + index + inc);
-            Tensor::Vector rv2 = simdpp::load(r + index + inc);
+            FloatVector av1 = simdpp::load_u(a + index);
+            FloatVector rv1 = simdpp::load_u(r + index);
+            FloatVector av2 = simdpp::load_u(a + index + inc);
+            FloatVector rv2 = simdpp::load_u(r + index + inc);
             rv1 = simdpp::mul(av1, rv1);
             rv2 = simdpp::mul(av2, rv2);
-            simdpp::store(r + index, rv1);
-            simdpp::store(r + index + inc, rv2);
+            simdpp::store_u(r + index, rv1);
+            simdpp::store_u(r + index + inc, rv2);
         }
+
+        VectorMultiply()(a + index, r + index, length - index);
     }
 };
 
 }
 
+}
+
 #endif
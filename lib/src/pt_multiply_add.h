@@ -8,15 +8,17 @@
 #ifndef PT_MULTIPLY_ADD_H
 #define PT_MULTIPLY_ADD_H
 
-#include "pt_tensor.h"
+#include "pt_libsimdpp.h"
 
 namespace pt
 {
 
+inline namespace SIMDPP_ARCH_NAMESPACE
+{
+
 namespace detail
 {
-    PT_INLINE Tensor::Vector madd(const Tensor::Vector& av, const Tensor::Vector& bv,
-                                      const Tensor::Vector& rv) noexcept
+    PT_INLINE FloatVector madd(const FloatVector& av, const FloatVector& bv, const FloatVector& rv) noexcept
     {
         #if PT_FMADD_ENABLE
             return simdpp::fmadd(av, bv, rv);
@@ -28,7 +30,7 @@ namespace detail
 
 struct ScalarMultiplyAdd
 {
-    PT_INLINE void operator()(const Tensor::Type* a, const Tensor::Type* b, Tensor::Type* r,
+    PT_INLINE void operator()(const FloatType* a, const FloatType* b, FloatType* r,
                                   int length) noexcept
     {
         for(int index = 0; index != length; ++index)
@@ -37,10 +39,10 @@ struct ScalarMultiplyAdd
         }
     }
 
-    PT_INLINE Tensor::Type operator()(const Tensor::Type* a, const Tensor::Type* b,
+    PT_INLINE FloatType operator()(const FloatType* a, const FloatType* b,
                                           int length) noexcept
     {
-        Tensor::Type r(0);
+        FloatType r(0);
 
         for(int index = 0; index != length; ++index)
         {
@@ -54,64 +56,87 @@ struct ScalarMultiplyAdd
 
 struct VectorMultiplyAdd
 {
-    PT_INLINE void operator()(const Tensor::Type* a, const Tensor::Type* b, Tensor::Type* r,
+    PT_INLINE void operator()(const FloatType* a, const FloatType* b, FloatType* r,
                                   int length) noexcept
     {
-        for(int index = 0; index != length; index += Tensor::VectorSize)
+        int index = 0;
+
+        for(int vectorsLength = length - int(FloatSize); index <= vectorsLength;
+            index += FloatSize)
         {
-            Tensor::Vector rv = simdpp::load(r + index);
-            rv = detail::madd(simdpp::load(a + index), simdpp::load(b + index), rv);
-            simdpp::store(r + index, rv);
+            FloatVector rv = simdpp::load_u(r + index);
+            rv = detail::madd(simdpp::load_u(a + index), simdpp::load_u(b + index), rv);
+            simdpp::store_u(r + index, rv);
         }
+
+        ScalarMultiplyAdd()(a + index, b + index, r + index, length - index);
     }
 
-    PT_INLINE Tensor::Type operator()(const Tensor::Type* a, const Tensor::Type* b,
+    PT_INLINE FloatType operator()(const FloatType* a, const FloatType* b,
                                           int length) noexcept
     {
-        Tensor::Vector rv = makeVector(Tensor::Type(0));
+        FloatVector rv = makeVector(FloatType(0));
+        int index = 0;
 
-        for(int index = 0; index != length; index += Tensor::VectorSize)
+        for(int vectorsLength = length - int(FloatSize); index <= vectorsLength;
+            index += FloatSize)
         {
-            rv = detail::madd(simdpp::load(a + index), simdpp::load(b + index), rv);
+            rv = detail::madd(simdpp::load_u(a + index), simdpp::load_u(b + index), rv);
         }
 
-        return simdpp::reduce_add(rv);
+        return simdpp::reduce_add(rv) + ScalarMultiplyAdd()(a + index, b + index, length - index);
     }
 };
 
 
 struct Vector2MultiplyAdd
 {
-    PT_INLINE void operator()(const Tensor::Type* a, const Tensor::Type* b, Tensor::Type* r,
+    PT_INLINE void operator()(const FloatType* a, const FloatType* b, FloatType* r,
                                   int length) noexcept
     {
-        for(int index = 0, inc = Tensor::VectorSize; index != length; index += inc * 2)
+        int index = 0;
+
+        for(int inc = FloatSize, vectorsLength = length - inc * 2; index <= vectorsLength;
+            index += inc * 2)
         {
-            Tensor::Vector rv1 = simdpp::load(r + index);
-            Tensor::Vector rv2 = simdpp::load(r + index + inc);
-            rv1 = detail::madd(simdpp::load(a + index), simdpp::load(b + index), rv1);
-            rv2 = detail::madd(simdpp::load(a + index + inc), simdpp::load(b + index + inc), rv2);
-            simdpp::store(r + index, rv1);
-            simdpp::store(r + index + inc, rv2);
+            FloatVector rv1 = simdpp::load_u(r + index);
+            FloatVector rv2 = simdpp::load_u(r + index + inc);
+            rv1 = detail::madd(simdpp::load_u(a + index), simdpp::load_u(b + index), rv1);
+            rv2 = detail::madd(simdpp::load_u(a + index + inc), simdpp::load_u(b + index + inc), rv2);
+            simdpp::store_u(r + index, rv1);
+            simdpp::store_u(r + index + inc, rv2);
         }
+
+        VectorMultiplyAdd()(a + index, b + index, r + index, length - index);
     }
 
-    PT_INLINE Tensor::Type operator()(const Tensor::Type* a, const Tensor::Type* b,
+    PT_INLINE FloatType operator()(const FloatType* a, const FloatType* b,
                                           int length) noexcept
     {
-        Tensor::Vector rv1 = makeVector(Tensor::Type(0));
-        Tensor::Vector rv2 = makeVector(Tensor::Type(0));
+        FloatVector rv1 = makeVector(FloatType(0));
+        FloatVector rv2 = makeVector(FloatType(0));
+        int index = 0;
 
-        for(int index = 0, inc = Tensor::VectorSize; index != length; index += inc * 2)
+        for(int inc = FloatSize, vectorsLength = length - inc * 2; index <= vectorsLength;
+            index += inc * 2)
         {
-            rv1 = detail::madd(simdpp::load(a + index), simdpp::load(b + index), rv1);
-            rv2 = detail::madd(simdpp::load(a + index + inc), simdpp::load(b + index + inc), rv2);
+            rv1 = detail::madd(simdpp::load_u(a + index), simdpp::load_u(b + index), rv1);
+            rv2 = detail::madd(simdpp::load_u(a + index + inc), simdpp::load_u(b + index + inc), rv2);
         }
 
-        return simdpp::reduce_add(rv1) + simdpp::reduce_add(rv2);
+        if(index <= length - int(FloatSize))
+        {
+            rv1 = detail::madd(simdpp::load_u(a + index), simdpp::load_u(b + index), rv1);
+            index += FloatSize;
+        }
+
+        return simdpp::reduce_add(simdpp::add(rv1, rv2)) +
+                ScalarMultiplyAdd()(a + index, b + index, length - index);
     }
 };
 
 }
 
+}
+
 #endif
@@ -0,0 +1,214 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_quantized_tensor.h"
+
+#include <cmath>
+#include <algorithm>
+#include "pt_parser.h"
+#include "pt_model_stream.h"
+
+namespace pt
+{
+
+namespace
+{
+    // Weights types written by kerasify.py:
+    enum class WeightsType
+    {
+        Float = 0,
+        Int8 = 1
+    };
+}
+
+bool QuantizedTensor::parseType(std::istream& stream, bool& quantized)
+{
+    quantized = false;
+
+    auto modelStream = dynamic_cast<ModelStream*>(&stream);
+
+    if(! modelStream || modelStream->getVersion() < 5)
+    {
+        return true;
+    }
+
+    unsigned int weightsType = 0;
+
+    if(! Parser::parse(stream, weightsType))
+    {
+        PT_LOG_ERROR << "Weights type parse failed" << std::endl;
+        return false;
+    }
+
+    if(weightsType != unsigned(WeightsType::Float) && weightsType != unsigned(WeightsType::Int8))
+    {
+        PT_LOG_ERROR << "Invalid weights type: " << weightsType << std::endl;
+        return false;
+    }
+
+    quantized = weightsType == unsigned(WeightsType::Int8);
+    return true;
+}
+
+std::unique_ptr<QuantizedTensor> QuantizedTensor::create(std::size_t dims, std::istream& stream)
+{
+    if(dims == 0)
+    {
+        PT_LOG_ERROR << "Invalid dims value: " << dims << std::endl;
+        return std::unique_ptr<QuantizedTensor>();
+    }
+
+    // Scales are stored as a float tensor before the quantized one:
+    auto scales = Tensor::create(1, stream);
+
+    if(! scales)
+    {
+        PT_LOG_ERROR << "Scales tensor parse failed" << std::endl;
+        return std::unique_ptr<QuantizedTensor>();
+    }
+
+    std::unique_ptr<QuantizedTensor> tensor(new QuantizedTensor());
+    tensor->_dims.reserve(dims);
+
+    for(std::size_t i = 0; i != dims; ++i)
+    {
+        unsigned int stride = 0;
+
+        if(! Parser::parse(stream, stride))
+        {
+            PT_LOG_ERROR << "Stride parse failed" << std::endl;
+            return std::unique_ptr<QuantizedTensor>();
+        }
+
+        if(stride == 0)
+        {
+            PT_LOG_ERROR << "Invalid stride value: " << stride << std::endl;
+            return std::unique_ptr<QuantizedTensor>();
+        }
+
+        tensor->_dims.push_back(stride);
+    }
+
+    if(scales->getSize() != tensor->_dims[0])
+    {
+        PT_LOG_ERROR << "Scales count must be the same as dims[0]" <<
+                        " (scales dims: " << VectorPrinter<std::size_t>{ scales->getDims() } << ")" <<
+                        " (dims: " << VectorPrinter<std::size_t>{ tensor->_dims } << ")" << std::endl;
+        return std::unique_ptr<QuantizedTensor>();
+    }
+
+    tensor->_scales = std::move(*scales);
+
+    std::size_t size = 1;
+
+    for(std::size_t dim : tensor->_dims)
+    {
+        size *= dim;
+    }
+
+    tensor->_rowSize = size / tensor->_dims[0];
+
+    // Like float tensors, data is preceded by padding bytes which align it to 64 bytes from the file beginning:
+    unsigned int padding = 0;
+
+    if(! Parser::parse(stream, padding))
+    {
+        PT_LOG_ERROR << "Padding parse failed" << std::endl;
+        return std::unique_ptr<QuantizedTensor>();
+    }
+
+    if(! stream.ignore(padding) || stream.gcount() != std::streamsize(padding))
+    {
+        PT_LOG_ERROR << "Padding skip failed: " << padding << std::endl;
+        return std::unique_ptr<QuantizedTensor>();
+    }
+
+    // If the file is mapped in memory, the tensor points to it instead of copying its data
+    // (the int8 kernels don't need aligned data):
+    auto modelStream = dynamic_cast<ModelStream*>(&stream);
+
+    if(char* data = modelStream ? modelStream->map(size) : nullptr)
+    {
+        tensor->_buffer = reinterpret_cast<const Type*>(data);
+        return tensor;
+    }
+
+    tensor->_data.resize(size);
+
+    if(! Parser::parse(stream, tensor->_data.data(), size))
+    {
+        PT_LOG_ERROR << "Data parse failed" << std::endl;
+        return std::unique_ptr<QuantizedTensor>();
+    }
+
+    return tensor;
+}
+
+QuantizedTensor QuantizedTensor::stack(std::initializer_list<const QuantizedTensor*> tensors)
+{
+    const QuantizedTensor& first = **tensors.begin();
+    auto rows = first._dims[0];
+    QuantizedTensor out;
+    out._dims = first._dims;
+    out._dims[0] = rows * tensors.size();
+    out._rowSize = first._rowSize;
+    out._data.resize(first.getSize() * tensors.size());
+    out._scales.resize(out._dims[0]);
+
+    auto dataIt = out._data.begin();
+    auto scalesIt = out._scales.begin();
+
+    for(const QuantizedTensor* tensor : tensors)
+    {
+        PT_ASSERT(tensor->_dims == first._dims);
+
+        dataIt = std::copy(tensor->getData(), tensor->getData() + tensor->getSize(), dataIt);
+        scalesIt = std::copy(tensor->_scales.begin(), tensor->_scales.end(), scalesIt);
+    }
+
+    return out;
+}
+
+FloatType QuantizedTensor::quantize(const FloatType* values, std::size_t size, std::int16_t* output) noexcept
+{
+    FloatType maxAbs = 0;
+
+    for(std::size_t index = 0; index != size; ++index)
+    {
+        maxAbs = std::max(maxAbs, std::abs(values[index]));
+    }
+
+    if(maxAbs <= 0)
+    {
+        std::fill(output, output + size, std::int16_t(0));
+        return 1;
+    }
+
+    FloatType inverseScale = MaxValue / maxAbs;
+
+    for(std::size_t index = 0; index != size; ++index)
+    {
+        FloatType value = values[index] * inverseScale;
+        output[index] = std::int16_t(value < 0 ? value - FloatType(0.5) : value + FloatType(0.5));
+    }
+
+    return maxAbs / MaxValue;
+}
+
+std::int16_t* QuantizedTensor::getBuffer(Tensor& tensor, std::size_t size)
+{
+    auto floatsCount = (size * sizeof(std::int16_t) + sizeof(Tensor::Type) - 1) / sizeof(Tensor::Type);
+
+    if(tensor.getSize() < floatsCount)
+    {
+        tensor.resize(std::max(floatsCount, std::size_t(1)));
+    }
+
+    return reinterpret_cast<std::int16_t*>(tensor.begin());
+}
+
+}
@@ -0,0 +1,102 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_QUANTIZED_TENSOR_H
+#define PT_QUANTIZED_TENSOR_H
+
+#include <cstdint>
+#include <initializer_list>
+#include "pt_tensor.h"
+
+namespace pt
+{
+
+// Weights quantized to int8 values with one scale for each row (dims[0]), so row values are
+// scales[row] * data[row][i]. Rows are the output channels of Dense, Conv1D and Conv2D layers
+// (and the gates rows of LSTM layers), so a batch normalization can still be folded into the scales.
+//
+// Layer inputs are quantized when the layer is applied, with one scale for each input sample or LSTM timestep
+// (see quantize), and the int32 sums of the int8 kernels are converted back to float with both scales
+// before the biases and the activation are applied.
+class QuantizedTensor
+{
+
+public:
+    using Type = std::int8_t;
+    using DimsVector = Tensor::DimsVector;
+
+    // Input values are quantized to [-MaxValue, MaxValue], like the weights:
+    static constexpr int MaxValue = 127;
+
+    // Parses the weights type stored before the weights of Dense, Conv1D, Conv2D and LSTM layers
+    // in v5 files (older files only have float weights). The values are the same as the ones written
+    // by kerasify.py:
+    static bool parseType(std::istream& stream, bool& quantized);
+
+    static std::unique_ptr<QuantizedTensor> create(std::size_t dims, std::istream& stream);
+
+    // Stacks the rows of the given tensors (which must have the same dims) in a new tensor:
+    static QuantizedTensor stack(std::initializer_list<const QuantizedTensor*> tensors);
+
+    // Quantizes the given values to [-MaxValue, MaxValue] with the returned scale.
+    // Quantized values are stored as int16 since the int8 kernels widen the weights to 16 bits anyway:
+    static FloatType quantize(const FloatType* values, std::size_t size, std::int16_t* output) noexcept;
+
+    // Returns a buffer of size int16 values stored in the memory of the given (scratch) tensor,
+    // which is resized if it is too small:
+    static std::int16_t* getBuffer(Tensor& tensor, std::size_t size);
+
+    QuantizedTensor() = default;
+
+    bool isValid() const noexcept
+    {
+        return ! _dims.empty();
+    }
+
+    const DimsVector& getDims() const noexcept
+    {
+        return _dims;
+    }
+
+    std::size_t getSize() const noexcept
+    {
+        return _scales.getSize() ? _scales.getSize() * _rowSize : 0;
+    }
+
+    // Values count of each row:
+    std::size_t getRowSize() const noexcept
+    {
+        return _rowSize;
+    }
+
+    const Type* getData() const noexcept
+    {
+        return _buffer ? _buffer : _data.data();
+    }
+
+    // Scales can be modified (for example, to fold a batch normalization):
+    Tensor& getScales() noexcept
+    {
+        return _scales;
+    }
+
+    const Tensor& getScales() const noexcept
+    {
+        return _scales;
+    }
+
+protected:
+    DimsVector _dims;
+    std::vector<Type> _data;
+    const Type* _buffer = nullptr; // Data of a mapped file.
+    std::size_t _rowSize = 0;
+    Tensor _scales;
+};
+
+}
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_recurrent_layer.h"
+
+#include <algorithm>
+#include "pt_dispatcher.h"
+#include "pt_kernels.h"
+#include "pt_quantized_tensor.h"
+#include "pt_logger.h"
+
+namespace pt
+{
+
+bool RecurrentLayer::_getMask(const Tensor& mask, std::size_t steps, const Tensor::Type*& maskValues)
+{
+    maskValues = nullptr;
+
+    if(! mask.isValid())
+    {
+        return true;
+    }
+
+    if(mask.getSize() != steps)
+    {
+        PT_LOG_ERROR << "Mask size must be the same as the input timesteps count" <<
+                        " (mask size: " << mask.getSize() << ")" << " (timesteps: " << steps << ")" << std::endl;
+        return false;
+    }
+
+    maskValues = mask.begin();
+    return true;
+}
+
+bool RecurrentLayer::_checkStepInput(const DimsVector& inDims, std::size_t inputSize)
+{
+    auto dimsCount = inDims.size();
+
+    if(dimsCount != 1 && dimsCount != 2)
+    {
+        PT_LOG_ERROR << "Input tensor dims count must be 1 or 2" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
+    }
+
+    if(dimsCount == 2 && inDims[0] != 1)
+    {
+        PT_LOG_ERROR << "Input tensor must contain only one timestep" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
+    }
+
+    if(inDims.back() != inputSize)
+    {
+        PT_LOG_ERROR << "Input tensor features count must be " << inputSize <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+Tensor* RecurrentLayer::_getScratch(std::vector<Tensor>& scratch, std::size_t count)
+{
+    if(scratch.size() < count)
+    {
+        scratch.resize(count);
+    }
+
+    return scratch.data();
+}
+
+Tensor RecurrentLayer::_transposeRows(const Tensor& weights, std::size_t rowBegin, std::size_t rowEnd)
+{
+    auto rows = rowEnd - rowBegin;
+    auto columns = weights.getDims()[1];
+    Tensor out(columns, rows);
+    auto weightsIt = weights.begin() + long(rowBegin * columns);
+    auto outIt = out.begin();
+
+    for(std::size_t row = 0; row != rows; ++row)
+    {
+        for(std::size_t column = 0; column != columns; ++column)
+        {
+            outIt[column * rows + row] = weightsIt[row * columns + column];
+        }
+    }
+
+    return out;
+}
+
+void RecurrentLayer::_multiplyAdd(const Tensor::Type* inBegin, int inRows, const QuantizedTensor& weights,
+                                  Tensor::Type* outBegin, Tensor& buffer, Tensor& scales, Dispatcher& dispatcher)
+{
+    auto wInc = int(weights.getRowSize());
+    auto wRows = int(weights.getDims()[0]);
+    std::int16_t* quantizedIn = QuantizedTensor::getBuffer(buffer, std::size_t(inRows * wInc));
+    scales.resize(std::size_t(inRows));
+
+    // Timesteps are quantized on their own, so the result doesn't depend on the other ones
+    // (or on how masked timesteps split the sequence in runs):
+    auto inScales = scales.begin();
+
+    for(int inRow = 0; inRow != inRows; ++inRow)
+    {
+        inScales[inRow] = QuantizedTensor::quantize(inBegin + (inRow * wInc), std::size_t(wInc),
+                                                    quantizedIn + (inRow * wInc));
+    }
+
+    auto weightsBegin = weights.getData();
+    auto scalesBegin = weights.getScales().begin();
+
+    dispatcher.run(wRows, wInc * inRows, [&](int taskBegin, int taskEnd)
+    {
+        auto dotRowsInt8 = Kernels::get().dotRowsInt8;
+
+        // The weights rows of each task are multiplied by all input rows:
+        for(int inRow = 0; inRow != inRows; ++inRow)
+        {
+            dotRowsInt8(quantizedIn + (inRow * wInc), weightsBegin + (taskBegin * wInc), wInc,
+                        taskEnd - taskBegin, wInc, scalesBegin + taskBegin, inScales[inRow],
+                        outBegin + (inRow * wRows + taskBegin));
+        }
+    });
+}
+
+void RecurrentLayer::_project(const Tensor& in, const Tensor::Type* mask, const Tensor& weights,
+                              const Tensor& biases, Tensor& projection, Dispatcher& dispatcher) const
+{
+    auto inputSize = weights.getDims()[1];
+    auto gatesSize = biases.getSize();
+
+    _projectRuns(in, mask, inputSize, gatesSize, projection,
+                 [&](const Tensor::Type* inBegin, int inRows, Tensor::Type* outBegin)
+    {
+        // A single timestep is multiplied by blocks of W rows, so W is not transposed for it:
+        if(inRows == 1)
+        {
+            _fillBiases(biases, inRows, outBegin);
+            _recurrentMultiplyAdd(inBegin, weights, 0, gatesSize, outBegin, dispatcher);
+            return;
+        }
+
+        std::call_once(_transposedWeightsFlag, [this, &weights, gatesSize]
+        {
+            _transposedWeights = _transposeRows(weights, 0, gatesSize);
+        });
+
+        // [inRows, inputSize] x [inputSize, gatesSize] GEMM, split by rows between threads:
+        auto transposedBegin = _transposedWeights.begin();
+
+        dispatcher.run(inRows, int(inputSize * gatesSize), [&](int taskBegin, int taskEnd)
+        {
+            auto gemm = Kernels::get().gemm;
+            gemm(inBegin + taskBegin * int(inputSize), taskEnd - taskBegin, int(inputSize), transposedBegin,
+                 int(gatesSize), biases.begin(), outBegin + taskBegin * int(gatesSize), int(gatesSize),
+                 int(gatesSize));
+        });
+    });
+}
+
+void RecurrentLayer::_project(const Tensor& in, const Tensor::Type* mask, const QuantizedTensor& weights,
+                              const Tensor& biases, Tensor& projection, Tensor& buffer, Tensor& scales,
+                              Dispatcher& dispatcher)
+{
+    _projectRuns(in, mask, weights.getDims()[1], biases.getSize(), projection,
+                 [&](const Tensor::Type* inBegin, int inRows, Tensor::Type* outBegin)
+    {
+        _fillBiases(biases, inRows, outBegin);
+        _multiplyAdd(inBegin, inRows, weights, outBegin, buffer, scales, dispatcher);
+    });
+}
+
+void RecurrentLayer::_recurrentMultiplyAdd(const Tensor::Type* in, const Tensor& weights, std::size_t rowBegin,
+                                           std::size_t rowEnd, Tensor::Type* out, Dispatcher& dispatcher)
+{
+    auto wInc = int(weights.getDims()[1]);
+    auto weightsBegin = weights.begin() + long(rowBegin) * wInc;
+
+    // Blocks of weights rows share each input load:
+    dispatcher.run(int(rowEnd - rowBegin), wInc, [&](int taskBegin, int taskEnd)
+    {
+        auto dotRows = Kernels::get().dotRows;
+        dotRows(in, weightsBegin + (taskBegin * wInc), wInc, taskEnd - taskBegin, wInc, out + taskBegin, 0);
+    });
+}
+
+void RecurrentLayer::_recurrentMultiplyAdd(const Tensor::Type* in, const QuantizedTensor& weights,
+                                           std::size_t rowBegin, std::size_t rowEnd, Tensor::Type* out,
+                                           Tensor& buffer, Dispatcher& dispatcher)
+{
+    auto wInc = int(weights.getRowSize());
+    std::int16_t* quantizedIn = QuantizedTensor::getBuffer(buffer, std::size_t(wInc));
+    FloatType inScale = QuantizedTensor::quantize(in, std::size_t(wInc), quantizedIn);
+    auto weightsBegin = weights.getData() + long(rowBegin) * wInc;
+    auto scalesBegin = weights.getScales().begin() + long(rowBegin);
+
+    dispatcher.run(int(rowEnd - rowBegin), wInc, [&](int taskBegin, int taskEnd)
+    {
+        auto dotRowsInt8 = Kernels::get().dotRowsInt8;
+        dotRowsInt8(quantizedIn, weightsBegin + (taskBegin * wInc), wInc, taskEnd - taskBegin, wInc,
+                    scalesBegin + taskBegin, inScale, out + taskBegin);
+    });
+}
+
+template<class ProjectRun>
+void RecurrentLayer::_projectRuns(const Tensor& in, const Tensor::Type* mask, std::size_t inputSize,
+                                  std::size_t gatesSize, Tensor& projection, const ProjectRun& projectRun)
+{
+    auto steps = in.getSize() / inputSize;
+    projection.resize(steps, gatesSize);
+
+    // Each run of consecutive unmasked timesteps is projected at once:
+    for(std::size_t runBegin = 0; runBegin != steps; )
+    {
+        if(_isMasked(mask, runBegin))
+        {
+            ++runBegin;
+            continue;
+        }
+
+        std::size_t runEnd = runBegin + 1;
+
+        while(runEnd != steps && ! _isMasked(mask, runEnd))
+        {
+            ++runEnd;
+        }
+
+        projectRun(in.begin() + long(runBegin * inputSize), int(runEnd - runBegin),
+                   projection.begin() + long(runBegin * gatesSize));
+        runBegin = runEnd;
+    }
+}
+
+void RecurrentLayer::_fillBiases(const Tensor& biases, int inRows, Tensor::Type* outBegin)
+{
+    for(int row = 0; row != inRows; ++row)
+    {
+        outBegin = std::copy(biases.begin(), biases.end(), outBegin);
+    }
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_RECURRENT_LAYER_H
+#define PT_RECURRENT_LAYER_H
+
+#include <mutex>
+#include "pt_tensor.h"
+#include "pt_layer.h"
+
+namespace pt
+{
+
+class Dispatcher;
+class QuantizedTensor;
+
+// Layer which carries a state from one timestep to the next one,
+// so it can be advanced one timestep at a time (see StreamingSession):
+class RecurrentLayer : public Layer
+{
+
+public:
+    // Number of values of the state (1D tensor) carried between timesteps:
+    virtual std::size_t getStateSize() const noexcept = 0;
+
+    // Applies the layer to a single timestep (input dims [1, features] or [features]),
+    // reading the previous state from the given tensor and replacing it with the new one:
+    virtual bool applyStep(LayerData& layerData, Tensor& state) const = 0;
+
+protected:
+    // Retrieves the values of the given timesteps mask (nullptr if the input is not masked):
+    static bool _getMask(const Tensor& mask, std::size_t steps, const Tensor::Type*& maskValues);
+
+    // Masked timesteps have mask values equal to 0 (see LayerData). maskValues can be null:
+    static bool _isMasked(const Tensor::Type* maskValues, std::size_t step) noexcept
+    {
+        return maskValues && ! (maskValues[step] > 0);
+    }
+
+    // Checks that the input of applyStep is a single timestep of inputSize features
+    // (input dims [1, inputSize] or [inputSize]):
+    static bool _checkStepInput(const DimsVector& inDims, std::size_t inputSize);
+
+    // Returns the first count scratch tensors, adding them if there are not enough:
+    static Tensor* _getScratch(std::vector<Tensor>& scratch, std::size_t count);
+
+    // Returns the transpose of the given rows of weights:
+    static Tensor _transposeRows(const Tensor& weights, std::size_t rowBegin, std::size_t rowEnd);
+
+    // out[row] += in[row] * weights^T for each of the inRows rows of in. Each input row is quantized with
+    // its own scale, like in applyStep, in the given buffer (see QuantizedTensor::getBuffer) and scales tensors:
+    static void _multiplyAdd(const Tensor::Type* inBegin, int inRows, const QuantizedTensor& weights,
+                             Tensor::Type* outBegin, Tensor& buffer, Tensor& scales, Dispatcher& dispatcher);
+
+    // Computes the input projection (x * W^T + b) of all the unmasked timesteps of in up front,
+    // so only the recurrent product remains in the sequential loop. mask can be null.
+    // Runs of many timesteps are multiplied by W^T with the GEMM kernel. W^T is built from the given weights
+    // the first time it is needed, so they must always be the same weights of this layer:
+    void _project(const Tensor& in, const Tensor::Type* mask, const Tensor& weights, const Tensor& biases,
+                  Tensor& projection, Dispatcher& dispatcher) const;
+
+    // Like the float version, with int8 weights (the input is quantized in the given buffer and scales tensors):
+    static void _project(const Tensor& in, const Tensor::Type* mask, const QuantizedTensor& weights,
+                         const Tensor& biases, Tensor& projection, Tensor& buffer, Tensor& scales,
+                         Dispatcher& dispatcher);
+
+    // out[row - rowBegin] += in * weights[row]^T for each row of weights in [rowBegin, rowEnd):
+    static void _recurrentMultiplyAdd(const Tensor::Type* in, const Tensor& weights, std::size_t rowBegin,
+                                      std::size_t rowEnd, Tensor::Type* out, Dispatcher& dispatcher);
+
+    // Like the float version, with int8 weights (in is quantized in the given buffer):
+    static void _recurrentMultiplyAdd(const Tensor::Type* in, const QuantizedTensor& weights, std::size_t rowBegin,
+                                      std::size_t rowEnd, Tensor::Type* out, Tensor& buffer, Dispatcher& dispatcher);
+
+private:
+    // W^T ([inputSize, gatesSize]), the GEMM kernel b matrix of the float input projection. It is built
+    // the first time a run of many timesteps is projected, so layers which only advance one timestep
+    // at a time (see StreamingSession) don't store W twice:
+    mutable std::once_flag _transposedWeightsFlag;
+    mutable Tensor _transposedWeights;
+
+    // Calls projectRun(inBegin, inRows, outBegin) for each run of consecutive unmasked timesteps,
+    // which must write the projection of the inRows timesteps of the run:
+    template<class ProjectRun>
+    static void _projectRuns(const Tensor& in, const Tensor::Type* mask, std::size_t inputSize,
+                             std::size_t gatesSize, Tensor& projection, const ProjectRun& projectRun);
+
+    // Fills the inRows rows of out with the biases:
+    static void _fillBiases(const Tensor& biases, int inRows, Tensor::Type* outBegin);
+};
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "pt_tensor.h"
 #include "pt_activation_layer.h"
+#include "pt_kernels.h"
 
 namespace pt
 {
@@ -17,25 +18,7 @@ public:
 
     void apply(Tensor& out) const final
     {
-        if(out.getSize() % Tensor::VectorSize == 0)
-        {
-            Tensor::Vector zero = makeVector(Tensor::Type(0));
-
-            for(auto it = out.begin(), end = out.end(); it != end; it += Tensor::VectorSize)
-            {
-                auto ptr = &*it;
-                Tensor::Vector v = simdpp::load(ptr);
-                simdpp::store(ptr, simdpp::max(v, zero));
-            }
-        }
-        else
-        {
-            for(auto it = out.begin(), end = out.end(); it != end; ++it)
-            {
-                auto& x = *it;
-                x = std::max(x, Tensor::Type(0));
-            }
-        }
+        Kernels::get().relu(out.begin(), int(out.getSize()));
     }
 };
 
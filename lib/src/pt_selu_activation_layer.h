@@ -10,6 +10,7 @@
 
 #include "pt_tensor.h"
 #include "pt_activation_layer.h"
+#include "pt_kernels.h"
 
 namespace pt
 {
@@ -24,18 +25,7 @@ public:
 
     void apply(Tensor& out) const final
     {
-        constexpr auto alpha = FloatType(1.6732632423543772848170429916717);
-        constexpr auto scale = FloatType(1.0507009873554804934193349852946);
-
-        for(FloatType& value : out)
-        {
-            if(value < 0)
-            {
-                value = alpha * std::expm1(value);
-            }
-
-            value *= scale;
-        }
+        Kernels::get().selu(out.begin(), int(out.getSize()));
     }
 };
 
@@ -10,6 +10,7 @@
 
 #include "pt_tensor.h"
 #include "pt_activation_layer.h"
+#include "pt_kernels.h"
 
 namespace pt
 {
@@ -24,19 +25,7 @@ public:
 
     void apply(Tensor& out) const final
     {
-        for(FloatType& value : out)
-        {
-            FloatType z = std::exp(-std::abs(value));
-
-            if(value < 0)
-            {
-                value = z / (FloatType(1) + z);
-            }
-            else
-            {
-                value = FloatType(1) / (FloatType(1) + z);
-            }
-        }
+        Kernels::get().sigmoid(out.begin(), int(out.getSize()));
     }
 };
 
@@ -0,0 +1,271 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_simple_rnn_layer.h"
+
+#include <algorithm>
+#include "pt_parser.h"
+#include "pt_layer_data.h"
+#include "pt_dispatcher.h"
+#include "pt_logger.h"
+
+namespace pt
+{
+
+// Temporary tensors of a sequence, stored in the given scratch tensors:
+struct SimpleRnnLayer::TempData
+{
+    static constexpr std::size_t TensorsCount = 3;
+
+    Tensor& projection;
+    Tensor& candidate;
+    Tensor& ht;
+
+    TempData(std::size_t units, Tensor* tensors) :
+        projection(tensors[0]),
+        candidate(tensors[1]),
+        ht(tensors[2])
+    {
+        candidate.resize(units);
+        ht.resize(units);
+        ht.fill(0);
+    }
+};
+
+std::unique_ptr<SimpleRnnLayer> SimpleRnnLayer::create(std::istream& stream)
+{
+    auto weights = Tensor::create(2, stream);
+
+    if(! weights)
+    {
+        PT_LOG_ERROR << "Weights tensor parse failed" << std::endl;
+        return std::unique_ptr<SimpleRnnLayer>();
+    }
+
+    auto recurrentWeights = Tensor::create(2, stream);
+
+    if(! recurrentWeights)
+    {
+        PT_LOG_ERROR << "Recurrent weights tensor parse failed" << std::endl;
+        return std::unique_ptr<SimpleRnnLayer>();
+    }
+
+    auto biases = Tensor::create(1, stream);
+
+    if(! biases)
+    {
+        PT_LOG_ERROR << "Biases tensor parse failed" << std::endl;
+        return std::unique_ptr<SimpleRnnLayer>();
+    }
+
+    const auto& wDims = weights->getDims();
+    const auto& uDims = recurrentWeights->getDims();
+    auto units = uDims[1];
+
+    if(wDims[0] != units || uDims[0] != units || biases->getSize() != units)
+    {
+        PT_LOG_ERROR << "W, U and biases tensors dims[0] must be the same as units" <<
+                        " (W dims: " << VectorPrinter<std::size_t>{ wDims } << ")" <<
+                        " (U dims: " << VectorPrinter<std::size_t>{ uDims } << ")" <<
+                        " (biases dims: " << VectorPrinter<std::size_t>{ biases->getDims() } << ")" << std::endl;
+        return std::unique_ptr<SimpleRnnLayer>();
+    }
+
+    auto activation = ActivationLayer::create(stream);
+
+    if(! activation)
+    {
+        PT_LOG_ERROR << "Activation layer parse failed" << std::endl;
+        return std::unique_ptr<SimpleRnnLayer>();
+    }
+
+    unsigned int returnSequences = 0;
+
+    if(! Parser::parse(stream, returnSequences))
+    {
+        PT_LOG_ERROR << "Return sequences parse failed" << std::endl;
+        return std::unique_ptr<SimpleRnnLayer>();
+    }
+
+    return std::unique_ptr<SimpleRnnLayer>(new SimpleRnnLayer(std::move(*weights), std::move(*recurrentWeights),
+                                                              std::move(*biases), std::move(activation),
+                                                              returnSequences));
+}
+
+bool SimpleRnnLayer::apply(LayerData& layerData) const
+{
+    const Tensor& in = layerData.in;
+
+    if(! _checkInput(in.getDims()))
+    {
+        return false;
+    }
+
+    auto units = getStateSize();
+    auto steps = in.getDims()[0];
+    const Tensor::Type* mask;
+
+    if(! _getMask(layerData.mask, steps, mask))
+    {
+        return false;
+    }
+
+    TempData tempData(units, _getScratch(layerData.scratch, TempData::TensorsCount));
+    _project(in, mask, _weights, _biases, tempData.projection, layerData.dispatcher);
+
+    // Masked timesteps are skipped, so they keep the state unchanged and output the last ht, like in Keras:
+    Tensor& out = layerData.out;
+
+    if(_returnSequences)
+    {
+        out.resize(steps, units);
+
+        auto outIt = out.begin();
+
+        for(std::size_t s = 0; s != steps; ++s)
+        {
+            if(! _isMasked(mask, s))
+            {
+                _step(s, layerData.dispatcher, tempData);
+            }
+
+            outIt = std::copy(tempData.ht.begin(), tempData.ht.end(), outIt);
+        }
+    }
+    else
+    {
+        for(std::size_t s = 0; s != steps; ++s)
+        {
+            if(! _isMasked(mask, s))
+            {
+                _step(s, layerData.dispatcher, tempData);
+            }
+        }
+
+        tempData.ht.copyTo(out);
+
+        // The mask of the input timesteps doesn't apply to the output:
+        layerData.mask.clear();
+    }
+
+    out.eraseDummyDims();
+    return true;
+}
+
+bool SimpleRnnLayer::applyStep(LayerData& layerData, Tensor& state) const
+{
+    const Tensor& in = layerData.in;
+
+    if(! _checkStepInput(in.getDims(), _weights.getDims()[1]))
+    {
+        return false;
+    }
+
+    if(state.getSize() != getStateSize())
+    {
+        PT_LOG_ERROR << "Invalid state size: " << state.getSize() << " (expected: " << getStateSize() << ")" <<
+                        std::endl;
+        return false;
+    }
+
+    const Tensor::Type* mask;
+
+    if(! _getMask(layerData.mask, 1, mask))
+    {
+        return false;
+    }
+
+    if(! _returnSequences)
+    {
+        layerData.mask.clear();
+    }
+
+    // A masked timestep keeps the state unchanged and outputs the last ht:
+    if(_isMasked(mask, 0))
+    {
+        state.copyTo(layerData.out);
+        return true;
+    }
+
+    TempData tempData(getStateSize(), _getScratch(layerData.scratch, TempData::TensorsCount));
+    state.copyTo(tempData.ht);
+
+    _project(in, nullptr, _weights, _biases, tempData.projection, layerData.dispatcher);
+    _step(0, layerData.dispatcher, tempData);
+
+    tempData.ht.copyTo(state);
+    tempData.ht.copyTo(layerData.out);
+    return true;
+}
+
+bool SimpleRnnLayer::getOutputDims(const DimsVector& inDims, DimsVector& outDims) const
+{
+    if(! _checkInput(inDims))
+    {
+        return false;
+    }
+
+    auto units = getStateSize();
+
+    if(_returnSequences && inDims[0] > 1)
+    {
+        outDims = { inDims[0], units };
+    }
+    else
+    {
+        outDims.assign(1, units);
+    }
+
+    return true;
+}
+
+SimpleRnnLayer::SimpleRnnLayer(Tensor&& weights, Tensor&& recurrentWeights, Tensor&& biases,
+                               std::unique_ptr<ActivationLayer>&& activation, bool returnSequences) noexcept :
+    _weights(std::move(weights)),
+    _recurrentWeights(std::move(recurrentWeights)),
+    _biases(std::move(biases)),
+    _activation(std::move(activation)),
+    _returnSequences(returnSequences)
+{
+}
+
+bool SimpleRnnLayer::_checkInput(const DimsVector& inDims) const
+{
+    if(inDims.size() != 2)
+    {
+        PT_LOG_ERROR << "Input tensor dims count must be 2" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" << std::endl;
+        return false;
+    }
+
+    const auto& ww = _weights.getDims();
+
+    if(inDims[1] != ww[1])
+    {
+        PT_LOG_ERROR << "Input tensor dims[1] must be the same as W dims[1]" <<
+                            " (input dims: " << VectorPrinter<std::size_t>{ inDims } << ")" <<
+                            " (W dims: " << VectorPrinter<std::size_t>{ ww } << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void SimpleRnnLayer::_step(std::size_t step, Dispatcher& dispatcher, TempData& tempData) const
+{
+    // ht = activation(x * W^T + b + ht * U^T), with the input projection already computed:
+    auto units = getStateSize();
+    auto projectionIt = tempData.projection.begin() + long(step * units);
+    Tensor& candidate = tempData.candidate;
+    std::copy(projectionIt, projectionIt + long(units), candidate.begin());
+
+    _recurrentMultiplyAdd(tempData.ht.begin(), _recurrentWeights, 0, units, candidate.begin(), dispatcher);
+    _activation->apply(candidate);
+    candidate.copyTo(tempData.ht);
+}
+
+}
@@ -0,0 +1,55 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_SIMPLE_RNN_LAYER_H
+#define PT_SIMPLE_RNN_LAYER_H
+
+#include "pt_tensor.h"
+#include "pt_activation_layer.h"
+#include "pt_recurrent_layer.h"
+
+namespace pt
+{
+
+class SimpleRnnLayer : public RecurrentLayer
+{
+
+public:
+    static std::unique_ptr<SimpleRnnLayer> create(std::istream& stream);
+
+    bool apply(LayerData& layerData) const final;
+
+    bool getOutputDims(const DimsVector& inDims, DimsVector& outDims) const final;
+
+    // State is stored as ht:
+    std::size_t getStateSize() const noexcept final
+    {
+        return _biases.getSize();
+    }
+
+    bool applyStep(LayerData& layerData, Tensor& state) const final;
+
+protected:
+    struct TempData;
+
+    Tensor _weights;
+    Tensor _recurrentWeights;
+    Tensor _biases;
+    std::unique_ptr<ActivationLayer> _activation;
+    bool _returnSequences;
+
+    SimpleRnnLayer(Tensor&& weights, Tensor&& recurrentWeights, Tensor&& biases,
+                   std::unique_ptr<ActivationLayer>&& activation, bool returnSequences) noexcept;
+
+    bool _checkInput(const DimsVector& inDims) const;
+
+    void _step(std::size_t step, Dispatcher& dispatcher, TempData& tempData) const;
+};
+
+}
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "pt_tensor.h"
 #include "pt_activation_layer.h"
+#include "pt_math.h"
 
 namespace pt
 {
@@ -32,27 +33,17 @@ public:
             d += value;
         }
 
-        if(out.getSize() % Tensor::VectorSize == 0)
+        Tensor::Type sd = 1 / d;
+        Tensor::Vector vd = makeVector(sd);
+
+        Math::transform(out.begin(), int(out.getSize()), [&vd](const Tensor::Vector& x) -> Tensor::Vector
         {
-            Tensor::Vector vd = makeVector(1 / d);
-
-            for(auto it = out.begin(), end = out.end(); it != end; it += Tensor::VectorSize)
-            {
-                auto ptr = &*it;
-                Tensor::Vector v = simdpp::load(ptr);
-                simdpp::store(ptr, simdpp::mul(v, vd));
-            }
-        }
-        else
+            return simdpp::mul(x, vd);
+        },
+        [sd](Tensor::Type x)
         {
-            Tensor::Type sd = 1 / d;
-
-            for(auto it = out.begin(), end = out.end(); it != end; ++it)
-            {
-                auto& x = *it;
-                x *= sd;
-            }
-        }
+            return x * sd;
+        });
     }
 };
 
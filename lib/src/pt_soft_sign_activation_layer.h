@@ -10,6 +10,7 @@
 
 #include "pt_tensor.h"
 #include "pt_activation_layer.h"
+#include "pt_kernels.h"
 
 namespace pt
 {
@@ -24,26 +25,7 @@ public:
 
     void apply(Tensor& out) const final
     {
-        if(out.getSize() % Tensor::VectorSize == 0)
-        {
-            Tensor::Vector one = makeVector(FloatType(1));
-
-            for(auto it = out.begin(), end = out.end(); it != end; it += Tensor::VectorSize)
-            {
-                auto ptr = &*it;
-                Tensor::Vector v = simdpp::load(ptr);
-                Tensor::Vector d = simdpp::add(one, simdpp::abs(v));
-                simdpp::store(ptr, simdpp::div(v, d));
-            }
-        }
-        else
-        {
-            for(auto it = out.begin(), end = out.end(); it != end; ++it)
-            {
-                auto& x = *it;
-                x = x / (Tensor::Type(1) + std::abs(x));
-            }
-        }
+        Kernels::get().softSign(out.begin(), int(out.getSize()));
     }
 };
 
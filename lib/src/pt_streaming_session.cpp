@@ -0,0 +1,134 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#include "pt_streaming_session.h"
+
+#include "pt_model.h"
+#include "pt_recurrent_layer.h"
+#include "pt_layer_data.h"
+#include "pt_logger.h"
+
+namespace pt
+{
+
+StreamingSession::StreamingSession(const Model& model) :
+    _model(model),
+    _ownDispatcher(1),
+    _dispatcher(_ownDispatcher)
+{
+    _init();
+}
+
+StreamingSession::StreamingSession(const Model& model, Dispatcher& dispatcher) :
+    _model(model),
+    _ownDispatcher(1),
+    _dispatcher(dispatcher)
+{
+    _init();
+}
+
+bool StreamingSession::step(const Tensor& frame, Tensor& out)
+{
+    if(! frame.isValid())
+    {
+        PT_LOG_ERROR << "Frame tensor is not valid" << std::endl;
+        return false;
+    }
+
+    const auto& layers = _model.getLayers();
+    std::size_t layersCount = layers.size();
+    frame.copyTo(_buffers[0]);
+    _mask.clear();
+
+    Tensor* layerIn = &_buffers[0];
+    Tensor* layerOut = &_buffers[1];
+
+    for(std::size_t i = 0; i != layersCount; ++i)
+    {
+        if(i == layersCount - 1)
+        {
+            layerOut = &out;
+        }
+
+        const Layer& layer = *layers[i];
+        LayerData layerData{ *layerIn, *layerOut, _mask, _scratch, _dispatcher, _model.getConfig() };
+        bool success;
+
+        if(_state[i].isValid())
+        {
+            success = static_cast<const RecurrentLayer&>(layer).applyStep(layerData, _state[i]);
+        }
+        else
+        {
+            success = layer.apply(layerData);
+        }
+
+        if(! success)
+        {
+            PT_LOG_ERROR << "Layer apply failed" << std::endl;
+            return false;
+        }
+
+        std::swap(layerIn, layerOut);
+    }
+
+    return true;
+}
+
+void StreamingSession::reset() noexcept
+{
+    for(Tensor& layerState : _state)
+    {
+        layerState.fill(0);
+    }
+}
+
+bool StreamingSession::restore(const State& state)
+{
+    if(state.size() != _state.size())
+    {
+        PT_LOG_ERROR << "Invalid state layers count: " << state.size() <<
+                        " (expected: " << _state.size() << ")" << std::endl;
+        return false;
+    }
+
+    for(std::size_t i = 0, count = state.size(); i != count; ++i)
+    {
+        if(state[i].getDims() != _state[i].getDims())
+        {
+            PT_LOG_ERROR << "Invalid state dims" <<
+                            " (state dims: " << VectorPrinter<std::size_t>{ state[i].getDims() } << ")" <<
+                            " (expected: " << VectorPrinter<std::size_t>{ _state[i].getDims() } << ")" <<
+                            std::endl;
+            return false;
+        }
+    }
+
+    for(std::size_t i = 0, count = state.size(); i != count; ++i)
+    {
+        state[i].copyTo(_state[i]);
+    }
+
+    return true;
+}
+
+void StreamingSession::_init()
+{
+    const auto& layers = _model.getLayers();
+    _state.resize(layers.size());
+
+    for(std::size_t i = 0, count = layers.size(); i != count; ++i)
+    {
+        if(auto recurrentLayer = dynamic_cast<const RecurrentLayer*>(layers[i].get()))
+        {
+            _state[i].resize(recurrentLayer->getStateSize());
+            _state[i].fill(0);
+        }
+    }
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ * pocket-tensor (c) 2018 Gustavo Valiente gustavo.valiente.m@gmail.com
+ * Kerasify (c) 2016 Robert W. Rose
+ *
+ * MIT License, see LICENSE file.
+ */
+
+#ifndef PT_SUBTRACT_H
+#define PT_SUBTRACT_H
+
+#include "pt_libsimdpp.h"
+
+namespace pt
+{
+
+inline namespace SIMDPP_ARCH_NAMESPACE
+{
+
+struct ScalarSubtract
+{
+    PT_INLINE void operator()(const FloatType* a, FloatType* r, int length) noexcept
+    {
+        for(int index = 0; index != length; ++index)
+        {
+            *(r + index) -= *(a + index);
+        }
+    }
+};
+
+
+struct VectorSubtract
+{
+    PT_INLINE void operator()(const FloatType* a, FloatType* r, int length) noexcept
+    {
+        int index = 0;
+
+        for(int vectorsLength = length - int(FloatSize); index <= vectorsLength;
+            index += FloatSize)
+        {
+            FloatVector av = simdpp::load_u(a + index);
+            FloatVector rv = simdpp::load_u(r + index);
+            rv = simdpp::sub(rv, av);
+            simdpp::store_u(r + index, rv);
+        }
+
+        ScalarSubtract()(a + index, r + index, length - index);
+    }
+};
+
+
+struct Vector2Subtract
+{
+    PT_INLINE void operator()(const FloatType* a, FloatType* r, int length) noexcept
+    {
+        int index = 0;
+
+        for(int inc = FloatSize, vectorsLength = length - inc * 2; index <= vectorsLength;
+            index += inc * 2)
+        {
+            FloatVector av1 = simdpp::load_u(a + index);
+            FloatVector rv1 = simdpp::load_u(r + index);
+            FloatVector av2 = simdpp::load_u(a + index + inc);
+            FloatVector rv2 = simdpp::load_u(r + index + inc);
+            rv1 = simdpp::sub(rv1, av1);
+            rv2 = simdpp::sub(rv2, av2);
+            simdpp::store_u(r + index, rv1);
+            simdpp::store_u(r + index + inc, rv2);
+        }
+
+        VectorSubtract()(a + index, r + index, length - index);
+    }
+};
+
+}
+
+}
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "pt_tensor.h"
 #include "pt_activation_layer.h"
+#include "pt_kernels.h"
 
 namespace pt
 {
@@ -24,10 +25,7 @@ public:
 
     void apply(Tensor& out) const final
     {
-        for(FloatType& value : out)
-        {
-            value = std::tanh(value);
-        }
+        Kernels::get().tanh(out.begin(), int(out.getSize()));
     }
 };
 
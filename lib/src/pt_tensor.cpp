@@ -8,30 +8,19 @@
 #include "pt_tensor.h"
 
 #include <array>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
 #include <numeric>
-#include "pt_add.h"
-#include "pt_multiply.h"
-#include "pt_multiply_add.h"
+#include "pt_kernels.h"
 #include "pt_parser.h"
+#include "pt_model_stream.h"
 
 namespace pt
 {
 
 namespace
 {
-    template<class AddType>
-    void addImpl(const Tensor& in, Tensor& out)
-    {
-        AddType()(&*in.begin(), &*out.begin(), in.getSize());
-    }
-
-    template<class MultiplyType>
-    void multiplyImpl(const Tensor& in, Tensor& out)
-    {
-        MultiplyType()(&*in.begin(), &*out.begin(), in.getSize());
-    }
-
-    template<class MultiplyAddType>
     void dotImpl(const Tensor& a, const Tensor& b, Tensor& out)
     {
         auto outInc = int(out.getDims()[1]);
@@ -43,7 +32,7 @@ namespace
         auto iInc = int(a.getDims()[1]);
         auto bBegin = b.begin();
         auto oBegin = out.begin();
-        MultiplyAddType multiplyAdd;
+        auto dot = Kernels::get().dot;
 
         for(auto outIt = oBegin, outEnd = oBegin + (taskEnd * outInc);
             outIt != outEnd; outIt += outInc)
@@ -52,19 +41,13 @@ namespace
 
             for(auto outIt2 = outIt; outIt2 != outIt + outInc; ++outIt2)
             {
-                *outIt2 = multiplyAdd(&*aIt, &*bIt, iInc);
+                *outIt2 = dot(&*aIt, &*bIt, iInc);
                 bIt += iInc;
             }
 
             aIt += iInc;
         }
     }
-
-    template<class MultiplyAddType>
-    void multiplyAddImpl(const Tensor& scale, const Tensor& in, Tensor& out)
-    {
-        MultiplyAddType()(&*in.begin(), &*scale.begin(), &*out.begin(), in.getSize());
-    }
 }
 
 std::unique_ptr<Tensor> Tensor::create(std::size_t dims, std::istream& stream)
@@ -99,6 +82,44 @@ std::unique_ptr<Tensor> Tensor::create(std::size_t dims, std::istream& stream)
 
     std::size_t size = tensor->getSize();
 
+    // In v2 files, tensor data is preceded by padding bytes which align it to 64 bytes
+    // from the file beginning:
+    auto modelStream = dynamic_cast<ModelStream*>(&stream);
+
+    if(modelStream && modelStream->getVersion() >= 2)
+    {
+        unsigned int padding = 0;
+
+        if(! Parser::parse(stream, padding))
+        {
+            PT_LOG_ERROR << "Padding parse failed" << std::endl;
+            return std::unique_ptr<Tensor>();
+        }
+
+        if(! stream.ignore(padding) || stream.gcount() != std::streamsize(padding))
+        {
+            PT_LOG_ERROR << "Padding skip failed: " << padding << std::endl;
+            return std::unique_ptr<Tensor>();
+        }
+
+        #if ! PT_DOUBLE_ENABLE
+            // If the file is mapped in memory, the tensor points to it instead of copying its data:
+            char* data = modelStream->map(size * sizeof(Type));
+
+            if(data && reinterpret_cast<std::uintptr_t>(data) % Alignment == 0)
+            {
+                tensor->setBuffer(reinterpret_cast<Type*>(data), size);
+                return tensor;
+            }
+
+            if(data && ! stream.seekg(-std::streamoff(size * sizeof(Type)), std::ios_base::cur))
+            {
+                PT_LOG_ERROR << "Data seek failed" << std::endl;
+                return std::unique_ptr<Tensor>();
+            }
+        #endif
+    }
+
     #if PT_DOUBLE_ENABLE
         std::vector<float> data(size);
         tensor->_data.resize(size);
@@ -126,15 +147,66 @@ std::unique_ptr<Tensor> Tensor::create(std::size_t dims, std::istream& stream)
     return tensor;
 }
 
+Tensor::Tensor(const Tensor& other) :
+    _dims(other._dims),
+    _data(other.begin(), other.end())
+{
+}
+
+Tensor& Tensor::operator=(const Tensor& other)
+{
+    if(this != &other)
+    {
+        other.copyTo(*this);
+    }
+
+    return *this;
+}
+
+Tensor::Tensor(Tensor&& other) noexcept :
+    _dims(std::move(other._dims)),
+    _data(std::move(other._data)),
+    _buffer(other._buffer),
+    _bufferSize(other._bufferSize)
+{
+    other._buffer = nullptr;
+    other._bufferSize = 0;
+}
+
+Tensor& Tensor::operator=(Tensor&& other) noexcept
+{
+    if(this != &other)
+    {
+        _dims = std::move(other._dims);
+        _data = std::move(other._data);
+        _buffer = other._buffer;
+        _bufferSize = other._bufferSize;
+        other._buffer = nullptr;
+        other._bufferSize = 0;
+    }
+
+    return *this;
+}
+
+void Tensor::setBuffer(Type* buffer, std::size_t bufferSize) noexcept
+{
+    PT_ASSERT(buffer);
+    PT_ASSERT(reinterpret_cast<std::uintptr_t>(buffer) % Alignment == 0);
+    PT_ASSERT(getSize() <= bufferSize);
+
+    DataVector().swap(_data);
+    _buffer = buffer;
+    _bufferSize = bufferSize;
+}
+
 void Tensor::copyTo(Tensor& other) const
 {
     other._dims.clear();
     other._dims.reserve(_dims.size());
     other._dims.insert(other._dims.end(), _dims.begin(), _dims.end());
 
-    other._data.clear();
-    other._data.reserve(_data.size());
-    other._data.insert(other._data.end(), _data.begin(), _data.end());
+    other._resizeData(getSize());
+    std::copy(begin(), end(), other.begin());
 }
 
 void Tensor::resize(std::size_t i)
@@ -143,7 +215,7 @@ void Tensor::resize(std::size_t i)
 
     _dims.clear();
     _dims.push_back(i);
-    _data.resize(i);
+    _resizeData(i);
 }
 
 void Tensor::resize(std::size_t i, std::size_t j)
@@ -155,7 +227,7 @@ void Tensor::resize(std::size_t i, std::size_t j)
     _dims.reserve(2);
     _dims.push_back(i);
     _dims.push_back(j);
-    _data.resize(i * j);
+    _resizeData(i * j);
 }
 
 void Tensor::resize(std::size_t i, std::size_t j, std::size_t k)
@@ -169,7 +241,7 @@ void Tensor::resize(std::size_t i, std::size_t j, std::size_t k)
     _dims.push_back(i);
     _dims.push_back(j);
     _dims.push_back(k);
-    _data.resize(i * j * k);
+    _resizeData(i * j * k);
 }
 
 void Tensor::resize(std::size_t i, std::size_t j, std::size_t k, std::size_t l)
@@ -185,7 +257,7 @@ void Tensor::resize(std::size_t i, std::size_t j, std::size_t k, std::size_t l)
     _dims.push_back(j);
     _dims.push_back(k);
     _dims.push_back(l);
-    _data.resize(i * j * k * l);
+    _resizeData(i * j * k * l);
 }
 
 void Tensor::fill(Type value) noexcept
@@ -195,21 +267,40 @@ void Tensor::fill(Type value) noexcept
 
 void Tensor::pad(std::size_t pad_height, std::size_t pad_width, FloatType value)
 {
-    Tensor result;
-    result.resize(_dims[0] + pad_height * 2, _dims[1] + pad_width * 2, _dims[2]);
-    result.fill(value);
-    for (std::size_t y = 0; y < _dims[0]; ++y)
+    PT_ASSERT(_dims.size() == 3);
+
+    // Padding is done in place, moving rows from the last one to the first one:
+    auto height = _dims[0];
+    auto width = _dims[1];
+    auto depth = _dims[2];
+    auto newHeight = height + pad_height * 2;
+    auto newWidth = width + pad_width * 2;
+    auto rowSize = width * depth;
+    auto newRowSize = newWidth * depth;
+    _resizeData(newHeight * newRowSize);
+
+    Type* data = _ptr();
+
+    for(std::size_t y = height; y-- > 0;)
     {
-        for (std::size_t x = 0; x < _dims[1]; ++x)
-        {
-            for (std::size_t z = 0; z < _dims[2]; ++z)
-            {
-                result(y + pad_height, x + pad_width, z) =  _data[_dims[2] * (_dims[1] * y + x) + z];
-            }
-        }
+        const Type* source = data + y * rowSize;
+        Type* dest = data + (y + pad_height) * newRowSize + pad_width * depth;
+        std::copy_backward(source, source + rowSize, dest + rowSize);
     }
-    _dims = std::move(result._dims);
-    _data = std::move(result._data);
+
+    std::fill(data, data + pad_height * newRowSize, value);
+
+    for(std::size_t y = pad_height; y != pad_height + height; ++y)
+    {
+        Type* row = data + y * newRowSize;
+        std::fill(row, row + pad_width * depth, value);
+        std::fill(row + (pad_width + width) * depth, row + newRowSize, value);
+    }
+
+    std::fill(data + (pad_height + height) * newRowSize, data + newHeight * newRowSize, value);
+
+    _dims[0] = newHeight;
+    _dims[1] = newWidth;
 }
 
 void Tensor::flatten()
@@ -227,18 +318,16 @@ void Tensor::unpack(std::size_t row, Tensor& out) const
     PT_ASSERT(_dims.size() >= 2);
     PT_ASSERT(row < _dims[0]);
 
-    auto packSize = std::accumulate(_dims.begin() + 1, _dims.end(), std::size_t(0));
-    auto base = row * packSize;
-    auto first = begin() + long(base);
-    auto last = first + long(packSize);
+    auto packSize = std::accumulate(_dims.begin() + 1, _dims.end(), std::size_t(1),
+                                    std::multiplies<std::size_t>());
+    auto first = begin() + row * packSize;
 
     out._dims.clear();
-    out._dims.reserve(_dims.size() - 1);
+    out._dims.reserve(_dims.size());
     out._dims.insert(out._dims.end(), _dims.begin() + 1, _dims.end());
 
-    out._data.clear();
-    out._data.reserve(std::size_t(last - first));
-    out._data.insert(out._data.end(), first, last);
+    out._resizeData(packSize);
+    std::copy(first, first + packSize, out.begin());
 }
 
 void Tensor::select(std::size_t row, Tensor& out) const
@@ -251,21 +340,8 @@ void Tensor::add(const Tensor& other, Tensor& out) const
 {
     PT_ASSERT(_dims == other._dims);
 
-    auto tensorSize = int(getSize());
     copyTo(out);
-
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
-    {
-        addImpl<Vector2Add>(other, out);
-    }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
-    {
-        addImpl<VectorAdd>(other, out);
-    }
-    else
-    {
-        addImpl<ScalarAdd>(other, out);
-    }
+    Kernels::get().add(other.begin(), out.begin(), int(getSize()));
 }
 
 void Tensor::multiply(const Tensor& other, Tensor& out) const
@@ -273,21 +349,8 @@ void Tensor::multiply(const Tensor& other, Tensor& out) const
     PT_ASSERT(isValid());
     PT_ASSERT(_dims == other._dims);
 
-    auto tensorSize = int(getSize());
     copyTo(out);
-
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
-    {
-        multiplyImpl<Vector2Multiply>(other, out);
-    }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
-    {
-        multiplyImpl<VectorMultiply>(other, out);
-    }
-    else
-    {
-        multiplyImpl<ScalarMultiply>(other, out);
-    }
+    Kernels::get().multiply(other.begin(), out.begin(), int(getSize()));
 }
 
 void Tensor::dot(const Tensor& other, Tensor& out) const
@@ -297,21 +360,7 @@ void Tensor::dot(const Tensor& other, Tensor& out) const
     PT_ASSERT(_dims[1] == other._dims[1]);
 
     out.resize(_dims[0], other._dims[0]);
-
-    auto tensorSize = int(_dims[1]);
-
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
-    {
-        dotImpl<Vector2MultiplyAdd>(*this, other, out);
-    }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
-    {
-        dotImpl<VectorMultiplyAdd>(*this, other, out);
-    }
-    else
-    {
-        dotImpl<ScalarMultiplyAdd>(*this, other, out);
-    }
+    dotImpl(*this, other, out);
 }
 
 void Tensor::fma(const Tensor& scale, const Tensor& bias, Tensor& out) const
@@ -319,21 +368,8 @@ void Tensor::fma(const Tensor& scale, const Tensor& bias, Tensor& out) const
     PT_ASSERT(_dims == scale._dims);
     PT_ASSERT(_dims == bias._dims);
 
-    auto tensorSize = int(getSize());
     bias.copyTo(out);
-
-    if(PT_LOOP_UNROLLING_ENABLE && tensorSize && tensorSize % (Tensor::VectorSize * 2) == 0)
-    {
-        multiplyAddImpl<Vector2MultiplyAdd>(scale, *this, out);
-    }
-    else if(tensorSize && tensorSize % Tensor::VectorSize == 0)
-    {
-        multiplyAddImpl<VectorMultiplyAdd>(scale, *this, out);
-    }
-    else
-    {
-        multiplyAddImpl<ScalarMultiplyAdd>(scale, *this, out);
-    }
+    Kernels::get().multiplyAdd(begin(), scale.begin(), out.begin(), int(getSize()));
 }
 
 void Tensor::eraseDummyDims() noexcept
@@ -360,6 +396,23 @@ void Tensor::clear() noexcept
     _data.clear();
 }
 
+void Tensor::_resizeData(std::size_t size)
+{
+    if(! _buffer)
+    {
+        _data.resize(size);
+    }
+    else if(size > _bufferSize)
+    {
+        // External buffer is too small, so its data is moved back to the tensor memory:
+        _data.reserve(size);
+        _data.assign(_buffer, _buffer + _bufferSize);
+        _data.resize(size);
+        _buffer = nullptr;
+        _bufferSize = 0;
+    }
+}
+
 std::ostream& operator<<(std::ostream& stream, const Tensor& tensor)
 {
     const auto& dims = tensor.getDims();
@@ -368,7 +421,7 @@ std::ostream& operator<<(std::ostream& stream, const Tensor& tensor)
 
     size_t count = 0;
 
-    for(auto value : tensor.getData())
+    for(auto value : tensor)
     {
         for(std::size_t step : steps)
         {
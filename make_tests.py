@@ -10,9 +10,9 @@ from keras import backend as K
 from keras.models import Sequential
 from keras.layers import (
     Conv1D, Conv2D, LocallyConnected1D, Dense, Flatten, Activation,
-    MaxPooling2D, Dropout, BatchNormalization
+    MaxPooling2D, Dropout, BatchNormalization, Masking
 )
-from keras.layers.recurrent import LSTM
+from keras.layers.recurrent import LSTM, GRU, SimpleRNN
 from keras.layers.advanced_activations import ELU, LeakyReLU
 from keras.layers.embeddings import Embedding
 from tensorflow import ConfigProto, Session
@@ -82,14 +82,14 @@ TEST_CASE("%s")
 '''
 
 
-def output_testcase(model, test_x, test_y, name, eps):
+def output_testcase(model, test_x, test_y, name, eps, quantize=False):
     print('Processing %s' % name)
     model.compile(loss='mse', optimizer='adam')
     model.fit(test_x, test_y, epochs=1, verbose=False)
     predict_y = model.predict(test_x).astype('f')
     print(model.summary())
 
-    export_model(model, models_path + '/%s.model' % name)
+    export_model(model, models_path + '/%s.model' % name, quantize)
 
     with open(src_path + '/%s_test.cpp' % name, 'w') as f:
         x_shape, x_data = c_array(test_x[0])
@@ -147,6 +147,16 @@ model = Sequential([
 output_testcase(model, test_x, test_y, 'dense_10x10x10', '1e-6')
 
 
+''' Dense int8 100x10 '''
+test_x = np.random.rand(10, 100).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Dense(10, input_dim=100, activation='relu'),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'dense_int8_100x10', '2e-2', True)
+
+
 ''' Conv1D 2 '''
 test_x = np.random.rand(10, 2, 1).astype('f')
 test_y = np.random.rand(10, 1).astype('f')
@@ -181,6 +191,18 @@ model = Sequential([
 output_testcase(model, test_x, test_y, 'conv1d_3x3', '1e-6')
 
 
+''' Conv1D strided dilated 3x3 '''
+test_x = np.random.rand(10, 13, 3).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv1D(4, (3), strides=2, input_shape=(13, 3)),
+    Conv1D(3, (2), dilation_rate=2),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv1d_strided_dilated_3x3', '1e-6')
+
+
 ''' Conv 2x2 '''
 test_x = np.random.rand(10, 2, 2, 1).astype('f')
 test_y = np.random.rand(10, 1).astype('f')
@@ -215,6 +237,110 @@ model = Sequential([
 output_testcase(model, test_x, test_y, 'conv_3x3x3', '1e-6')
 
 
+''' Conv same 3x3 '''
+test_x = np.random.rand(10, 5, 6, 2).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(3, (3, 3), padding='same', input_shape=(5, 6, 2)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_same_3x3', '1e-6')
+
+
+''' Conv same 4x4 '''
+test_x = np.random.rand(10, 5, 6, 2).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(3, (4, 4), padding='same', input_shape=(5, 6, 2)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_same_4x4', '1e-6')
+
+
+''' Conv strided 3x3 '''
+test_x = np.random.rand(10, 9, 10, 2).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(4, (3, 3), strides=(2, 2), padding='same', input_shape=(9, 10, 2)),
+    Conv2D(3, (3, 2), strides=(2, 1)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_strided_3x3', '1e-6')
+
+
+''' Conv dilated 3x3 '''
+test_x = np.random.rand(10, 9, 10, 2).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(4, (3, 3), dilation_rate=(2, 2), padding='same', input_shape=(9, 10, 2)),
+    Conv2D(3, (2, 3), dilation_rate=(3, 2)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_dilated_3x3', '1e-6')
+
+
+''' Conv wide 3x3 '''
+test_x = np.random.rand(10, 6, 7, 16).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(128, (3, 3), padding='same', input_shape=(6, 7, 16)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_wide_3x3', '1e-5')
+
+
+''' Conv GEMM 5x5 '''
+test_x = np.random.rand(10, 12, 12, 12).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(128, (5, 5), padding='same', input_shape=(12, 12, 12)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_gemm_5x5', '1e-5')
+
+
+''' Conv GEMM strided dilated 3x3 '''
+test_x = np.random.rand(10, 13, 14, 32).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(128, (3, 3), strides=(2, 2), padding='same', input_shape=(13, 14, 32)),
+    Conv2D(128, (3, 3), dilation_rate=(2, 2), padding='same'),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_gemm_strided_dilated_3x3', '1e-5')
+
+
+''' Conv Winograd 3x3 '''
+test_x = np.random.rand(10, 7, 9, 8).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(8, (3, 3), padding='same', input_shape=(7, 9, 8)),
+    Conv2D(16, (3, 3)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_winograd_3x3', '1e-6')
+
+
+''' Conv int8 3x3 '''
+test_x = np.random.rand(10, 7, 9, 3).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Conv2D(8, (3, 3), padding='same', activation='relu', input_shape=(7, 9, 3)),
+    Conv2D(4, (3, 3), strides=(2, 2)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'conv_int8_3x3', '2e-2', True)
+
+
 ''' LocallyConnected1D 2 '''
 test_x = np.random.rand(10, 2, 1).astype('f')
 test_y = np.random.rand(10, 1).astype('f')
@@ -424,6 +550,17 @@ model = Sequential([
 output_testcase(model, test_x, test_y, 'maxpool2d_3x3x3', '1e-6')
 
 
+''' Maxpooling2D strided 3x3x3'''
+test_x = np.random.rand(10, 10, 10, 3).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    MaxPooling2D(pool_size=(3, 3), strides=(2, 1), input_shape=(10, 10, 3)),
+    Flatten(),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'maxpool2d_strided_3x3x3', '1e-6')
+
+
 ''' LSTM simple 7x20 '''
 test_x = np.random.rand(10, 7, 20).astype('f')
 test_y = np.random.rand(10, 3).astype('f')
@@ -455,6 +592,17 @@ model = Sequential([
 output_testcase(model, test_x, test_y, 'lstm_stacked_64x83', '1e-6')
 
 
+''' LSTM int8 stacked 16x9 '''
+test_x = np.random.rand(10, 16, 9).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    LSTM(16, return_sequences=True, input_shape=(16, 9)),
+    LSTM(8, return_sequences=False),
+    Dense(1, activation='sigmoid')
+])
+output_testcase(model, test_x, test_y, 'lstm_int8_stacked_16x9', '2e-2', True)
+
+
 ''' Embedding 64 '''
 np.random.seed(10)
 test_x = np.random.randint(100, size=(32, 10)).astype('f')
@@ -466,3 +614,77 @@ model = Sequential([
     Dense(20, activation='sigmoid')
 ])
 output_testcase(model, test_x, test_y, 'embedding_64', '1e-6')
+
+
+''' Embedding mask zero LSTM 20 '''
+np.random.seed(11)
+test_x = np.random.randint(1, 100, size=(32, 20)).astype('f')
+for sample in range(32):
+    test_x[sample, :np.random.randint(20)] = 0
+test_y = np.random.rand(32, 1).astype('f')
+model = Sequential([
+    Embedding(100, 16, input_length=20, mask_zero=True),
+    LSTM(8, return_sequences=False),
+    Dense(1, activation='sigmoid')
+])
+output_testcase(model, test_x, test_y, 'embedding_mask_zero_lstm_20', '1e-6')
+
+
+''' Masking stacked LSTM 12x6 '''
+test_x = np.random.rand(10, 12, 6).astype('f')
+for sample in range(10):
+    test_x[sample, :np.random.randint(12)] = 0
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Masking(mask_value=0., input_shape=(12, 6)),
+    LSTM(8, return_sequences=True),
+    LSTM(4, return_sequences=False),
+    Dense(1)
+])
+output_testcase(model, test_x, test_y, 'masking_lstm_stacked_12x6', '1e-6')
+
+
+''' Embedding stacked LSTM 30 '''
+test_x = np.random.randint(1000, size=(10, 30)).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    Embedding(1000, 32, input_length=30),
+    LSTM(16, return_sequences=True),
+    LSTM(8, return_sequences=False),
+    Dense(1, activation='sigmoid')
+])
+output_testcase(model, test_x, test_y, 'embedding_lstm_stacked_30', '1e-6')
+
+
+''' GRU stacked 16x9 '''
+test_x = np.random.rand(10, 16, 9).astype('f')
+test_y = np.random.rand(10, 1).astype('f')
+model = Sequential([
+    GRU(16, return_sequences=True, input_shape=(16, 9)),
+    GRU(8, return_sequences=False),
+    Dense(1, activation='sigmoid')
+])
+output_testcase(model, test_x, test_y, 'gru_stacked_16x9', '1e-6')
+
+
+''' GRU reset after 7x20 '''
+test_x = np.random.rand(10, 7, 20).astype('f')
+test_y = np.random.rand(10, 3).astype('f')
+model = Sequential([
+    GRU(3, reset_after=True, return_sequences=False, input_shape=(7, 20))
+])
+output_testcase(model, test_x, test_y, 'gru_reset_after_7x20', '1e-6')
+
+
+''' Embedding mask zero GRU SimpleRNN 20 '''
+test_x = np.random.randint(1, 100, size=(32, 20)).astype('f')
+for sample in range(32):
+    test_x[sample, :np.random.randint(20)] = 0
+test_y = np.random.rand(32, 1).astype('f')
+model = Sequential([
+    Embedding(100, 16, input_length=20, mask_zero=True),
+    GRU(8, return_sequences=True),
+    SimpleRNN(4, return_sequences=False),
+    Dense(1, activation='sigmoid')
+])
+output_testcase(model, test_x, test_y, 'embedding_mask_zero_gru_simple_rnn_20', '1e-6')
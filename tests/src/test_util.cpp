@@ -1,9 +1,249 @@
 #include "test_util.h"
 
+#include <cmath>
+#include <algorithm>
 #include <chrono>
+#include <thread>
 #include <iostream>
+#include <vector>
 #include "pt_model.h"
 #include "pt_dispatcher.h"
+#include "pt_execution_context.h"
+#include "pt_execution_context_pool.h"
+#include "pt_streaming_session.h"
+
+namespace
+{
+    void checkOutput(const pt::Tensor::Type* out, std::size_t outSize, const pt::Tensor& expected, float eps)
+    {
+        REQUIRE(outSize == expected.getSize());
+
+        for(std::size_t i = 0; i != outSize; ++i)
+        {
+            auto diff = std::fabs(out[i] - expected.begin()[i]);
+
+            if(diff >= pt::FloatType(eps))
+            {
+                std::cout << "Diff: " << diff << std::endl;
+                REQUIRE(diff < pt::FloatType(eps));
+            }
+        }
+    }
+
+    void checkOutput(const pt::Tensor& out, const pt::Tensor& expected, float eps)
+    {
+        REQUIRE(out.isValid());
+
+        checkOutput(out.begin(), out.getSize(), expected, eps);
+    }
+
+    // Sequence models are the ones with recurrent layers, which keep a state between timesteps:
+    bool isSequenceModel(const pt::Model& model, pt::Dispatcher& dispatcher, const pt::Tensor& in)
+    {
+        pt::StreamingSession session(model, dispatcher);
+        auto state = session.snapshot();
+
+        return in.getDims().size() <= 2 &&
+                std::any_of(state.begin(), state.end(), [](const pt::Tensor& layerState) { return layerState.isValid(); });
+    }
+
+    // Returns the first timesteps of a sequence input:
+    pt::Tensor getSteps(const pt::Tensor& in, std::size_t steps)
+    {
+        const auto& inDims = in.getDims();
+        pt::Tensor result;
+
+        if(inDims.size() == 1)
+        {
+            result.resize(steps);
+        }
+        else
+        {
+            result.resize(steps, inDims[1]);
+        }
+
+        std::copy(in.begin(), in.begin() + long(result.getSize()), result.begin());
+        return result;
+    }
+
+    // Runs all samples of the batch at once, which must give the same output as predicting them one by one:
+    void testBatch(const pt::Model& model, pt::Dispatcher& dispatcher, const pt::Tensor& in,
+                   const pt::Tensor& expected, float eps)
+    {
+        std::vector<pt::Tensor> batchIn(3, in);
+        std::vector<pt::Tensor> batchOut;
+        REQUIRE(model.predictBatch(dispatcher, batchIn, batchOut));
+        REQUIRE(batchOut.size() == batchIn.size());
+
+        for(const pt::Tensor& out : batchOut)
+        {
+            checkOutput(out, expected, eps);
+        }
+
+        // Sequences of different lengths are batched too; length 1 is skipped because it makes the input
+        // of stacked recurrent layers lose its timesteps dimension:
+        std::size_t steps = in.getDims()[0];
+
+        if(steps < 3 || ! isSequenceModel(model, dispatcher, in))
+        {
+            return;
+        }
+
+        pt::Tensor prefix = getSteps(in, std::max(steps / 2, std::size_t(2)));
+        pt::Tensor prefixExpected;
+        REQUIRE(model.predict(dispatcher, prefix, prefixExpected));
+
+        batchIn[1] = prefix;
+        REQUIRE(model.predictBatch(dispatcher, batchIn, batchOut));
+        REQUIRE(batchOut.size() == batchIn.size());
+        checkOutput(batchOut[0], expected, eps);
+        checkOutput(batchOut[1], prefixExpected, eps);
+        checkOutput(batchOut[2], expected, eps);
+    }
+
+    // The second prediction reuses the memory planned by the first one:
+    void testContext(const pt::Model& model, pt::Dispatcher& dispatcher, const pt::Tensor& in,
+                     const pt::Tensor& expected, float eps)
+    {
+        pt::ExecutionContext context(model, dispatcher);
+        pt::Tensor out;
+
+        for(int iteration = 0; iteration != 2; ++iteration)
+        {
+            REQUIRE(model.predict(context, in, out));
+            checkOutput(out, expected, eps);
+        }
+    }
+
+    // Input and output are read and written in caller memory, in place if it is aligned and with copies otherwise:
+    void testViews(const pt::Model& model, pt::Dispatcher& dispatcher, const pt::Tensor& in,
+                   const pt::Tensor& expected, float eps)
+    {
+        pt::ExecutionContext context(model, dispatcher);
+        REQUIRE(context.plan(in.getDims()));
+
+        const auto& outDims = context.getOutputDims();
+        auto inSize = in.getSize();
+        auto outSize = expected.getSize();
+        pt::Tensor alignedOut(outSize);
+        REQUIRE(model.predict(context, pt::ConstTensorView(in), pt::TensorView(alignedOut.begin(), outDims)));
+        checkOutput(alignedOut.begin(), outSize, expected, eps);
+
+        std::vector<pt::Tensor::Type> unalignedIn(inSize + 1);
+        std::vector<pt::Tensor::Type> unalignedOut(outSize + 1);
+        std::copy(in.begin(), in.end(), unalignedIn.begin() + 1);
+
+        pt::ConstTensorView inView(unalignedIn.data() + 1, in.getDims());
+        REQUIRE(model.predict(context, inView, pt::TensorView(unalignedOut.data() + 1, outDims)));
+        checkOutput(unalignedOut.data() + 1, outSize, expected, eps);
+    }
+
+    // Predictions run with pooled contexts, from the calling thread and from another one at the same time:
+    void testPool(const pt::Model& model, const pt::Tensor& in, const pt::Tensor& expected, float eps)
+    {
+        pt::ExecutionContextPool pool(model, 2);
+        pt::Tensor threadOut;
+        bool threadSuccess = false;
+        std::thread thread([&]{ threadSuccess = pool.predict(in, threadOut); });
+
+        pt::Tensor out;
+        bool success = pool.predict(in, out);
+        thread.join();
+
+        REQUIRE(success);
+        REQUIRE(threadSuccess);
+        checkOutput(out, expected, eps);
+        checkOutput(threadOut, expected, eps);
+    }
+
+    // Feeds the timesteps [stepBegin, stepEnd) of a sequence input one at a time:
+    void streamSteps(pt::StreamingSession& session, const pt::Tensor& in, std::size_t stepBegin, std::size_t stepEnd,
+                     pt::Tensor& out)
+    {
+        pt::Tensor frame = getSteps(in, 1);
+        auto frameSize = frame.getSize();
+
+        for(std::size_t step = stepBegin; step != stepEnd; ++step)
+        {
+            auto frameIt = in.begin() + long(step * frameSize);
+            std::copy(frameIt, frameIt + long(frameSize), frame.begin());
+            REQUIRE(session.step(frame, out));
+        }
+    }
+
+    // The output of the last timestep is the expected output, or its last row if the model returns sequences:
+    void checkLastStep(const pt::Tensor& out, const pt::Tensor& expected, std::size_t steps, float eps)
+    {
+        REQUIRE(out.isValid());
+
+        auto outSize = out.getSize();
+
+        if(outSize == expected.getSize())
+        {
+            checkOutput(out, expected, eps);
+            return;
+        }
+
+        REQUIRE(outSize * steps == expected.getSize());
+
+        pt::Tensor lastExpected(outSize);
+        std::copy(expected.end() - long(outSize), expected.end(), lastExpected.begin());
+        checkOutput(out, lastExpected, eps);
+    }
+
+    // Sequence models fed one timestep at a time must give the expected output after the last timestep,
+    // also when the second half of the sequence is replayed from a snapshot and after a reset:
+    void testStreaming(const pt::Model& model, pt::Dispatcher& dispatcher, const pt::Tensor& in,
+                       const pt::Tensor& expected, float eps)
+    {
+        if(! isSequenceModel(model, dispatcher, in))
+        {
+            return;
+        }
+
+        pt::StreamingSession session(model, dispatcher);
+        std::size_t steps = in.getDims()[0];
+        std::size_t half = steps / 2;
+        pt::Tensor out;
+
+        streamSteps(session, in, 0, half, out);
+
+        auto state = session.snapshot();
+        streamSteps(session, in, half, steps, out);
+        checkLastStep(out, expected, steps, eps);
+
+        // Timesteps are quantized on their own, so quantized models give the same output as predict too:
+        pt::Tensor predicted;
+        REQUIRE(model.predict(dispatcher, in, predicted));
+        checkLastStep(out, predicted, steps, 1e-5f);
+
+        REQUIRE(session.restore(state));
+        streamSteps(session, in, half, steps, out);
+        checkLastStep(out, expected, steps, eps);
+
+        session.reset();
+        streamSteps(session, in, 0, steps, out);
+        checkLastStep(out, expected, steps, eps);
+
+        // States of other models are rejected:
+        auto invalidState = state;
+        invalidState.emplace_back();
+        REQUIRE(! session.restore(invalidState));
+
+        invalidState = state;
+
+        for(pt::Tensor& layerState : invalidState)
+        {
+            if(layerState.isValid())
+            {
+                layerState.resize(layerState.getSize() + 1);
+                break;
+            }
+        }
+
+        REQUIRE(! session.restore(invalidState));
+    }
+}
 
 void testModel(pt::Tensor& in, const pt::Tensor& expected, const char* modelFileName, float eps)
 {
@@ -21,17 +261,14 @@ void testModel(pt::Tensor& in, const pt::Tensor& expected, const char* modelFile
     bool success = model->predict(dispatcher, in, out);
     auto elapsedTime = std::chrono::high_resolution_clock::now() - startTime;
     REQUIRE(success);
-    REQUIRE(out.isValid());
-
-    for(std::size_t i = 0, l = out.getDims()[0]; i != l; ++i)
-    {
-        if(std::fabs(out(i) - expected(i)) >= pt::FloatType(eps))
-        {
-	    std::cout << "Diff: " << std::fabs(out(i) - expected(i)) << std::endl;
-            REQUIRE(std::fabs(out(i) - expected(i)) < pt::FloatType(eps));
-        }
-    }
+    checkOutput(out, expected, eps);
 
     auto elapsedMcs = std::chrono::duration_cast<std::chrono::microseconds>(elapsedTime).count();
     std::cout << modelFileName << " elapsed mcs: " << elapsedMcs << std::endl;
+
+    testBatch(*model, dispatcher, in, expected, eps);
+    testContext(*model, dispatcher, in, expected, eps);
+    testViews(*model, dispatcher, in, expected, eps);
+    testPool(*model, in, expected, eps);
+    testStreaming(*model, dispatcher, in, expected, eps);
 }